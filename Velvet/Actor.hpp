@@ -3,9 +3,11 @@
 #include <iostream>
 #include <vector>
 
+#include <fmt/core.h>
+#ifndef VT_HEADLESS
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <fmt/core.h>
+#endif
 
 #include "Component.hpp"
 #include "Transform.hpp"
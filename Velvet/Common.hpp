@@ -26,6 +26,7 @@ struct VtSimParams
 	// forces
 	glm::vec3 gravity				HOST_INIT(glm::vec3(0, -9.8f, 0));	//!< Constant acceleration applied to all particles
 	float bendCompliance			HOST_INIT(10.0f);
+	bool enableBending				HOST_INIT(true);					//!< Run the CPU bending sweep, whose corrections are accumulated in deltas only
 	float damping					HOST_INIT(0.25f);					//!< Viscous drag force, applies a force proportional, and opposite to the particle velocity
 	float relaxationFactor			HOST_INIT(1.0f);					//!< Control the convergence rate of the parallel solver, default: 1, values greater than 1 may lead to instability
 	float longRangeStretchiness		HOST_INIT(1.2f);
@@ -36,6 +37,23 @@ struct VtSimParams
 	bool enableSelfCollision		HOST_INIT(true);
 	int interleavedHash				HOST_INIT(3);						//!< Hash once every n substeps. This can improves performance greatly.
 
+	// cpu solver
+	int numThreads					HOST_INIT(1);						//!< Number of worker threads the CPU solver may use
+	int threadAffinity				HOST_INIT(0);						//!< Pin CPU solver workers: 0 off, 1 compact (one NUMA node after another), 2 scatter (round robin over nodes)
+	bool numaFirstTouch				HOST_INIT(false);					//!< Let each worker first write the solver arrays it sweeps, so they live on its NUMA node
+	int minParallelParticles		HOST_INIT(4096);					//!< Cloths with fewer particles are solved on the calling thread only
+	bool deterministic				HOST_INIT(true);					//!< Fixed work partitions and reduction orders, results do not depend on the thread count
+	bool coloredConstraints			HOST_INIT(false);					//!< Solve constraints in conflict-free lane groups with SIMD kernels and colors in parallel. Changes the Gauss-Seidel order
+	bool jacobiCPU					HOST_INIT(false);					//!< Solve stretch and self collision as Jacobi gathers like the GPU solver, relaxed by relaxationFactor
+	bool gridStretch				HOST_INIT(false);					//!< Solve stretch on grid cloths with an index-free stencil sweep, not with Morton-ordered particles
+	int cacheTileKB					HOST_INIT(0);						//!< Solve all stretch iterations of a substep tile by tile, with tiles of about this many KiB (e.g. the L2 size), 0 disables
+	bool fusedSweeps				HOST_INIT(false);					//!< Finalize each substep in one sweep with the next PredictPositions and CollideSDF, and the last one with the mesh copy
+	bool solverArena				HOST_INIT(true);					//!< Allocate solver, spatial hash and mesh staging buffers from one arena that scene reloads reuse
+	bool compactState				HOST_INIT(false);					//!< fp16 velocities and stretch rest lengths, 16-bit constraint and neighbor indices. Less memory traffic, less precision
+	int arenaHugePages				HOST_INIT(0);						//!< Back solver arenas with huge pages: 0 off, 1 transparent (Linux), 2 explicit (hugetlbfs pool, or Windows large pages)
+	bool reorderParticles			HOST_INIT(false);					//!< Store particles in Morton order of their position and constraints by first particle, applied at initialization
+	int reorderInterval				HOST_INIT(0);						//!< Re-sort particles every n frames while reorderParticles is set, 0 sorts once at initialization
+
 	// runtime info
 	unsigned int numParticles;											//!< Total number of particles 
 	float particleDiameter;												//!< The maximum interaction radius for particles
@@ -60,7 +78,22 @@ struct VtSimParams
 		IMGUI_LEFT_LABEL(ImGui::SliderFloat, "Friction", &friction, 0, 1);
 		IMGUI_LEFT_LABEL(ImGui::SliderFloat, "Collision Margin", &collisionMargin, 0, 0.5);
 		IMGUI_LEFT_LABEL(ImGui::Checkbox, "Enable Self Collision", &enableSelfCollision);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "Enable Bending", &enableBending);
 		IMGUI_LEFT_LABEL(ImGui::SliderInt, "Interleaved Hash", &interleavedHash, 1, 10);
+		IMGUI_LEFT_LABEL(ImGui::SliderInt, "CPU Threads", &numThreads, 1, 64);
+		IMGUI_LEFT_LABEL(ImGui::SliderInt, "CPU Thread Affinity", &threadAffinity, 0, 2);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU NUMA First Touch", &numaFirstTouch);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "Deterministic", &deterministic);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU Colored Constraints", &coloredConstraints);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU Jacobi", &jacobiCPU);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU Grid Stretch", &gridStretch);
+		IMGUI_LEFT_LABEL(ImGui::SliderInt, "CPU Cache Tile (KiB)", &cacheTileKB, 0, 4096);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU Fused Sweeps", &fusedSweeps);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU Solver Arena", &solverArena);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU Compact State", &compactState);
+		IMGUI_LEFT_LABEL(ImGui::SliderInt, "CPU Arena Huge Pages", &arenaHugePages, 0, 2);
+		IMGUI_LEFT_LABEL(ImGui::Checkbox, "CPU Morton Order", &reorderParticles);
+		IMGUI_LEFT_LABEL(ImGui::SliderInt, "CPU Reorder Interval", &reorderInterval, 0, 600);
 		ImGui::Separator();
 		IMGUI_LEFT_LABEL(ImGui::SliderFloat, "Relaxation Factor", &relaxationFactor, 0, 3.0);
 		//IMGUI_LEFT_LABEL(ImGui::SliderFloat, "Bend Compliance", &bendCompliance, 1e-3, 100.0, "%.3f", ImGuiSliderFlags_Logarithmic);
@@ -2,6 +2,8 @@
 
 #include "Scene.hpp"
 #include "VtEngine.hpp"
+#include "VtProfiler.hpp"
+#include "VtMemoryReport.hpp"
 
 using namespace Velvet;
 
@@ -29,6 +31,23 @@ struct SolverTiming
 {
 	int count = 0;
 
+#ifdef SOLVER_CPU
+	// CPU phases are recorded by VT_PROFILE_SCOPE
+	vector<string> labels = {
+		"Predict",
+		"SolveStretch",
+		"SolveBending",
+		"SolveAttach",
+		"CollideSDFs",
+		"CollideParticles",
+		"Finalize",
+		"UpdateNormals",
+
+		"HashObjects",
+
+		"Total",
+	};
+#else
 	vector<string> labels = {
 		"SetParams",
 		//"Initialize",
@@ -49,6 +68,7 @@ struct SolverTiming
 
 		"Total",
 	};
+#endif
 
 	unordered_map<string, double> label2time;
 	unordered_map<string, double> label2avgTime;
@@ -94,6 +114,20 @@ struct SolverTiming
 		}
 	}
 
+	// returns time in mili seconds
+	double GetTime(const string& label)
+	{
+#ifdef SOLVER_CPU
+		if (label == "Total")
+		{
+			return Timer::GetTimer("Solver_Total") * 1000;
+		}
+		return Profiler::LastRecordedTime("Solver_" + label) * 1000;
+#else
+		return Timer::GetTimerGPU("Solver_" + label);
+#endif
+	}
+
 	void Update()
 	{
 		if (Timer::PeriodicUpdate("GUI_SOLVER", 0.2f))
@@ -111,7 +145,7 @@ struct SolverTiming
 			label2time["KernelSum"] = 0;
 			for (const auto& label : labels)
 			{
-				label2time[label] = Timer::GetTimerGPU("Solver_" + label);
+				label2time[label] = GetTime(label);
 				label2avgTime[label] += label2time[label];
 
 				if (label != "Total" && label != "Initialize") label2time["KernelSum"] += label2time[label];
@@ -127,9 +161,11 @@ struct SolverTiming
 		if (!ImGui::CollapsingHeader("Solver timing"))// , ImGuiTreeNodeFlags_DefaultOpen))
 		{
 			Global::gameState.detailTimer = false;
+			Timer::SetDetailTimerGPU(false);
 			return;
 		}
 		Global::gameState.detailTimer = true;
+		Timer::SetDetailTimerGPU(true);
 
 		//float averageGPUTime = (float)(label2avgTime["KernelSum"] / count);
 		//int averageFPS = (averageGPUTime > 0.0f) ? (int)(1000.0f / (averageGPUTime)) : 0;
@@ -163,7 +199,156 @@ struct SolverTiming
 
 			ImGui::EndTable();
 		}
+
+#ifdef VT_PROFILER
+		if (ImGui::Button("Save Chrome Trace"))
+		{
+			auto path = fmt::format("velvet_trace_{}.json", Timer::frameCount());
+			if (Profiler::ExportChromeTrace(path, 60))
+			{
+				fmt::print("Info(GUI): Profiler trace saved to [{}].\n", path);
+			}
+		}
+		HelpMarker("Saves the last 60 frames. Open with chrome://tracing or ui.perfetto.dev");
+#endif
+	}
+};
+
+#ifdef SOLVER_CPU
+// Residuals recorded by VtClothSolverCPU while the header is open
+struct SolverConvergence
+{
+	float iterationValues[2][256] = {};
+	float historyValues[4][VtConvergenceRecorder::k_historyLength] = {};
+	int numIterationValues = 0;
+	int numHistoryValues = 0;
+
+	void OnGUI()
+	{
+		auto cloths = Global::game->FindComponents<VtClothObjectCPU>();
+		bool open = ImGui::CollapsingHeader("Solver convergence");
+		for (auto cloth : cloths)
+		{
+			cloth->solver()->convergence.enabled = open;
+		}
+		if (!open || cloths.empty()) return;
+
+		// Only the first cloth is shown
+		const auto& convergence = cloths[0]->solver()->convergence;
+		numIterationValues = min((int)convergence.samples.size(), IM_ARRAYSIZE(iterationValues[0]));
+		for (int i = 0; i < numIterationValues; i++)
+		{
+			iterationValues[0][i] = convergence.samples[i].stretchRms * 1000;
+			iterationValues[1][i] = convergence.samples[i].bendingRms;
+		}
+		numHistoryValues = convergence.historySize;
+		for (int i = 0; i < numHistoryValues; i++)
+		{
+			const auto& sample = convergence.HistoryAt(i);
+			historyValues[0][i] = sample.maxViolation * 1000;
+			historyValues[1][i] = sample.maxPenetration * 1000;
+			historyValues[2][i] = sample.bendingMax;
+			historyValues[3][i] = sample.kineticEnergy;
+		}
+
+		ImGui::PushItemWidth(-FLT_MIN);
+		ImGui::Text("Last frame, per substep x iteration");
+		PlotValues(iterationValues[0], numIterationValues, "Stretch RMS: {:.3f} mm");
+		PlotValues(iterationValues[1], numIterationValues, "Bending RMS: {:.4f} rad");
+		ImGui::Text("End of frame, last %d frames", numHistoryValues);
+		PlotValues(historyValues[0], numHistoryValues, "Max violation: {:.3f} mm");
+		PlotValues(historyValues[1], numHistoryValues, "Penetration: {:.3f} mm");
+		PlotValues(historyValues[2], numHistoryValues, "Bending max: {:.4f} rad");
+		PlotValues(historyValues[3], numHistoryValues, "Kinetic energy: {:.2f}");
+		ImGui::PopItemWidth();
+		HelpMarker("Recording adds to solver time. Run VelvetHeadless with --residuals <file> to export every sample as json.");
+	}
+
+	void PlotValues(const float* values, int count, const char* format)
+	{
+		if (count == 0) return;
+		float maxValue = *max_element(values, values + count);
+		auto overlay = fmt::format(fmt::runtime(format), values[count - 1]);
+		ImGui::PlotLines(fmt::format("##{}", format).c_str(), values, count, 0, overlay.c_str(), 0, maxValue * 1.1f + 1e-6f, ImVec2(0, 50.0f));
+	}
+};
+#endif
+
+// Spatial hash quality and contact counts, collected while the header is open
+struct BroadphaseStat
+{
+	void OnGUI()
+	{
+		bool open = ImGui::CollapsingHeader("Broadphase");
+#ifdef SOLVER_CPU
+		auto cloths = Global::game->FindComponents<VtClothObjectCPU>();
+		for (auto cloth : cloths)
+		{
+			if (cloth->solver()->spatialHash()) cloth->solver()->spatialHash()->collectStats = open;
+		}
+		if (!open || cloths.empty() || !cloths[0]->solver()->spatialHash()) return;
+
+		// Only the first cloth is shown
+		auto solver = cloths[0]->solver();
+		ShowHashStats(solver->spatialHash()->stats);
+		ShowContacts(solver->contactStats, solver->colliders());
+#else
+		auto solvers = Global::game->FindComponents<VtClothSolverGPU>();
+		for (auto solver : solvers)
+		{
+			if (solver->spatialHash()) solver->spatialHash()->collectStats = open;
+		}
+		if (!open || solvers.empty() || !solvers[0]->spatialHash()) return;
+
+		ShowHashStats(solvers[0]->spatialHash()->stats);
+		ImGui::TextDisabled("Contact counts are only collected by the CPU solver");
+#endif
+	}
+
+	void ShowHashStats(const VtBroadphaseStats& stats)
+	{
+		if (!stats.valid)
+		{
+			ImGui::Text("No rehash yet (enable self collision)");
+			return;
+		}
+
+		if (ImGui::BeginTable("broadphase", 2, ImGuiTableFlags_SizingStretchProp))
+		{
+			auto row = [](const char* label, const string& value) {
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(label);
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(value.c_str());
+			};
+			row("Occupied buckets: ", fmt::format("{} / {}", stats.occupiedBuckets, stats.tableSize));
+			row("Bucket size: ", fmt::format("mean {:.2f}, max {}", stats.meanBucketSize, stats.maxBucketSize));
+			row("Hash collisions: ", fmt::format("{:.1f}% of {} cells", stats.collisionRate * 100, stats.numCells));
+			row("Neighbors: ", fmt::format("mean {:.2f}, max {}", stats.meanNeighbors, stats.maxNeighbors));
+			row("At neighbor cap: ", fmt::format("{} (max {})", stats.numCapped, Global::simParams.maxNumNeighbors));
+			ImGui::EndTable();
+		}
+		HelpMarker("A hash collision is a grid cell sharing its bucket with another cell. Their particles are visited but rejected by the distance test.");
+
+		float histogram[VtBroadphaseStats::k_numHistogramBins];
+		for (int i = 0; i < VtBroadphaseStats::k_numHistogramBins; i++)
+		{
+			histogram[i] = (float)stats.histogram[i];
+		}
+		ImGui::PushItemWidth(-FLT_MIN);
+		ImGui::PlotHistogram("##neighbors", histogram, VtBroadphaseStats::k_numHistogramBins, 0,
+			"Neighbors per particle: 0, 1, 2-3, ..., 64+", 0, (float)stats.numObjects, ImVec2(0, 60.0f));
+		ImGui::PopItemWidth();
 	}
+
+#ifdef SOLVER_CPU
+	void ShowContacts(const VtContactStats& contacts, const vector<Collider*>& colliders)
+	{
+		ImGui::Text("Particle contacts: %d", contacts.particleContacts);
+		for (int i = 0; i < contacts.colliderContacts.size() && i < colliders.size(); i++)
+		{
+			ImGui::Text("%s contacts: %d", colliders[i]->actor->name.c_str(), contacts.colliderContacts[i]);
+		}
+	}
+#endif
 };
 
 struct PerformanceStat
@@ -410,13 +595,77 @@ void GUI::ShowOptionWindow()
 	ImGui::End();
 }
 
+// Bytes held per subsystem. Sampled every frame so that the peaks cover the whole session.
+struct MemoryStat
+{
+	VtMemoryReport report;
+
+	void Update()
+	{
+		report.Sample(Global::game);
+	}
+
+	void OnGUI()
+	{
+		if (!ImGui::CollapsingHeader("Memory")) return;
+
+		ImGui::Text("Particles: %zu", report.numParticles);
+		if (ImGui::BeginTable("memory", 4, ImGuiTableFlags_SizingStretchProp))
+		{
+			ImGui::TableSetupColumn("Subsystem");
+			ImGui::TableSetupColumn("Current");
+			ImGui::TableSetupColumn("B/particle");
+			ImGui::TableSetupColumn("Peak");
+			ImGui::TableHeadersRow();
+
+			for (const auto& subsystem : report.subsystems)
+			{
+				ImGui::TableNextColumn();
+				bool expanded = ImGui::TreeNode(subsystem.name);
+				Row(subsystem.bytes, subsystem.peakBytes);
+				if (!expanded) continue;
+
+				for (const auto& entry : report.entries)
+				{
+					if (strcmp(entry.subsystem, subsystem.name) != 0) continue;
+					ImGui::TableNextColumn(); ImGui::TextUnformatted(entry.name);
+					Row(entry.bytes, entry.peakBytes);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::TableNextColumn(); ImGui::TextUnformatted("Total");
+			Row(report.totalBytes, report.peakTotalBytes);
+			ImGui::EndTable();
+		}
+
+		size_t processPeak = VtMemoryReport::ProcessPeakBytes();
+		if (processPeak > 0)
+		{
+			ImGui::Text("Process peak: %s", VtMemoryReport::FormatBytes(processPeak).c_str());
+		}
+		if (ImGui::Button("Reset Peaks"))
+		{
+			report = VtMemoryReport();
+		}
+		HelpMarker("Allocated capacity of CPU buffers and the size of buffers uploaded to OpenGL. "
+			"Run VelvetHeadless with --memory-report to print the same table for a scene.");
+	}
+
+	void Row(size_t bytes, size_t peakBytes)
+	{
+		ImGui::TableNextColumn(); ImGui::TextUnformatted(VtMemoryReport::FormatBytes(bytes).c_str());
+		ImGui::TableNextColumn(); ImGui::Text("%.1f", report.BytesPerParticle(bytes));
+		ImGui::TableNextColumn(); ImGui::TextUnformatted(VtMemoryReport::FormatBytes(peakBytes).c_str());
+	}
+};
+
 void GUI::ShowStatWindow()
 {
 	ImGui::SetNextWindowSize(ImVec2(k_rightWindowWidth * 1.1f, 0));
 	ImGui::SetNextWindowPos(ImVec2(m_canvasWidth - k_rightWindowWidth * 1.1f - 20, 20.0f));
 	ImGui::Begin("Statistics", NULL, k_windowFlags);
 	#ifdef SOLVER_CPU
-	ImGui::Text("Cloth Solver: CPU");
+	ImGui::Text("Cloth Solver: CPU (%s)", VtSimd::Name(VtSimd::Active()));
 	#else
 	ImGui::Text("Cloth Solver: GPU");
 	#endif
@@ -430,6 +679,18 @@ void GUI::ShowStatWindow()
 	solverTiming.Update();
 	solverTiming.OnGUI();
 
+#ifdef SOLVER_CPU
+	static SolverConvergence solverConvergence;
+	solverConvergence.OnGUI();
+#endif
+
+	static BroadphaseStat broadphaseStat;
+	broadphaseStat.OnGUI();
+
+	static MemoryStat memoryStat;
+	memoryStat.Update();
+	memoryStat.OnGUI();
+
 	if (!m_showDebugInfo.empty() || !m_showDebugInfoOnce.empty())
 	{
 		if (ImGui::CollapsingHeader("Debug", ImGuiTreeNodeFlags_DefaultOpen))
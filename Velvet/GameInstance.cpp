@@ -5,13 +5,18 @@
 #include <fmt/core.h>
 
 #include "Helper.hpp"
+#include "Actor.hpp"
+#include "Timer.hpp"
+#include "Global.hpp"
+#include "VtProfiler.hpp"
+#ifndef VT_HEADLESS
 #include "Camera.hpp"
 #include "Input.hpp"
 #include "RenderPipeline.hpp"
 #include "GUI.hpp"
-#include "Timer.hpp"
 #include "VtEngine.hpp"
 #include "Resource.hpp"
+#endif
 
 using namespace Velvet;
 
@@ -22,7 +27,9 @@ GameInstance::GameInstance(GLFWwindow* window, shared_ptr<GUI> gui)
 	// setup members
 	m_window = window;
 	m_gui = gui;
+#ifndef VT_HEADLESS
 	m_renderPipeline = make_shared<RenderPipeline>();
+#endif
 	m_timer = make_shared<Timer>();
 
 	Timer::StartTimer("GAME_INSTANCE_INIT");
@@ -58,12 +65,38 @@ int GameInstance::Run()
 	}
 
 	Initialize();
+#ifndef VT_HEADLESS
 	MainLoop();
+#endif
 	Finalize();
 
 	return 0;
 }
 
+void GameInstance::Initialize()
+{
+	for (const auto& go : m_actors)
+	{
+		go->Start();
+	}
+}
+
+void GameInstance::FixedStep()
+{
+	for (const auto& go : m_actors) go->FixedUpdate();
+
+	animationUpdate.Invoke();
+}
+
+void GameInstance::Finalize()
+{
+	for (const auto& go : m_actors)
+	{
+		go->OnDestroy();
+	}
+}
+
+#ifndef VT_HEADLESS
 unsigned int GameInstance::depthFrameBuffer()
 {
 	return m_renderPipeline->depthTex;
@@ -118,14 +151,6 @@ void GameInstance::ProcessKeyboard(GLFWwindow* m_window)
 	}
 }
 
-void GameInstance::Initialize()
-{
-	for (const auto& go : m_actors)
-	{
-		go->Start();
-	}
-}
-
 void GameInstance::MainLoop()
 {
 	double initTime = Timer::EndTimer("GAME_INSTANCE_INIT") * 1000;
@@ -133,6 +158,7 @@ void GameInstance::MainLoop()
 	// render loop
 	while (!glfwWindowShouldClose(m_window) && !pendingReset)
 	{
+		VT_PROFILE_FRAME();
 		if (windowMinimized())
 		{
 			glfwPollEvents();
@@ -157,9 +183,7 @@ void GameInstance::MainLoop()
 			Timer::NextFrame();
 			if (Timer::NextFixedFrame())
 			{
-				for (const auto& go : m_actors) go->FixedUpdate();
-
-				animationUpdate.Invoke();
+				FixedStep();
 
 				if (Global::gameState.step)
 				{
@@ -186,12 +210,5 @@ void GameInstance::MainLoop()
 		glfwPollEvents();
 	}
 }
-
-void GameInstance::Finalize()
-{
-	for (const auto& go : m_actors)
-	{
-		go->OnDestroy();
-	}
-}
+#endif
 
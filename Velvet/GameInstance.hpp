@@ -5,9 +5,13 @@
 #include <string>
 #include <functional>
 
+#include <glm/glm.hpp>
+#ifndef VT_HEADLESS
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <glm/glm.hpp>
+#else
+struct GLFWwindow;
+#endif
 
 #include "Component.hpp"
 #include "Common.hpp"
@@ -33,6 +37,14 @@ namespace Velvet
 
 		int Run();
 
+		// Start/stop all actors. Run() calls these around the main loop;
+		// drivers without a window (e.g. VtHeadlessEngine) call them directly.
+		void Initialize();
+		void Finalize();
+
+		// Advance one physics frame: fixed update of all actors followed by animation callbacks.
+		void FixedStep();
+
 		void ProcessMouse(GLFWwindow* m_window, double xpos, double ypos);
 		void ProcessScroll(GLFWwindow* m_window, double xoffset, double yoffset);
 		void ProcessKeyboard(GLFWwindow* m_window);
@@ -67,9 +79,7 @@ namespace Velvet
 		glm::vec4 skyColor = glm::vec4(0.0f);
 
 	private:
-		void Initialize();
 		void MainLoop();
-		void Finalize();
 
 	private:
 		GLFWwindow* m_window = nullptr;
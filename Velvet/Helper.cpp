@@ -1,5 +1,5 @@
 #include "Helper.hpp"
-#include <glm\ext\matrix_transform.hpp>
+#include <glm/ext/matrix_transform.hpp>
 
 namespace Velvet
 {
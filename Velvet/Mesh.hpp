@@ -3,9 +3,12 @@
 #include <vector>
 #include <algorithm> 
 
+#include <glm/glm.hpp>
+#include <fmt/core.h>
+#ifndef VT_HEADLESS
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <fmt/core.h>
+#endif
 
 using namespace std;
 
@@ -53,6 +56,7 @@ namespace Velvet
 
 		~Mesh()
 		{
+#ifndef VT_HEADLESS
 			if (m_EBO > 0)
 			{
 				glDeleteBuffers(1, &m_EBO);
@@ -65,6 +69,7 @@ namespace Velvet
 			{
 				glDeleteVertexArrays(1, &m_VAO);
 			}
+#endif
 		}
 
 		unsigned int VAO() const
@@ -103,27 +108,62 @@ namespace Velvet
 			return m_indices;
 		}
 
-		const GLuint verticesVBO() const
+		const unsigned int verticesVBO() const
 		{
 			return m_VBOs[0];
 		}
 
-		const GLuint normalsVBO() const
+		const unsigned int normalsVBO() const
 		{
 			return m_VBOs[1];
 		}
 
-		void SetVerticesAndNormals(const vector<glm::vec3>& vertices, const vector<glm::vec3>& normals)
+		// CPU copies of the vertex data, kept next to the GL buffers
+		size_t cpuBytes() const
 		{
-			auto size = vertices.size() * sizeof(glm::vec3);
-			m_positions = vertices;
-			m_normals = normals;
-			glBindBuffer(GL_ARRAY_BUFFER, m_VBOs[0]);
-			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_DYNAMIC_DRAW);
-			glBindBuffer(GL_ARRAY_BUFFER, m_VBOs[1]);
-			glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_DYNAMIC_DRAW);
+			return m_positions.capacity() * sizeof(glm::vec3) + m_normals.capacity() * sizeof(glm::vec3) +
+				m_texCoords.capacity() * sizeof(glm::vec2) + m_indices.capacity() * sizeof(unsigned int);
+		}
+
+		// Bytes uploaded by this class. Buffers filled by callers of AllocateVBO are not included.
+		size_t gpuBytes() const
+		{
+			return m_gpuBytes;
 		}
 
+		// Called every frame by simulated meshes. Copies into existing storage, so it does not allocate
+		// as long as the number of vertices stays the same.
+		template <class TVertices, class TNormals>
+		void SetVerticesAndNormals(const TVertices& vertices, const TNormals& normals)
+		{
+#ifndef VT_HEADLESS
+			bool sameSize = (vertices.size() == m_positions.size() && normals.size() == m_normals.size());
+#endif
+			m_positions.assign(vertices.begin(), vertices.end());
+			m_normals.assign(normals.begin(), normals.end());
+#ifndef VT_HEADLESS
+			// Buffers are created with GL_STATIC_DRAW; reallocate them once as dynamic, then update in place
+			if (m_dynamicBuffers && sameSize)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, m_VBOs[0]);
+				glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(glm::vec3), vertices.data());
+				glBindBuffer(GL_ARRAY_BUFFER, m_VBOs[1]);
+				glBufferSubData(GL_ARRAY_BUFFER, 0, normals.size() * sizeof(glm::vec3), normals.data());
+			}
+			else
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, m_VBOs[0]);
+				glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_DYNAMIC_DRAW);
+				glBindBuffer(GL_ARRAY_BUFFER, m_VBOs[1]);
+				glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_DYNAMIC_DRAW);
+				m_dynamicBuffers = true;
+				m_gpuBytes = BufferBytes();
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+		}
+
+#ifndef VT_HEADLESS
 		GLuint AllocateVBO(unsigned int floatCount, bool instanceAttribute = false)
 		{
 			GLuint VBO;
@@ -145,6 +185,7 @@ namespace Velvet
 
 			return VBO;
 		}
+#endif
 
 	private:
 		vector<glm::vec3> m_positions;
@@ -152,9 +193,17 @@ namespace Velvet
 		vector<glm::vec2> m_texCoords;
 		vector<unsigned int> m_indices;
 
-		GLuint m_VAO = 0;
-		GLuint m_EBO = 0;
-		vector<GLuint> m_VBOs;
+		unsigned int m_VAO = 0;
+		unsigned int m_EBO = 0;
+		vector<unsigned int> m_VBOs;
+		bool m_dynamicBuffers = false;
+		size_t m_gpuBytes = 0;
+
+		size_t BufferBytes() const
+		{
+			return m_positions.size() * sizeof(glm::vec3) + m_normals.size() * sizeof(glm::vec3) +
+				m_texCoords.size() * sizeof(glm::vec2) + m_indices.size() * sizeof(unsigned int);
+		}
 
 		void Initialize(const vector<glm::vec3>& vertices, const vector<glm::vec3>& normals, const vector<glm::vec2>& texCoords,
 			const vector<unsigned int>& indices, vector<unsigned int> attributeSizes = {})
@@ -164,6 +213,7 @@ namespace Velvet
 			m_texCoords = texCoords;
 			m_indices = indices;
 
+#ifndef VT_HEADLESS
 			// 1. bind Vertex Array Object
 			glGenVertexArrays(1, &m_VAO);
 			glBindVertexArray(m_VAO);
@@ -197,6 +247,8 @@ namespace Velvet
 				glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 			}
 			glBindVertexArray(0);
+			m_gpuBytes = BufferBytes();
+#endif
 		}
 
 	};
@@ -14,6 +14,7 @@
 #include "External/stb_image.h"
 #include "Mesh.hpp"
 #include "Material.hpp"
+#include "VtMemoryReport.hpp"
 
 namespace Velvet
 {
@@ -63,6 +64,10 @@ namespace Velvet
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+				// Driver-side size is not queryable; count one texel per component (RGB is padded to 4) plus a third for mipmaps
+				size_t texelBytes = nrComponents == 3 ? 4 : nrComponents;
+				textureCacheBytes += (size_t)width * height * texelBytes * 4 / 3;
+
                 stbi_image_free(data);
             }
             else
@@ -214,6 +219,30 @@ namespace Velvet
 			meshCache.clear();
 		}
 
+		static bool IsCached(const Mesh* mesh)
+		{
+			for (const auto& entry : meshCache)
+			{
+				if (entry.second.get() == mesh) return true;
+			}
+			return false;
+		}
+
+		static void ReportMemory(VtMemoryReport& report)
+		{
+			size_t meshCpuBytes = 0, meshGpuBytes = 0;
+			for (const auto& entry : meshCache)
+			{
+				meshCpuBytes += entry.second->cpuBytes();
+				meshGpuBytes += entry.second->gpuBytes();
+			}
+			report.Add("Resource", "mesh cache (CPU)", meshCpuBytes);
+			report.Add("Resource", "mesh cache (GL)", meshGpuBytes);
+			report.Add("Resource", "texture cache (GL, estimated)", textureCacheBytes);
+			// Shader programs live in the driver, only the host objects are counted
+			report.Add("Resource", "material cache", matCache.size() * sizeof(Material));
+		}
+
 	private:
 		static inline glm::vec3 AdaptVector(const aiVector3D& input)
 		{
@@ -228,6 +257,7 @@ namespace Velvet
 		static inline unordered_map<string, unsigned int> textureCache;
 		static inline unordered_map<string, shared_ptr<Mesh>> meshCache;
 		static inline unordered_map<string, shared_ptr<Material>> matCache;
+		static inline size_t textureCacheBytes = 0;
 
 		static inline string defaultTexturePath = "Assets/Texture/";
 		static inline string defaultMeshPath = "Assets/Model/";
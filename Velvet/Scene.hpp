@@ -4,17 +4,19 @@
 #include <functional>
 
 #include "GameInstance.hpp"
+#include "Actor.hpp"
+#include "Collider.hpp"
+#include "VtClothObjectCPU.hpp"
+#ifndef VT_HEADLESS
 #include "Input.hpp"
 #include "Resource.hpp"
-#include "Actor.hpp"
 #include "PlayerController.hpp"
 #include "MeshRenderer.hpp"
 #include "MaterialProperty.hpp"
-#include "Collider.hpp"
-#include "VtClothObjectCPU.hpp"
 #include "VtClothObjectGPU.hpp"
 #include "ParticleInstancedRenderer.hpp"
 #include "ParticleGeometryRenderer.hpp"
+#endif
 
 #define SOLVER_CPU
 
@@ -48,6 +50,7 @@ namespace Velvet
 
 		void SpawnCameraAndLight(GameInstance* game)
 		{
+#ifndef VT_HEADLESS
 			//=====================================
 			// 1. Camera
 			//=====================================
@@ -89,8 +92,10 @@ namespace Velvet
 			//		fmt::print("Inner: {}\n", lightComp->innerCutoff--);
 			//	}
 			//	});
+#endif
 		}
-	
+
+#ifndef VT_HEADLESS
 		void SpawnDebug(GameInstance* game)
 		{
 			auto quad = game->CreateActor("Debug Quad");
@@ -127,6 +132,7 @@ namespace Velvet
 					});
 			}
 		}
+#endif
 	
 		shared_ptr<Mesh> GenerateClothMesh(int resolution)
 		{
@@ -257,6 +263,12 @@ namespace Velvet
 		{
 			auto cloth = game->CreateActor("Cloth Generated");
 
+			auto mesh = GenerateClothMesh(resolution);
+			//auto mesh = GenerateClothMeshIrregular(resolution);
+
+#ifdef VT_HEADLESS
+			cloth->AddComponent(make_shared<VtClothObjectCPU>(resolution, mesh));
+#else
 			auto material = Resource::LoadMaterial("_Default");
 			material->Use();
 			material->doubleSided = true;
@@ -270,9 +282,6 @@ namespace Velvet
 				mat->specular = 0.01f;
 			};
 
-			auto mesh = GenerateClothMesh(resolution);
-			//auto mesh = GenerateClothMeshIrregular(resolution);
-
 			auto renderer = make_shared<MeshRenderer>(mesh, material, true);
 			renderer->SetMaterialProperty(materialProperty);
 
@@ -280,7 +289,7 @@ namespace Velvet
 			auto prenderer = make_shared<ParticleGeometryRenderer>();
 
 #ifdef SOLVER_CPU
-			auto clothObj = make_shared<VtClothObjectCPU>(resolution); 
+			auto clothObj = make_shared<VtClothObjectCPU>(resolution, mesh);
 			
 #else
 			if (solver == nullptr)
@@ -292,6 +301,7 @@ namespace Velvet
 #endif
 
 			cloth->AddComponents({ renderer, clothObj, prenderer });
+#endif
 
 			return cloth;
 		}
@@ -299,6 +309,10 @@ namespace Velvet
 		shared_ptr<Actor> SpawnSphere(GameInstance* game)
 		{
 			auto sphere = game->CreateActor("Sphere");
+			auto collider = make_shared<Collider>(ColliderType::Sphere);
+#ifdef VT_HEADLESS
+			sphere->AddComponent(collider);
+#else
 			MaterialProperty materialProperty;
 			materialProperty.preRendering = [](Material* mat) {
 				mat->SetVec3("material.tint", glm::vec3(1.0));
@@ -310,11 +324,12 @@ namespace Velvet
 			auto mesh = Resource::LoadMesh("sphere.obj");
 			auto renderer = make_shared<MeshRenderer>(mesh, material, true);
 			renderer->SetMaterialProperty(materialProperty);
-			auto collider = make_shared<Collider>(ColliderType::Sphere);
 			sphere->AddComponents({ renderer, collider });
+#endif
 			return sphere;
 		}
 
+#ifndef VT_HEADLESS
 		shared_ptr<Actor> SpawnLight(GameInstance* game)
 		{
 			auto actor = game->CreateActor("Prefab Light");
@@ -335,11 +350,15 @@ namespace Velvet
 			actor->AddComponents({ camera, controller });
 			return actor;
 		}
+#endif
 
 		shared_ptr<Actor> SpawnInfinitePlane(GameInstance* game)
 		{
 			auto infPlane = game->CreateActor("Infinite Plane");
-
+			auto collider = make_shared<Collider>(ColliderType::Plane);
+#ifdef VT_HEADLESS
+			infPlane->AddComponent(collider);
+#else
 			auto mat = Resource::LoadMaterial("InfinitePlane");
 			mat->noWireframe = true;
 			// Plane: ax + by + cz + d = 0
@@ -351,14 +370,18 @@ namespace Velvet
 
 			auto mesh = make_shared<Mesh>(vertices, vector<glm::vec3>(), vector<glm::vec2>(), indices);
 			auto renderer = make_shared<MeshRenderer>(mesh, mat);
-			auto collider = make_shared<Collider>(ColliderType::Plane);
 			infPlane->AddComponents({ renderer, collider });
+#endif
 			return infPlane;
 		}
 	
 		shared_ptr<Actor> SpawnColoredCube(GameInstance* game, glm::vec3 color = glm::vec3(1.0f))
 		{
 			auto cube = game->CreateActor("Cube");
+			auto collider = make_shared<Collider>(ColliderType::Cube);
+#ifdef VT_HEADLESS
+			cube->AddComponent(collider);
+#else
 			auto material = Resource::LoadMaterial("_Default");
 
 			MaterialProperty materialProperty;
@@ -370,9 +393,8 @@ namespace Velvet
 			auto mesh = Resource::LoadMesh("cube.obj");
 			auto renderer = make_shared<MeshRenderer>(mesh, material, true);
 			renderer->SetMaterialProperty(materialProperty);
-
-			auto collider = make_shared<Collider>(ColliderType::Cube);
 			cube->AddComponents({ renderer, collider });
+#endif
 			return cube;
 		}
 	};
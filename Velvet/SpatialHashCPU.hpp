@@ -2,37 +2,120 @@
 
 #include <iostream>
 #include <vector>
+#include <cstdint>
+#include <cassert>
 #include <glm/glm.hpp>
 
+#include "Global.hpp"
+#include "VtProfiler.hpp"
+#include "VtBroadphaseStats.hpp"
+#include "VtMemoryReport.hpp"
+#include "VtParticleStore.hpp"
+#include "VtThreadPool.hpp"
+
 namespace Velvet
 {
 	using namespace std;
 
+	// View into the flat neighbor list of one object, valid until the next HashObjects
+	struct NeighborRange
+	{
+		const int* first;
+		const int* last;
+
+		const int* begin() const { return first; }
+		const int* end() const { return last; }
+		size_t size() const { return last - first; }
+	};
+
 	class SpatialHashCPU
 	{
 	public:
-		SpatialHashCPU(float spacing, int maxNumObjects)
+		// Set collectStats to update stats after every rehash (costs about as much as the rehash itself)
+		bool collectStats = false;
+		VtBroadphaseStats stats;
+		// Set parallel to query neighbors on the shared thread pool. The neighbor lists are the same either way.
+		bool parallel = false;
+
+		// compact stores neighbors as 16-bit offsets from their object (VtSimParams::compactState), see ForEachNeighbor()
+		SpatialHashCPU(float spacing, int maxNumObjects, bool compact = false) : m_compact(compact)
 		{
 			m_particleDiameter2 = spacing * spacing;
 			m_spacing = spacing * Global::simParams.hashCellSizeScalar;
 			m_spacing2 = m_spacing * m_spacing;
 			m_tableSize = 2 * maxNumObjects;
-			m_cellStart = vector<int>(m_tableSize + 1, 0);
-			m_cellEntries = vector<int>(maxNumObjects, 0);
-			m_neighbors = vector<vector<int>>(maxNumObjects);
+			m_cellStart = VtAlignedVector<int>(m_tableSize + 1, 0);
+			m_cellEntries = VtAlignedVector<int>(maxNumObjects, 0);
+			// Neighbors of all objects are stored back to back. The entry buffer only grows,
+			// so once contacts settle rehashing does not allocate anymore.
+			m_neighborStart = VtAlignedVector<int>(maxNumObjects + 1, 0);
+			if (m_compact)
+			{
+				m_compactEntries.reserve((size_t)maxNumObjects * k_reservedNeighborsPerObject);
+			}
+			else
+			{
+				m_neighborEntries.reserve((size_t)maxNumObjects * k_reservedNeighborsPerObject);
+			}
 		}
 
-		void SetInitialPositions(const vector<glm::vec3>& positions)
+		void SetInitialPositions(const VtVec3Stream& positions)
 		{
-			m_initialPositions.resize(positions.size());
-			for (int i = 0; i < positions.size(); i++)
-			{
-				m_initialPositions[i] = positions[i];
-			}
+			positions.CopyTo(m_initialPositions);
+		}
+
+		// Spreads the tables over the pool threads, see VtFirstTouch(). Per-object arrays follow the chunks of the parallel
+		// query and the cell table is split evenly. Reserved neighbor entries are written ahead in object order as well,
+		// so that the first rehash does not fault them all in on the calling thread.
+		void FirstTouch()
+		{
+			auto& pool = VtThreadPool::Shared();
+			int numObjects = (int)m_neighborStart.size() - 1;
+			int chunkSize = Global::simParams.deterministic ? k_objectChunk : pool.ShareSize(numObjects, k_objectChunk);
+			auto perObject = [&](const auto& body) { pool.ParallelFor(numObjects, chunkSize, body); };
+			// The offset past the last object goes with the last chunk
+			VtFirstTouch(m_neighborStart, [&](const auto& body) {
+				perObject([&](int begin, int end) { body(begin, end == numObjects ? end + 1 : end); });
+				});
+			VtFirstTouch(m_initialPositions, perObject);
+
+			auto evenly = [&](int count) {
+				return [&pool, count](const auto& body) { pool.ParallelFor(count, pool.ShareSize(count, k_objectChunk), body); };
+			};
+			VtFirstTouch(m_cellStart, evenly((int)m_cellStart.size()));
+			VtFirstTouch(m_cellEntries, evenly((int)m_cellEntries.size()));
+
+			auto touchReserved = [&](auto& entries) {
+				if (!entries.empty() || entries.capacity() < (size_t)numObjects * k_reservedNeighborsPerObject) return;
+				auto* data = entries.data();
+				perObject([&](int begin, int end) {
+					memset(data + (size_t)begin * k_reservedNeighborsPerObject, 0, (size_t)(end - begin) * k_reservedNeighborsPerObject * sizeof(*data));
+					});
+			};
+			touchReserved(m_neighborEntries);
+			touchReserved(m_compactEntries);
+		}
+
+		// Object i is renamed to the previous object order[i]. Neighbor lists are stale until the next HashObjects().
+		// Allocates: a new order can gather the densest neighborhoods into any chunk, so every chunk list grows
+		// to the largest one so far.
+		void ReorderObjects(const vector<int>& order)
+		{
+			auto previous = m_initialPositions;
+			for (size_t i = 0; i < order.size(); i++) m_initialPositions[i] = previous[order[i]];
+
+			auto reserveLargest = [](auto& chunks) {
+				size_t capacity = 0;
+				for (const auto& entries : chunks) capacity = max(capacity, entries.capacity());
+				for (auto& entries : chunks) entries.reserve(capacity);
+			};
+			reserveLargest(m_chunkNeighbors);
+			reserveLargest(m_compactChunkNeighbors);
 		}
 
-		void HashObjects(const vector<glm::vec3>& positions)
+		void HashObjects(const VtVec3Stream& positions)
 		{
+			VT_PROFILE_SCOPE("Solver_HashObjects");
 			std::fill(m_cellStart.begin(), m_cellStart.end(), 0);
 			std::fill(m_cellEntries.begin(), m_cellEntries.end(), 0);
 
@@ -60,19 +143,100 @@ namespace Velvet
 				m_cellEntries[m_cellStart[coords]] = i;
 			}
 
-			CacheNeighbors(positions);
+			if (m_compact)
+			{
+				CacheNeighbors(positions, m_compactEntries, m_compactChunkNeighbors);
+			}
+			else
+			{
+				CacheNeighbors(positions, m_neighborEntries, m_chunkNeighbors);
+			}
+
+			if (collectStats)
+			{
+				ComputeStats(positions);
+			}
+		}
+
+		// visit(j) for every neighbor j of object i, in cell order as they were found
+		template <class TVisit>
+		void ForEachNeighbor(int i, const TVisit& visit) const
+		{
+			if (!m_compact)
+			{
+				for (int j : GetNeighbors(i)) visit(j);
+				return;
+			}
+			const int16_t* entry = m_compactEntries.data() + m_neighborStart[i];
+			const int16_t* last = m_compactEntries.data() + m_neighborStart[i + 1];
+			while (entry < last)
+			{
+				if (*entry != k_escape)
+				{
+					visit(i + *entry);
+					entry++;
+				}
+				else
+				{
+					visit((int)((uint32_t)(uint16_t)entry[1] | ((uint32_t)(uint16_t)entry[2] << 16)));
+					entry += 3;
+				}
+			}
 		}
 
-		vector<int>& GetNeighbors(int i)
+		int NumNeighbors(int i) const
 		{
-			return m_neighbors[i];
+			if (!m_compact) return m_neighborStart[i + 1] - m_neighborStart[i];
+			int count = 0;
+			ForEachNeighbor(i, [&](int) { count++; });
+			return count;
+		}
+
+		bool compact() const
+		{
+			return m_compact;
+		}
+
+		void ReportMemory(VtMemoryReport& report) const
+		{
+			report.Add("SpatialHash", "cell table", VtMemoryReport::Bytes(m_cellStart) + VtMemoryReport::Bytes(m_cellEntries));
+			report.Add("SpatialHash", "neighbor starts", m_neighborStart);
+			// Grows to the densest contact state seen so far and is never shrunk
+			report.Add("SpatialHash", "neighbor entries", VtMemoryReport::Bytes(m_neighborEntries) + VtMemoryReport::Bytes(m_compactEntries));
+			size_t chunkBytes = VtMemoryReport::Bytes(m_chunkNeighbors) + VtMemoryReport::Bytes(m_compactChunkNeighbors) + VtMemoryReport::Bytes(m_chunkOffsets);
+			for (const auto& chunk : m_chunkNeighbors) chunkBytes += VtMemoryReport::Bytes(chunk);
+			for (const auto& chunk : m_compactChunkNeighbors) chunkBytes += VtMemoryReport::Bytes(chunk);
+			report.Add("SpatialHash", "neighbor chunks", chunkBytes);
+			report.Add("SpatialHash", "initial positions", m_initialPositions);
+			report.Add("SpatialHash", "stats scratch", m_statsBuilder.ScratchBytes());
 		}
 
 	private:
-		vector<int> m_cellEntries;
-		vector<int> m_cellStart;
-		vector<vector<int>> m_neighbors;
-		vector<glm::vec3> m_initialPositions;
+		static constexpr int k_reservedNeighborsPerObject = 16;
+		static constexpr int k_objectChunk = 1024;
+		// A compact entry is the offset of the neighbor from its object. Offsets outside int16 are written as k_escape
+		// followed by the low and high 16 bits of the neighbor index.
+		static constexpr int16_t k_escape = INT16_MIN;
+
+		// The int entries of object i, empty when the lists are compact; callers go through ForEachNeighbor()
+		NeighborRange GetNeighbors(int i) const
+		{
+			assert(!m_compact);
+			const int* entries = m_neighborEntries.data();
+			return NeighborRange{ entries + m_neighborStart[i], entries + m_neighborStart[i + 1] };
+		}
+
+		VtAlignedVector<int> m_cellEntries;
+		VtAlignedVector<int> m_cellStart;
+		VtAlignedVector<int> m_neighborStart;
+		VtAlignedVector<int> m_neighborEntries;
+		vector<VtAlignedVector<int>> m_chunkNeighbors;	// per-chunk neighbor lists of a parallel query, only grow
+		bool m_compact;
+		VtAlignedVector<int16_t> m_compactEntries;		// instead of m_neighborEntries with m_compact
+		vector<VtAlignedVector<int16_t>> m_compactChunkNeighbors;
+		vector<int> m_chunkOffsets;
+		VtAlignedVector<glm::vec3> m_initialPositions;
+		VtBroadphaseStatsBuilder m_statsBuilder;
 		int m_tableSize;
 		float m_spacing, m_spacing2, m_particleDiameter2;
 
@@ -97,18 +261,106 @@ namespace Velvet
 			return h;
 		}
 
-		void CacheNeighbors(const vector<glm::vec3>& positions)
+		void ComputeStats(const VtVec3Stream& positions)
 		{
-			for (int i = 0; i < positions.size(); i++)
+			int numObjects = (int)positions.size();
+			m_statsBuilder.Begin(numObjects, m_tableSize);
+			for (int h = 0; h < m_tableSize; h++)
+			{
+				auto& cells = m_statsBuilder.BucketCells();
+				for (int i = m_cellStart[h]; i < m_cellStart[h + 1]; i++)
+				{
+					glm::vec3 p = positions[m_cellEntries[i]];
+					cells.push_back(glm::ivec3(ComputeIntCoord(p.x), ComputeIntCoord(p.y), ComputeIntCoord(p.z)));
+				}
+				m_statsBuilder.AddBucket();
+			}
+			for (int i = 0; i < numObjects; i++)
 			{
-				m_neighbors[i] = QueryNeighbors(positions, i);
+				m_statsBuilder.AddNeighborCount(NumNeighbors(i), Global::simParams.maxNumNeighbors);
 			}
+			stats = m_statsBuilder.End();
 		}
 
-		vector<int> QueryNeighbors(const vector<glm::vec3>& positions, int id)
+		// Fills neighborEntries, as int or compact entries
+		template <class TEntry>
+		void CacheNeighbors(const VtVec3Stream& positions, VtAlignedVector<TEntry>& neighborEntries, vector<VtAlignedVector<TEntry>>& chunkNeighbors)
 		{
-			vector<int> result;
+			int numObjects = (int)positions.size();
+			if (!parallel || VtThreadPool::Shared().numThreads() == 1)
+			{
+				neighborEntries.clear();
+				for (int i = 0; i < numObjects; i++)
+				{
+					m_neighborStart[i] = (int)neighborEntries.size();
+					QueryNeighbors(positions, i, neighborEntries);
+				}
+				m_neighborStart[numObjects] = (int)neighborEntries.size();
+				return;
+			}
 
+			// Every chunk of objects collects its neighbors separately, with starts relative to the chunk.
+			// The chunks are then concatenated in order, which gives exactly the serial lists: neighbors of an
+			// object are always in cell order and within a cell in the order of m_cellEntries.
+			// Fast mode (not Global::simParams.deterministic) uses one chunk per thread, the lists are the same.
+			auto& pool = VtThreadPool::Shared();
+			int chunkSize = Global::simParams.deterministic ? k_objectChunk : pool.ShareSize(numObjects, k_objectChunk);
+			int numChunks = (numObjects + chunkSize - 1) / chunkSize;
+			if (chunkNeighbors.size() < numChunks)
+			{
+				chunkNeighbors.resize(numChunks);
+				m_chunkOffsets.resize(numChunks + 1);
+			}
+			// No-op unless the chunk size grew (fast mode with fewer threads)
+			for (auto& entries : chunkNeighbors) entries.reserve((size_t)chunkSize * k_reservedNeighborsPerObject);
+			pool.ParallelFor(numObjects, chunkSize, [&](int begin, int end) {
+				auto& entries = chunkNeighbors[begin / chunkSize];
+				entries.clear();
+				for (int i = begin; i < end; i++)
+				{
+					m_neighborStart[i] = (int)entries.size();
+					QueryNeighbors(positions, i, entries);
+				}
+				});
+
+			m_chunkOffsets[0] = 0;
+			for (int c = 0; c < numChunks; c++)
+			{
+				m_chunkOffsets[c + 1] = m_chunkOffsets[c] + (int)chunkNeighbors[c].size();
+			}
+			neighborEntries.resize(m_chunkOffsets[numChunks]);
+
+			pool.ParallelFor(numObjects, chunkSize, [&](int begin, int end) {
+				int chunk = begin / chunkSize;
+				int offset = m_chunkOffsets[chunk];
+				for (int i = begin; i < end; i++) m_neighborStart[i] += offset;
+				copy(chunkNeighbors[chunk].begin(), chunkNeighbors[chunk].end(), neighborEntries.begin() + offset);
+				});
+			m_neighborStart[numObjects] = m_chunkOffsets[numChunks];
+		}
+
+		static void Append(VtAlignedVector<int>& entries, int, int neighbor)
+		{
+			entries.push_back(neighbor);
+		}
+
+		static void Append(VtAlignedVector<int16_t>& entries, int id, int neighbor)
+		{
+			int offset = neighbor - id;
+			if (offset > INT16_MIN && offset <= INT16_MAX)
+			{
+				entries.push_back((int16_t)offset);
+				return;
+			}
+			entries.push_back(k_escape);
+			entries.push_back((int16_t)(uint16_t)((uint32_t)neighbor & 0xFFFF));
+			entries.push_back((int16_t)(uint16_t)((uint32_t)neighbor >> 16));
+		}
+
+		// Appends neighbors of object id to entries
+		template <class TEntry>
+		void QueryNeighbors(const VtVec3Stream& positions, int id, VtAlignedVector<TEntry>& entries)
+		{
 			glm::vec3 position = positions[id];
 			glm::vec3 originalPosition = m_initialPositions[id];
 
@@ -148,15 +400,12 @@ namespace Velvet
 								(glm::distance(position, positions[neighbor]) < m_spacing) &&
 								(glm::distance(originalPosition, m_initialPositions[neighbor]) > m_spacing))
 							{ 
-								//m_neighbors[id].push_back( neighbor );
-								result.push_back(neighbor);
+								Append(entries, id, neighbor);
 							}
 						}
 					}
 				}
 			}
-
-			return result;
 		}
 	};
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include "VtBuffer.hpp"
 #include "Global.hpp"
+#include "VtBroadphaseStats.hpp"
 #include "SpatialhashGPU.cuh"
 
 using namespace std;
@@ -49,8 +50,17 @@ namespace Velvet
 			params.particleDiameter2 = Global::simParams.particleDiameter * Global::simParams.particleDiameter;
 
 			HashObjects(particleHash, particleIndex, cellStart, cellEnd, neighbors, positions, initialPositions, params);
+
+			if (collectStats)
+			{
+				ComputeStats(positions);
+			}
 		}
 
+		// Set collectStats to read the hash back after every rehash (synchronizes with the device)
+		bool collectStats = false;
+		VtBroadphaseStats stats;
+
 		VtBuffer<uint> neighbors;
 		VtBuffer<glm::vec3> initialPositions;
 
@@ -92,6 +102,38 @@ namespace Velvet
 	private:
 		float m_spacing;
 		int m_tableSize;
+		VtBroadphaseStatsBuilder m_statsBuilder;
+
+		void ComputeStats(const VtBuffer<glm::vec3>& positions)
+		{
+			cudaDeviceSynchronize();
+
+			// particleIndex is sorted by hash; cellStart/cellEnd delimit each bucket, empty buckets start at 0xffffffff
+			const glm::vec3* positionData = positions;
+			int numObjects = (int)positions.size();
+			m_statsBuilder.Begin(numObjects, m_tableSize);
+			for (int h = 0; h < m_tableSize; h++)
+			{
+				if (cellStart[h] == 0xffffffff) continue;
+
+				auto& cells = m_statsBuilder.BucketCells();
+				for (uint i = cellStart[h]; i < cellEnd[h]; i++)
+				{
+					cells.push_back(HashPosition3i(positionData[particleIndex[i]]));
+				}
+				m_statsBuilder.AddBucket();
+			}
+
+			// Neighbors are stored strided: neighbors[k * numObjects + id], terminated by 0xffffffff unless full
+			int maxNumNeighbors = Global::simParams.maxNumNeighbors;
+			for (int id = 0; id < numObjects; id++)
+			{
+				int count = 0;
+				while (count < maxNumNeighbors && neighbors[count * numObjects + id] != 0xffffffff) count++;
+				m_statsBuilder.AddNeighborCount(count, maxNumNeighbors);
+			}
+			stats = m_statsBuilder.End();
+		}
 
 		void Test(const VtBuffer<glm::vec3>& positions)
 		{
@@ -3,11 +3,16 @@
 #include <iostream>
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 
+#include <fmt/printf.h>
+#ifndef VT_HEADLESS
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <fmt/printf.h>
 #include <cuda_runtime.h>
+#endif
 
 //#include "Global.hpp"
 
@@ -30,6 +35,7 @@ namespace Velvet
 
 		~Timer()
 		{
+#ifndef VT_HEADLESS
 			for (const auto& label2events : cudaEvents)
 			{
 				for (auto& e : label2events.second)
@@ -37,6 +43,11 @@ namespace Velvet
 					cudaEventDestroy(e);
 				}
 			}
+			for (auto& e : m_eventPool)
+			{
+				cudaEventDestroy(e);
+			}
+#endif
 		}
 
 		static void StartTimer(const string& label)
@@ -87,10 +98,14 @@ namespace Velvet
 			}
 		}
 
+		// Returns time in seconds. Uses a steady clock so that timing does not depend on a window context.
 		static double CurrentTime()
 		{
-			return glfwGetTime();
+			using namespace std::chrono;
+			static const auto start = steady_clock::now();
+			return duration<double>(steady_clock::now() - start).count();
 		}
+#ifndef VT_HEADLESS
 	public:
 		static void StartTimerGPU(const string& label)
 		{
@@ -102,9 +117,8 @@ namespace Velvet
 			}
 			s_timer->frames[label] = frame;
 
-			cudaEvent_t start, end;
-			cudaEventCreate(&start);
-			cudaEventCreate(&end);
+			cudaEvent_t start = AcquireEvent();
+			cudaEvent_t end = AcquireEvent();
 			auto& events = s_timer->cudaEvents[label];
 			events.push_back(start);
 			events.push_back(end);
@@ -133,9 +147,9 @@ namespace Velvet
 					float time;
 					cudaEventElapsedTime(&time, events[i], events[i + 1]);
 					totalTime += time;
-					cudaEventDestroy(events[i]);
-					cudaEventDestroy(events[i + 1]);
 				}
+				// Events are recycled instead of destroyed, creating them is expensive
+				s_timer->m_eventPool.insert(s_timer->m_eventPool.end(), events.begin(), events.end());
 				events.clear();
 				s_timer->history[label] = totalTime;
 			}
@@ -149,6 +163,35 @@ namespace Velvet
 				return 0;
 			}
 		}
+
+		// Per-kernel timers (ScopedTimerGPU) are only recorded when enabled, e.g. while the GUI shows them
+		static void SetDetailTimerGPU(bool enable)
+		{
+			s_timer->m_detailTimerGPU = enable;
+		}
+
+		static bool detailTimerGPU()
+		{
+			return s_timer != nullptr && s_timer->m_detailTimerGPU;
+		}
+
+	private:
+		static cudaEvent_t AcquireEvent()
+		{
+			auto& pool = s_timer->m_eventPool;
+			cudaEvent_t e;
+			if (pool.empty())
+			{
+				cudaEventCreate(&e);
+			}
+			else
+			{
+				e = pool.back();
+				pool.pop_back();
+			}
+			return e;
+		}
+#endif
 	public:
 		static void UpdateDeltaTime()
 		{
@@ -165,6 +208,16 @@ namespace Velvet
 			s_timer->m_elapsedTime += s_timer->m_deltaTime;
 		}
 
+		// Advance exactly one fixed frame regardless of wall clock.
+		// Used when there is no render loop driving the timer (e.g. headless runs).
+		static void NextFixedFrameHeadless()
+		{
+			s_timer->m_deltaTime = s_timer->m_fixedDeltaTime;
+			s_timer->m_frameCount++;
+			s_timer->m_physicsFrameCount++;
+			s_timer->m_elapsedTime += s_timer->m_deltaTime;
+		}
+
 		// Return true when fixed update should be executed
 		static bool NextFixedFrame()
 		{
@@ -225,7 +278,11 @@ namespace Velvet
 		unordered_map<string, double> times;
 		unordered_map<string, double> history;
 		unordered_map<string, int> frames;
+#ifndef VT_HEADLESS
 		unordered_map<string, vector<cudaEvent_t>> cudaEvents;
+		vector<cudaEvent_t> m_eventPool;
+		bool m_detailTimerGPU = false;
+#endif
 		unordered_map<string, float> label2accumulatedTime;
 
 		int m_frameCount = 0;
@@ -239,23 +296,25 @@ namespace Velvet
 	};
 
 
+#ifndef VT_HEADLESS
 	class ScopedTimerGPU
 	{
 	public:
-		ScopedTimerGPU(const string&& _label)
+		ScopedTimerGPU(const char* _label)
 		{
-			//if (!Global::gameState.detailTimer) return;
+			if (!Timer::detailTimerGPU()) return;
 			label = _label;
-			Timer::StartTimerGPU(_label);
+			Timer::StartTimerGPU(label);
 		}
 
 		~ScopedTimerGPU()
 		{
-			//if (!Global::gameState.detailTimer) return;
+			if (label.empty()) return;
 			Timer::EndTimerGPU(label);
 		}
 
 	private:
 		string label;
 	};
+#endif
 }
\ No newline at end of file
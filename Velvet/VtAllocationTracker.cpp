@@ -0,0 +1,145 @@
+#include "VtAllocationTracker.hpp"
+
+#ifdef VT_TRACK_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Replaces the global allocation functions to feed AllocationTracker. The aligned overloads are replaced too,
+// since the solver streams (VtAlignedAllocator) go through them.
+
+namespace
+{
+	void* AlignedMalloc(size_t size, size_t alignment)
+	{
+		size = size > 0 ? size : 1;
+#if defined(_WIN32)
+		return _aligned_malloc(size, alignment);
+#else
+		void* ptr = nullptr;
+		return posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) == 0 ? ptr : nullptr;
+#endif
+	}
+
+	void AlignedFree(void* ptr)
+	{
+#if defined(_WIN32)
+		_aligned_free(ptr);
+#else
+		free(ptr);
+#endif
+	}
+}
+
+void* operator new(size_t size)
+{
+	Velvet::AllocationTracker::OnAllocation();
+	void* ptr = malloc(size > 0 ? size : 1);
+	if (ptr == nullptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	Velvet::AllocationTracker::OnAllocation();
+	return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	Velvet::AllocationTracker::OnAllocation();
+	void* ptr = AlignedMalloc(size, (size_t)alignment);
+	if (ptr == nullptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	Velvet::AllocationTracker::OnAllocation();
+	return AlignedMalloc(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, alignment, tag);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	AlignedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	AlignedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+	AlignedFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+	AlignedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	AlignedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	AlignedFree(ptr);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <fmt/core.h>
+
+#include "VtProfiler.hpp"
+
+// Heap allocations are counted per profiler scope when VT_TRACK_ALLOCATIONS is defined.
+// The global operator new replacement lives in VtAllocationTracker.cpp, which is only compiled
+// into the VelvetBenchmark and VelvetHeadless projects. Scopes come from VT_PROFILE_SCOPE, so
+// VT_PROFILER is required as well.
+#if defined(VT_TRACK_ALLOCATIONS) && !defined(VT_PROFILER)
+#error "VT_TRACK_ALLOCATIONS requires VT_PROFILER"
+#endif
+
+namespace Velvet
+{
+	using namespace std;
+
+	// Solver scopes are expected to run without heap allocations once the simulation reached steady state.
+	// Enable() the tracker after the first frame; every allocation inside a profiled scope counts as violation.
+	class AllocationTracker
+	{
+	public:
+		static void Enable(bool enable)
+		{
+			s_enabled.store(enable, memory_order_relaxed);
+		}
+
+		// Called by operator new. Must not allocate itself.
+		static inline void OnAllocation()
+		{
+			if (!s_enabled.load(memory_order_relaxed)) return;
+
+			auto buffer = Profiler::CurrentBuffer();
+			if (buffer == nullptr || buffer->depth == 0) return;
+
+			s_violations[buffer->scopeId].fetch_add(1, memory_order_relaxed);
+		}
+
+		static uint64_t NumViolations()
+		{
+			uint64_t result = 0;
+			for (const auto& v : s_violations) result += v.load(memory_order_relaxed);
+			return result;
+		}
+
+		// Prints every scope that allocated and resets the counters. Returns false if there was any violation.
+		static bool Report(const string& context)
+		{
+			bool passed = true;
+			for (uint32_t i = 0; i < Profiler::k_maxScopes; i++)
+			{
+				uint64_t count = s_violations[i].exchange(0, memory_order_relaxed);
+				if (count == 0) continue;
+
+				fmt::print("Error(Allocation): [{}] {} heap allocation(s) inside scope [{}].\n", context, count, Profiler::ScopeName(i));
+				passed = false;
+			}
+			return passed;
+		}
+
+		static constexpr bool Active()
+		{
+#ifdef VT_TRACK_ALLOCATIONS
+			return true;
+#else
+			return false;
+#endif
+		}
+
+	private:
+		inline static atomic<bool> s_enabled{ false };
+		inline static atomic<uint64_t> s_violations[Profiler::k_maxScopes] = {};
+	};
+}
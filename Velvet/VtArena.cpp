@@ -0,0 +1,181 @@
+#include "VtArena.hpp"
+
+#include <new>
+
+#include <fmt/core.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+using namespace Velvet;
+
+namespace
+{
+	constexpr size_t k_hugePageSize = size_t(2) << 20;
+
+	size_t RoundUp(size_t bytes, size_t granule)
+	{
+		return (bytes + granule - 1) / granule * granule;
+	}
+}
+
+VtArena* VtArena::Acquire(size_t bytes, HugePages hugePages)
+{
+	lock_guard<mutex> lock(s_mutex);
+
+	// The smallest pooled arena that fits and was asked for the same kind of pages
+	auto best = s_pool.end();
+	for (auto it = s_pool.begin(); it != s_pool.end(); it++)
+	{
+		if ((*it)->m_capacity < bytes || (*it)->m_requestedHugePages != hugePages) continue;
+		if (best == s_pool.end() || (*it)->m_capacity < (*best)->m_capacity) best = it;
+	}
+	if (best != s_pool.end())
+	{
+		VtArena* arena = *best;
+		s_pool.erase(best);
+		arena->Reset();
+		return arena;
+	}
+
+	unique_ptr<VtArena> arena(new VtArena());
+	if (!arena->Reserve(bytes, hugePages))
+	{
+		fmt::print("Error(Arena): Unable to reserve {:.2f} MB, allocating from the heap.\n", bytes / 1e6);
+		return nullptr;
+	}
+	s_arenas.push_back(move(arena));
+	return s_arenas.back().get();
+}
+
+void VtArena::Release(VtArena* arena)
+{
+	if (arena == nullptr) return;
+
+	lock_guard<mutex> lock(s_mutex);
+	s_pool.push_back(arena);
+	if (s_pool.size() > k_maxPooled)
+	{
+		// The arena that waits longest goes back to the system. Its last owner is gone, and so are its objects.
+		VtArena* oldest = s_pool.front();
+		s_pool.erase(s_pool.begin());
+		s_arenas.erase(find_if(s_arenas.begin(), s_arenas.end(), [&](const unique_ptr<VtArena>& a) { return a.get() == oldest; }));
+	}
+}
+
+bool VtArena::Owns(const void* p)
+{
+	auto address = static_cast<const uint8_t*>(p);
+	lock_guard<mutex> lock(s_mutex);
+	for (const auto& arena : s_arenas)
+	{
+		if (address >= arena->m_base && address < arena->m_base + arena->m_capacity) return true;
+	}
+	return false;
+}
+
+bool VtArena::Reserve(size_t bytes, HugePages hugePages)
+{
+	m_requestedHugePages = hugePages;
+	bytes = RoundUp(max(bytes, size_t(1)), k_hugePageSize);
+
+#if defined(_WIN32)
+	if (hugePages == HugePages::Explicit)
+	{
+		// Large pages are committed at once and need the "Lock pages in memory" privilege
+		size_t largePage = GetLargePageMinimum();
+		void* p = largePage == 0 ? nullptr : VirtualAlloc(nullptr, RoundUp(bytes, largePage), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (p != nullptr)
+		{
+			m_base = static_cast<uint8_t*>(p);
+			m_capacity = m_committed = RoundUp(bytes, largePage);
+			m_hugePages = HugePages::Explicit;
+			return true;
+		}
+		fmt::print("Warning(Arena): Large pages are unavailable (error {}), using regular pages.\n", GetLastError());
+	}
+	else if (hugePages == HugePages::Transparent)
+	{
+		fmt::print("Warning(Arena): Transparent huge pages are only supported on Linux, using regular pages.\n");
+	}
+
+	void* p = VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_READWRITE);
+	if (p == nullptr) return false;
+	m_base = static_cast<uint8_t*>(p);
+	m_capacity = bytes;
+	m_committed = 0;
+	return true;
+#elif defined(__linux__)
+	if (hugePages == HugePages::Explicit)
+	{
+		// Taken from the hugetlbfs pool (vm.nr_hugepages), which has to hold the whole arena
+		void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			m_base = static_cast<uint8_t*>(p);
+			m_capacity = m_committed = bytes;
+			m_hugePages = HugePages::Explicit;
+			return true;
+		}
+		fmt::print("Warning(Arena): No {:.2f} MB of huge pages available (vm.nr_hugepages), using regular pages.\n", bytes / 1e6);
+	}
+
+	// Pages are committed on first touch, so the reservation only costs address space
+	void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) return false;
+	m_base = static_cast<uint8_t*>(p);
+	m_capacity = m_committed = bytes;
+	if (hugePages == HugePages::Transparent)
+	{
+		if (madvise(p, bytes, MADV_HUGEPAGE) == 0)
+		{
+			m_hugePages = HugePages::Transparent;
+		}
+		else
+		{
+			fmt::print("Warning(Arena): Transparent huge pages are disabled (/sys/kernel/mm/transparent_hugepage/enabled), using regular pages.\n");
+		}
+	}
+	return true;
+#else
+	if (hugePages != HugePages::Off)
+	{
+		fmt::print("Warning(Arena): Huge pages are not supported on this platform, using regular pages.\n");
+	}
+	m_base = static_cast<uint8_t*>(::operator new(bytes, align_val_t(k_hugePageSize), nothrow));
+	if (m_base == nullptr) return false;
+	m_capacity = m_committed = bytes;
+	return true;
+#endif
+}
+
+bool VtArena::Commit(size_t end)
+{
+	if (end <= m_committed) return true;
+#if defined(_WIN32)
+	// Reserved but not yet committed, in steps of a huge page to keep the number of calls low
+	size_t committed = min(RoundUp(end, k_hugePageSize), m_capacity);
+	if (VirtualAlloc(m_base + m_committed, committed - m_committed, MEM_COMMIT, PAGE_READWRITE) == nullptr) return false;
+	m_committed = committed;
+	return true;
+#else
+	return false;
+#endif
+}
+
+VtArena::~VtArena()
+{
+	if (m_base == nullptr) return;
+#if defined(_WIN32)
+	VirtualFree(m_base, 0, MEM_RELEASE);
+#elif defined(__linux__)
+	munmap(m_base, m_capacity);
+#else
+	::operator delete(m_base, align_val_t(k_hugePageSize));
+#endif
+}
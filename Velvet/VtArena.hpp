@@ -0,0 +1,141 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace Velvet
+{
+	using namespace std;
+
+	// One contiguous reservation of address space that hands out aligned blocks by bumping an offset. Blocks are never
+	// freed one by one: Reset() makes the whole arena available again in O(1). Pages are committed as the offset reaches
+	// them, so an arena can be reserved generously.
+	//
+	// Arenas are pooled. Acquire() prefers an arena that an earlier owner Release()d, so a scene reload reuses the pages
+	// of the previous scene instead of returning them to the system and faulting them in again.
+	//
+	// VtAlignedAllocator takes its memory from the arena of the innermost Scope on the calling thread, and from the heap
+	// outside of any scope or once the arena is full. It never frees arena memory, see Owns().
+	class VtArena
+	{
+	public:
+		enum class HugePages
+		{
+			Off,
+			Transparent,	// ask the kernel to back the arena with huge pages where it can (Linux)
+			Explicit,		// reserve huge pages up front, falls back to Off if the system has none to give
+		};
+
+		// Makes allocations of the calling thread come from arena while it is alive. Nests; a null arena means the heap.
+		class Scope
+		{
+		public:
+			explicit Scope(VtArena* arena) : m_previous(t_current)
+			{
+				t_current = arena;
+			}
+
+			~Scope()
+			{
+				t_current = m_previous;
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			VtArena* m_previous;
+		};
+
+		// Returns an empty arena of at least the given size. Allocates when no pooled arena is large enough.
+		static VtArena* Acquire(size_t bytes, HugePages hugePages);
+
+		// Hands the arena back to the pool. Blocks stay valid until the arena is acquired again, so objects that live
+		// in it may be destroyed after Release().
+		static void Release(VtArena* arena);
+
+		// Whether p lies in any arena, pooled ones included
+		static bool Owns(const void* p);
+
+		static VtArena* Current()
+		{
+			return t_current;
+		}
+
+		// nullptr if the arena is full
+		void* Allocate(size_t bytes, size_t alignment)
+		{
+			size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+			if (offset + bytes > m_capacity || !Commit(offset + bytes)) return nullptr;
+			m_offset = offset + bytes;
+			m_peak = max(m_peak, m_offset);
+			return m_base + offset;
+		}
+
+		void Reset()
+		{
+			m_offset = 0;
+		}
+
+		size_t capacity() const
+		{
+			return m_capacity;
+		}
+
+		size_t used() const
+		{
+			return m_offset;
+		}
+
+		// Highest offset since the arena was reserved, which is what stays committed
+		size_t peak() const
+		{
+			return m_peak;
+		}
+
+		HugePages hugePages() const
+		{
+			return m_hugePages;
+		}
+
+		~VtArena();
+
+	private:
+		static constexpr size_t k_maxPooled = 8;
+		inline static thread_local VtArena* t_current = nullptr;
+		inline static mutex s_mutex;
+		inline static vector<unique_ptr<VtArena>> s_arenas;	// every reserved arena, in use or pooled
+		inline static vector<VtArena*> s_pool;					// released arenas, ready for Acquire()
+
+		uint8_t* m_base = nullptr;
+		size_t m_capacity = 0;
+		size_t m_committed = 0;
+		size_t m_offset = 0;
+		size_t m_peak = 0;
+		HugePages m_hugePages = HugePages::Off;			// what the arena got
+		HugePages m_requestedHugePages = HugePages::Off;	// what Acquire() asked for
+
+		VtArena() = default;
+
+		// Reserves the address space, or returns false
+		bool Reserve(size_t bytes, HugePages hugePages);
+
+		// Makes [0, end) usable. Only needed where the system does not commit pages on first touch.
+		bool Commit(size_t end);
+	};
+
+	// Releases the arena it holds when destroyed
+	struct VtArenaRelease
+	{
+		void operator()(VtArena* arena) const
+		{
+			VtArena::Release(arena);
+		}
+	};
+
+	using VtArenaHandle = unique_ptr<VtArena, VtArenaRelease>;
+}
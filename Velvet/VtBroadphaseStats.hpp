@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <fmt/core.h>
+
+namespace Velvet
+{
+	using namespace std;
+
+	// Quality of a spatial hash after one rehash. Shared by SpatialHashCPU and SpatialHashGPU.
+	struct VtBroadphaseStats
+	{
+		// Neighbors per particle: 0, 1, 2-3, 4-7, ..., 64+
+		static constexpr int k_numHistogramBins = 8;
+
+		bool valid = false;
+		int numObjects = 0;
+		int tableSize = 0;
+		int occupiedBuckets = 0;
+		int maxBucketSize = 0;
+		float meanBucketSize = 0;	//!< Over occupied buckets
+		int numCells = 0;			//!< Distinct grid cells that contain particles
+		float collisionRate = 0;	//!< Fraction of cells that share their bucket with another cell
+		int maxNeighbors = 0;
+		float meanNeighbors = 0;
+		int numCapped = 0;			//!< Particles with at least maxNumNeighbors neighbors
+		int histogram[k_numHistogramBins] = {};
+
+		static int HistogramBin(int numNeighbors)
+		{
+			int bin = 0;
+			while (numNeighbors > 0 && bin < k_numHistogramBins - 1)
+			{
+				numNeighbors >>= 1;
+				bin++;
+			}
+			return bin;
+		}
+
+		static string BinLabel(int bin)
+		{
+			if (bin == 0) return "0";
+			if (bin == 1) return "1";
+			int first = 1 << (bin - 1);
+			return bin == k_numHistogramBins - 1 ? fmt::format("{}+", first) : fmt::format("{}-{}", first, 2 * first - 1);
+		}
+
+		string Summary() const
+		{
+			return fmt::format("buckets {}/{} occupied, size mean {:.2f} max {}, cells {}, collision rate {:.1f}%, "
+				"neighbors mean {:.2f} max {}, capped {}",
+				occupiedBuckets, tableSize, meanBucketSize, maxBucketSize, numCells, collisionRate * 100,
+				meanNeighbors, maxNeighbors, numCapped);
+		}
+	};
+
+	// Active contacts found by the latest collision pass of a solver
+	struct VtContactStats
+	{
+		int particleContacts = 0;		//!< Particle pairs closer than the particle diameter
+		vector<int> colliderContacts;	//!< Particles pushed out of each collider, same order as the solver's colliders
+	};
+
+	// Fills VtBroadphaseStats bucket by bucket. The scratch buffer is kept between rehashes.
+	class VtBroadphaseStatsBuilder
+	{
+	public:
+		void Begin(int numObjects, int tableSize)
+		{
+			m_stats = VtBroadphaseStats();
+			m_stats.numObjects = numObjects;
+			m_stats.tableSize = tableSize;
+			m_numNeighbors = 0;
+			m_numCollidingCells = 0;
+			// A bucket can hold every object, reserve once so that later rehashes do not allocate
+			m_cells.reserve(numObjects);
+		}
+
+		// Grid cells of all objects in one occupied bucket
+		vector<glm::ivec3>& BucketCells()
+		{
+			m_cells.clear();
+			return m_cells;
+		}
+
+		void AddBucket()
+		{
+			int size = (int)m_cells.size();
+			if (size == 0) return;
+
+			sort(m_cells.begin(), m_cells.end(), [](const glm::ivec3& a, const glm::ivec3& b) {
+				return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+				});
+			int distinct = (int)(unique(m_cells.begin(), m_cells.end()) - m_cells.begin());
+
+			m_stats.occupiedBuckets++;
+			m_stats.maxBucketSize = max(m_stats.maxBucketSize, size);
+			m_stats.numCells += distinct;
+			if (distinct > 1) m_numCollidingCells += distinct;
+		}
+
+		void AddNeighborCount(int count, int cap)
+		{
+			m_numNeighbors += count;
+			m_stats.maxNeighbors = max(m_stats.maxNeighbors, count);
+			m_stats.histogram[VtBroadphaseStats::HistogramBin(count)]++;
+			if (count >= cap) m_stats.numCapped++;
+		}
+
+		const VtBroadphaseStats& End()
+		{
+			m_stats.meanBucketSize = m_stats.occupiedBuckets > 0 ? (float)m_stats.numObjects / m_stats.occupiedBuckets : 0;
+			m_stats.collisionRate = m_stats.numCells > 0 ? (float)m_numCollidingCells / m_stats.numCells : 0;
+			m_stats.meanNeighbors = m_stats.numObjects > 0 ? (float)m_numNeighbors / m_stats.numObjects : 0;
+			m_stats.valid = true;
+			return m_stats;
+		}
+
+		size_t ScratchBytes() const
+		{
+			return m_cells.capacity() * sizeof(glm::ivec3);
+		}
+
+	private:
+		VtBroadphaseStats m_stats;
+		vector<glm::ivec3> m_cells;
+		size_t m_numNeighbors = 0;
+		int m_numCollidingCells = 0;
+	};
+}
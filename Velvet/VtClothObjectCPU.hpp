@@ -1,9 +1,13 @@
 #pragma once
 
 #include "Component.hpp"
+#include "Actor.hpp"
+#include "GameInstance.hpp"
 #include "VtClothSolverCPU.hpp"
+#ifndef VT_HEADLESS
 #include "MeshRenderer.hpp"
 #include "MouseGrabber.hpp"
+#endif
 
 namespace Velvet
 {
@@ -11,10 +15,11 @@ namespace Velvet
 	class VtClothObjectCPU : public Component
 	{
 	public:
-		VtClothObjectCPU(int resolution)
+		VtClothObjectCPU(int resolution, shared_ptr<Mesh> mesh)
 		{
 			SET_COMPONENT_NAME;
 			m_solver = make_shared<VtClothSolverCPU>(resolution);
+			m_mesh = mesh;
 		}
 
 		void SetAttachedIndices(vector<int> indices)
@@ -24,24 +29,28 @@ namespace Velvet
 
 		void SetAttachmentPosition(int index, glm::vec3 attachPos) const
 		{ 
-			get<1>(m_solver->m_attachmentConstriants[index]) = attachPos;
+			auto& attachments = m_solver->m_attachmentConstriants;
+			attachments.rest[attachments.Slot(index)] = attachPos;
 		}
 
 		void Start() override
 		{
-			auto mesh = actor->GetComponent<MeshRenderer>()->mesh();
-			m_solver->Initialize(mesh, actor->transform->matrix());
+			m_solver->Initialize(m_mesh, actor->transform->matrix(), Global::game->FindComponents<Collider>());
 			actor->transform->Reset();
 		}
 
 		void Update() override
 		{
+#ifndef VT_HEADLESS
 			HandleMouseInteraction();
+#endif
 		}
 
 		void FixedUpdate() override
 		{
+#ifndef VT_HEADLESS
 			UpdateGrappedVertex(); 
+#endif
 			Timer::StartTimer("CPU_TIME");
 			m_solver->Simulate();
 			Timer::EndTimer("CPU_TIME");
@@ -52,6 +61,11 @@ namespace Velvet
 			return m_solver;
 		}
 
+		shared_ptr<Mesh> mesh() const
+		{
+			return m_mesh;
+		}
+
 		float particleDiameter() const
 		{
 			return m_solver->particleDiameter();
@@ -59,7 +73,9 @@ namespace Velvet
 
 	private:
 		shared_ptr<VtClothSolverCPU> m_solver;
+		shared_ptr<Mesh> m_mesh;
 
+#ifndef VT_HEADLESS
 		bool m_isGrabbing = false;
 		float m_grabbedVertexMass = 0;
 		RaycastCollision m_rayCollision;
@@ -75,8 +91,9 @@ namespace Velvet
 				if (m_rayCollision.collide)
 				{
 					m_isGrabbing = true;
-					m_grabbedVertexMass = m_solver->m_inverseMass[m_rayCollision.objectIndex];
-					m_solver->m_inverseMass[m_rayCollision.objectIndex] = 0;
+					int id = m_solver->ParticleIndex(m_rayCollision.objectIndex);
+					m_grabbedVertexMass = m_solver->m_inverseMass[id];
+					m_solver->m_inverseMass[id] = 0;
 				}
 			}
 
@@ -84,10 +101,11 @@ namespace Velvet
 			if (shouldReleaseObject && m_isGrabbing)
 			{
 				m_isGrabbing = false;
-				m_solver->m_inverseMass[m_rayCollision.objectIndex] = m_grabbedVertexMass;
+				m_solver->m_inverseMass[m_solver->ParticleIndex(m_rayCollision.objectIndex)] = m_grabbedVertexMass;
 			}
 		}
 	
+		// objectIndex is a mesh vertex, which stays valid when the solver reorders its particles
 		RaycastCollision FindClosestVertexToRay(Ray ray)
 		{
 			int result = -1;
@@ -99,7 +117,7 @@ namespace Velvet
 				float distanceToRay = glm::length(glm::cross(ray.direction, position - ray.origin));
 				if (distanceToRay < minDistanceToRay)
 				{
-					result = i;
+					result = m_solver->MeshIndex(i);
 					minDistanceToRay = distanceToRay;
 					distanceToView = glm::dot(ray.direction, position - ray.origin);
 				}
@@ -113,12 +131,12 @@ namespace Velvet
 			{
 				Ray ray = GetMouseRay();
 				glm::vec3 mousePos = ray.origin + ray.direction * m_rayCollision.distanceToOrigin;
-				int id = m_rayCollision.objectIndex;
+				int id = m_solver->ParticleIndex(m_rayCollision.objectIndex);
 				auto curPos = m_solver->m_positions[id];
 				glm::vec3 target = Helper::Lerp(mousePos, curPos, 0.8f);
 
-				m_solver->m_positions[id] = target;
-				m_solver->m_velocities[id] += (target - curPos) / Timer::fixedDeltaTime();
+				m_solver->m_positions.Set(id, target);
+				m_solver->AddVelocity(id, (target - curPos) / Timer::fixedDeltaTime());
 			}
 		}
 
@@ -139,5 +157,6 @@ namespace Velvet
 
 			return Ray{ nearPoint, direction };
 		}
+#endif
 	};
 }
\ No newline at end of file
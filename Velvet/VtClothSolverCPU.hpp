@@ -1,89 +1,344 @@
 #pragma once
 
-#include "Actor.hpp"
-#include "Component.hpp"
-#include "MeshRenderer.hpp"
+#include <tuple>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <typeinfo>
+#include <type_traits>
+
+#include "Mesh.hpp"
 #include "Global.hpp"
-#include "GameInstance.hpp"
 #include "Collider.hpp"
-#include "Camera.hpp"
-#include "Input.hpp"
-#include "GUI.hpp"
 #include "SpatialHashCPU.hpp"
 #include "Timer.hpp"
+#include "VtProfiler.hpp"
+#include "VtConvergence.hpp"
+#include "VtMemoryReport.hpp"
+#include "VtParticleStore.hpp"
+#include "VtParticleKernels.hpp"
+#include "VtConstraintBuffer.hpp"
+#include "VtConstraintKernels.hpp"
+#include "VtThreadPool.hpp"
 
 
 namespace Velvet
 {
+	// Switches of one VtClothSolverCPU frame that are fixed at compile time. Simulate() picks the instantiation that
+	// matches Global::simParams once per frame, so particle and contact loops do not test disabled features.
+	template <bool TSelfCollision, bool TFriction, bool TBending>
+	struct VtSolverFeatures
+	{
+		static constexpr bool selfCollision = TSelfCollision;	// enableSelfCollision
+		static constexpr bool friction = TFriction;				// friction > 0
+		static constexpr bool bending = TBending;				// enableBending, Gauss-Seidel only
+	};
+
 	class VtClothSolverCPU
 	{
+		// Micro benchmarks time private solver phases individually
+		friend class VtSolverBenchmark;
 	public:
 		// SimBuffer Begin
-		vector<glm::vec3> m_positions;
-		vector<glm::vec3> m_predicted;
-		vector<glm::vec3> m_velocities;
-		vector<glm::vec3> m_deltas;
-		vector<int>		  m_deltaCounts;
-		vector<float> m_inverseMass;
-
-		vector<tuple<int, int, float>> m_stretchConstraints; // idx1, idx2, distance
-		vector<tuple<int, glm::vec3>> m_attachmentConstriants; // idx1, position
-		vector<tuple<int, int, int, int, float>> m_bendingConstraints; // idx1, idx2, idx3, idx4, angle
+		// Structure of arrays: per-particle phases run as SIMD kernels (VtParticleKernels)
+		VtVec3Stream m_positions;
+		VtVec3Stream m_predicted;
+		VtVec3Stream m_velocities;		// empty with compact(), see Velocity()
+		VtVec3Stream m_deltas;
+		VtAlignedVector<int> m_deltaCounts;
+		VtAlignedVector<float> m_inverseMass;
+
+		VtStretchConstraints m_stretchConstraints; // (idx1, idx2), distance
+		VtStretchGrid m_stretchGrid; // the same constraints without indices, see gridStretch()
+		VtCompactStretch m_compactStretch; // the same constraints with 16-bit indices and fp16 rest lengths, see compact()
+		VtAttachmentConstraints m_attachmentConstriants; // idx1, position
+		VtBendingConstraints m_bendingConstraints; // (idx1, idx2, idx3, idx4), angle
 		vector<tuple<int, int, int, int>> m_selfCollisionConstraints; // idx1, triangle(idx2, idx3, idx4)
 		// SimBuffer End
 
+		// Set convergence.enabled to record residuals after every iteration, or every substep of tiledStretch() (adds to Solver_Total)
+		VtConvergenceRecorder convergence;
+		// Updated by every CollideParticles / CollideSDF call
+		VtContactStats contactStats;
+
 		VtClothSolverCPU(int resolution)
 		{
 			m_resolution = resolution;
 		}
 
+		// Attached vertices are indices into the mesh. May be called after Initialize() as well: attachments are then
+		// regenerated at the current positions.
 		void SetAttachedIndices(vector<int> indices)
 		{
 			m_attachedIndices = indices;
+			if (m_positions.empty()) return;
+
+			for (int idx : m_attachmentConstriants.indices)
+			{
+				m_inverseMass[idx] = 1.0f;
+			}
+			m_attachmentConstriants.clear();
+			GenerateAttachment(m_attachedIndices);
+			RecolorConstraints();
+		}
+
+		// With colored(), partitions every constraint buffer into colors and lane groups (VtConstraintBuffer::PackLanes).
+		// Lists the stretch constraints of every particle for Jacobi iterations. Has to be called whenever constraints
+		// are added or removed after initialization.
+		void RecolorConstraints()
+		{
+			if (m_colored)
+			{
+				m_stretchConstraints.PackLanes(m_numVertices);
+				m_bendingConstraints.PackLanes(m_numVertices);
+				m_attachmentConstriants.PackLanes(m_numVertices);
+			}
+			m_stretchConstraints.BuildIncidence(m_numVertices);
+			if (m_compact)
+			{
+				BuildCompactStretch();
+			}
 		}
 
-		void Initialize(shared_ptr<Mesh> mesh, glm::mat4 modelMatrix)
+		// Global::simParams.coloredConstraints: constraints are solved in the packed order of their lane groups, by the
+		// vectorized kernels. Otherwise they keep the order of generation and are solved one after another.
+		bool colored() const
+		{
+			return m_colored;
+		}
+
+		// Global::simParams.compactState: velocities are stored as fp16 (m_halfVelocities), colored stretch sweeps read
+		// m_compactStretch and neighbor lists hold 16-bit offsets. Results differ from the fp32 state by rounding.
+		bool compact() const
+		{
+			return m_compact;
+		}
+
+		glm::vec3 Velocity(int i) const
+		{
+			return m_compact ? m_halfVelocities[i] : m_velocities[i];
+		}
+
+		void AddVelocity(int i, glm::vec3 velocity)
+		{
+			if (m_compact)
+			{
+				m_halfVelocities.Add(i, velocity);
+			}
+			else
+			{
+				m_velocities.Add(i, velocity);
+			}
+		}
+
+		// With Global::simParams.reorderParticles the solver stores particles in Morton order of their position
+		// instead of mesh order. Mesh vertex i is particle ParticleIndex(i), particle p is mesh vertex MeshIndex(p).
+		int ParticleIndex(int meshIndex) const
+		{
+			return m_particleOf.empty() ? meshIndex : m_particleOf[meshIndex];
+		}
+
+		int MeshIndex(int particle) const
+		{
+			return m_meshIndexOf.empty() ? particle : m_meshIndexOf[particle];
+		}
+
+		// Sorts particles by the Morton code of their current position, and constraints by their first particle.
+		// Changes the solving order, and allocates.
+		void ReorderParticles()
+		{
+			vector<int> order = MortonOrder();
+			vector<int> newIndex(m_numVertices);
+			for (int i = 0; i < m_numVertices; i++) newIndex[order[i]] = i;
+
+			for (auto stream : { &m_positions, &m_predicted, &m_velocities, &m_deltas })
+			{
+				if (stream->empty()) continue;
+				for (int i = 0; i < m_numVertices; i++) m_collisionOrigins.Set(i, (*stream)[order[i]]);
+				swap(*stream, m_collisionOrigins);
+			}
+			if (m_compact)
+			{
+				VtHalfStream previous = m_halfVelocities;
+				for (int i = 0; i < m_numVertices; i++)
+				{
+					m_halfVelocities.x[i] = previous.x[order[i]];
+					m_halfVelocities.y[i] = previous.y[order[i]];
+					m_halfVelocities.z[i] = previous.z[order[i]];
+				}
+			}
+			auto permute = [&](auto& values) {
+				auto previous = values;
+				for (int i = 0; i < m_numVertices; i++) values[i] = previous[order[i]];
+			};
+			permute(m_inverseMass);
+			permute(m_deltaCounts);
+			m_spatialHash->ReorderObjects(order);
+
+			if (m_meshIndexOf.empty())
+			{
+				m_meshIndexOf.resize(m_numVertices);
+				for (int i = 0; i < m_numVertices; i++) m_meshIndexOf[i] = i;
+				m_particleOf = m_meshIndexOf;
+			}
+			permute(m_meshIndexOf);
+			for (int i = 0; i < m_numVertices; i++) m_particleOf[m_meshIndexOf[i]] = i;
+
+			m_stretchConstraints.RemapParticles(newIndex);
+			m_bendingConstraints.RemapParticles(newIndex);
+			m_attachmentConstriants.RemapParticles(newIndex);
+			m_stretchConstraints.SortByFirstParticle();
+			m_bendingConstraints.SortByFirstParticle();
+			m_attachmentConstriants.SortByFirstParticle();
+			RecolorConstraints();
+			m_framesSinceReorder = 0;
+		}
+
+		void Initialize(shared_ptr<Mesh> mesh, glm::mat4 modelMatrix, const vector<Collider*>& colliders)
 		{
 			Timer::StartTimer("INIT_SOLVER_CPU");
 			fmt::print("Info(VtClothSolver): Start\n");
 			m_mesh = mesh;
 
-			m_positions = m_mesh->vertices();
+			// Particle, constraint, spatial hash and mesh staging buffers come from one arena (Global::simParams.solverArena),
+			// which a reloaded scene takes over from the previous one. Buffers that grow later on come from the heap. With
+			// first touch the arrays move to the heap right after they are built, so they skip the arena.
+			bool firstTouch = Global::simParams.numaFirstTouch && (int)m_mesh->vertices().size() >= Global::simParams.minParallelParticles;
+			if (Global::simParams.solverArena && firstTouch)
+			{
+				fmt::print("Info(ClothSolverCPU): Solver arena skipped, arrays are placed by first touch\n");
+			}
+			else if (Global::simParams.solverArena)
+			{
+				size_t bytes = k_arenaBaseBytes + m_mesh->vertices().size() * k_arenaBytesPerParticle;
+				m_arena = VtArenaHandle(VtArena::Acquire(bytes, (VtArena::HugePages)clamp(Global::simParams.arenaHugePages, 0, 2)));
+			}
+			VtArena::Scope arenaScope(m_arena.get());
+
+			m_positions.Assign(m_mesh->vertices());
 			m_numVertices = (int)m_positions.size();
 			for (int i = 0; i < m_numVertices; i++)
 			{
-				m_positions[i] = modelMatrix * glm::vec4(m_positions[i], 1.0f);
+				m_positions.Set(i, modelMatrix * glm::vec4(m_positions[i], 1.0f));
 			}
 
-			m_indices = m_mesh->indices();
-			m_colliders = Global::game->FindComponents<Collider>();
+			m_indices.assign(m_mesh->indices().begin(), m_mesh->indices().end());
+			m_colliders = colliders;
+			contactStats.colliderContacts = vector<int>(m_colliders.size(), 0);
+			m_sdfContacts = vector<atomic<int>>(m_colliders.size());
 
-			m_velocities = vector<glm::vec3>(m_numVertices);
-			m_predicted = vector<glm::vec3>(m_numVertices);
-			m_inverseMass = vector<float>(m_numVertices, 1.0);
+			m_colored = Global::simParams.coloredConstraints;
+			m_compact = Global::simParams.compactState;
+			if (m_compact)
+			{
+				m_halfVelocities.Resize(m_numVertices);
+			}
+			else
+			{
+				m_velocities = VtVec3Stream(m_numVertices);
+			}
+			m_predicted = VtVec3Stream(m_numVertices);
+			m_inverseMass = VtAlignedVector<float>(m_numVertices, 1.0);
 
-			m_deltas = vector<glm::vec3>(m_numVertices, glm::vec3(0));
-			m_deltaCounts = vector<int>(m_numVertices, 0);
+			m_deltas = VtVec3Stream(m_numVertices);
+			m_deltaCounts = VtAlignedVector<int>(m_numVertices, 0);
+			m_normals = VtAlignedVector<glm::vec3>(m_numVertices);
+			m_triangleNormals = VtAlignedVector<glm::vec3>(m_indices.size() / 3);
+			m_positions.CopyTo(m_meshPositions);
+			m_collisionOrigins = VtVec3Stream(m_numVertices);
 
 			//m_particleDiameter = glm::length(m_positions[0] - m_positions[m_resolution + 1]);
 			m_particleDiameter = glm::length(m_positions[0] - m_positions[1]) * Global::simParams.particleDiameterScalar;
 			std::cout << "particle diameter: " << m_particleDiameter << std::endl;
 
-			m_spatialHash = make_shared<SpatialHashCPU>(m_particleDiameter, m_numVertices);
+			m_spatialHash = make_shared<SpatialHashCPU>(m_particleDiameter, m_numVertices, m_compact);
 			m_spatialHash->SetInitialPositions(m_positions);
+			BuildVertexTriangles();
 
 			GenerateStretch();
+			if (m_numVertices == (m_resolution + 1) * (m_resolution + 1))
+			{
+				m_stretchGrid.Build(m_resolution, m_positions);
+			}
 			GenerateAttachment(m_attachedIndices);
 			GenerateBending();
+			m_partialReductions.resize(max(m_stretchConstraints.size(), (size_t)m_numVertices) / k_particleChunk + 1);
+
+			// Colors and lane groups for the vectorized, multithreaded sweeps. Every SIMD level and thread count solves in this order.
+			if (Global::simParams.reorderParticles)
+			{
+				ReorderParticles();
+			}
+			else
+			{
+				RecolorConstraints();
+			}
+			if (Global::simParams.numaFirstTouch)
+			{
+				ConfigurePool();
+				FirstTouch();
+			}
+			if (m_colored)
+			{
+				fmt::print("Info(ClothSolverCPU): Packed {} stretch and {} bending constraints into {} and {} colors ({} and {} lane groups)\n",
+					m_stretchConstraints.size(), m_bendingConstraints.size(), m_stretchConstraints.numColors(), m_bendingConstraints.numColors(),
+					m_stretchConstraints.numGroups(), m_bendingConstraints.numGroups());
+			}
+			else
+			{
+				fmt::print("Info(ClothSolverCPU): Solving {} stretch and {} bending constraints in generation order\n",
+					m_stretchConstraints.size(), m_bendingConstraints.size());
+			}
 
 			double time = Timer::EndTimer("INIT_SOLVER_CPU") * 1000;
 			fmt::print("Info(ClothSolverCPU): Initialize done. Took time {:.2f} ms\n", time);
 			fmt::print("Info(ClothSolverCPU): Use recommond max vel = {}\n", Global::simParams.maxSpeed);
+			fmt::print("Info(ClothSolverCPU): Per-particle kernels use {}\n", VtSimd::Name(VtSimd::Active()));
+			if (m_compact)
+			{
+				size_t stretchBytes = m_stretchConstraints.size() * (sizeof(m_stretchConstraints.indices[0]) + sizeof(m_stretchConstraints.rest[0]));
+				fmt::print("Info(ClothSolverCPU): Compact state, fp16 velocities and {} of {} KB of stretch constraints per sweep\n",
+					m_compactStretch.empty() ? stretchBytes / 1024 : m_compactStretch.capacityBytes() / 1024, stretchBytes / 1024);
+			}
+			if (Global::simParams.threadAffinity != 0 || Global::simParams.numaFirstTouch)
+			{
+				const char* affinities[] = { "unpinned", "compact", "scatter" };
+				fmt::print("Info(ClothSolverCPU): {} NUMA node(s), {} workers{}\n", VtThreadPool::NumaNodes().size(),
+					affinities[clamp(Global::simParams.threadAffinity, 0, 2)], Global::simParams.numaFirstTouch && parallel() ? ", arrays placed by first touch" : "");
+			}
+			if (m_arena)
+			{
+				const char* pages[] = { "regular", "transparent huge", "huge" };
+				fmt::print("Info(ClothSolverCPU): Arena holds {:.2f} of {:.2f} MB, {} pages\n", m_arena->used() / 1e6, m_arena->capacity() / 1e6,
+					pages[(int)m_arena->hugePages()]);
+			}
 		}
 
+		// Does not allocate once the first frame is done (checked by VT_TRACK_ALLOCATIONS builds)
 		void Simulate()
 		{
+			// Starting or stopping workers and reordering particles allocate, so they are done outside the profiled scopes
+			ConfigurePool();
+			m_spatialHash->parallel = parallel();
+			if (Global::simParams.reorderParticles && Global::simParams.reorderInterval > 0 &&
+				++m_framesSinceReorder >= Global::simParams.reorderInterval)
+			{
+				ReorderParticles();
+				if (Global::simParams.numaFirstTouch) FirstTouch();
+			}
+
 			Timer::StartTimer("Solver_Total");
+			{
+				VT_PROFILE_SCOPE("Solver_Simulate");
+				WithFeatures([&](auto features) { Simulate(features); });
+			}
+			Timer::EndTimer("Solver_Total");
+		}
+
+		// One frame with the features of TFeatures
+		template <class TFeatures>
+		void Simulate(TFeatures features)
+		{
 			float frameTime = Timer::fixedDeltaTime();
 			float substepTime = Timer::fixedDeltaTime() / Global::simParams.numSubsteps;
 			 
@@ -112,37 +367,126 @@ namespace Velvet
 				Finalize(substepTime);
 			}*/
 
-			CollideSDF(m_positions, m_positions, frameTime);
+			{
+				VT_PROFILE_SCOPE("Solver_CollideSDFs");
+				CollideSDF(features, m_positions, m_positions, frameTime);
+			}
 
+			if (convergence.enabled)
+			{
+				int samplesPerSubstep = tiledStretch() ? 1 : Global::simParams.numIterations;
+				convergence.BeginFrame(Global::simParams.numSubsteps * samplesPerSubstep, (int)m_colliders.size());
+			}
+
+			// With fusedSweeps, Finalize of one substep also predicts the next one (FinalizeAndPredict)
+			bool fused = Global::simParams.fusedSweeps;
 			for (int substep = 0; substep < Global::simParams.numSubsteps; substep++)
 			{
-				PredictPositions(m_predicted, m_velocities, m_positions, substepTime);
+				bool predicted = fused && substep > 0;
+				if (!predicted)
+				{
+					VT_PROFILE_SCOPE("Solver_Predict");
+					PredictPositions(substepTime);
+				}
 
-				if (Global::simParams.enableSelfCollision)
+				if constexpr (TFeatures::selfCollision)
 				{
 					if (substep % Global::simParams.interleavedHash == 0)
 					{
 						m_spatialHash->HashObjects(m_predicted);
 					}
-					CollideParticles();
-					//ApplyDeltas();
+					VT_PROFILE_SCOPE("Solver_CollideParticles");
+					if (Global::simParams.jacobiCPU)
+					{
+						CollideParticlesJacobi(features);
+						ApplyDeltas();
+					}
+					else
+					{
+						CollideParticles(features);
+					}
+				}
+				// Without self collision, FinalizeAndPredict has applied the colliders as well
+				if (!predicted || TFeatures::selfCollision)
+				{
+					VT_PROFILE_SCOPE("Solver_CollideSDFs");
+					CollideSDF(features, m_predicted, m_positions, substepTime);
 				}
-				CollideSDF(m_predicted, m_positions, substepTime);
 
-				for (int iteration = 0; iteration < Global::simParams.numIterations; iteration++)
+				if (tiledStretch())
 				{
-					SolveStretch(substepTime);
-					SolveBending(substepTime);					
-					SolveAttachment(); 
+					SolveTiled(features, substep, substepTime);
+				}
+				else
+				{
+					for (int iteration = 0; iteration < Global::simParams.numIterations; iteration++)
+					{
+						// Jacobi iterations follow the GPU solver: bending is left out there, and on the CPU
+						// it only accumulates deltas that are never applied
+						if (Global::simParams.jacobiCPU)
+						{
+							{
+								VT_PROFILE_SCOPE("Solver_SolveStretch");
+								SolveStretchJacobi();
+							}
+							{
+								VT_PROFILE_SCOPE("Solver_ApplyDeltas");
+								ApplyDeltas();
+							}
+						}
+						else
+						{
+							{
+								VT_PROFILE_SCOPE("Solver_SolveStretch");
+								SolveStretch(substepTime);
+							}
+							if constexpr (TFeatures::bending)
+							{
+								VT_PROFILE_SCOPE("Solver_SolveBending");
+								SolveBending(substepTime);
+							}
+						}
+						{
+							VT_PROFILE_SCOPE("Solver_SolveAttach");
+							SolveAttachment();
+						}
+						if (convergence.enabled)
+						{
+							VT_PROFILE_SCOPE("Solver_Residuals");
+							RecordResiduals(substep, iteration, substepTime);
+						}
+					}
 				}
 
-				Finalize(substepTime);
+				VT_PROFILE_SCOPE("Solver_Finalize");
+				if (!fused)
+				{
+					Finalize(substepTime);
+				}
+				else if (substep + 1 < Global::simParams.numSubsteps)
+				{
+					FinalizeAndPredict(features, substepTime, !TFeatures::selfCollision);
+				}
+				else
+				{
+					FinalizeToMesh(substepTime);
+				}
 			}
 
-			auto normals = ComputeNormals(m_positions);
-			m_mesh->SetVerticesAndNormals(m_positions, normals);
+			{
+				VT_PROFILE_SCOPE("Solver_UpdateNormals");
+				if (!fused)
+				{
+					CopyToMesh();
+				}
+				ComputeNormals(m_meshPositions, m_normals);
+				m_mesh->SetVerticesAndNormals(m_meshPositions, m_normals);
+			}
 
-			Timer::EndTimer("Solver_Total");
+			if (convergence.enabled)
+			{
+				convergence.EndFrame();
+			}
 		}
 
 		float particleDiameter() const
@@ -150,31 +494,58 @@ namespace Velvet
 			return m_particleDiameter;
 		}
 
+		shared_ptr<SpatialHashCPU> spatialHash() const
+		{
+			return m_spatialHash;
+		}
+
+		const vector<Collider*>& colliders() const
+		{
+			return m_colliders;
+		}
+
+		// Solver and spatial hash buffers. The simulated mesh is reported by its owner.
+		void ReportMemory(VtMemoryReport& report) const
+		{
+			report.Add("Solver", "positions", m_positions.capacityBytes() + VtMemoryReport::Bytes(m_meshPositions));
+			report.Add("Solver", "predicted", m_predicted.capacityBytes() + m_collisionOrigins.capacityBytes());
+			report.Add("Solver", "velocities", m_velocities.capacityBytes() + m_halfVelocities.capacityBytes());
+			report.Add("Solver", "deltas", m_deltas.capacityBytes() + VtMemoryReport::Bytes(m_deltaCounts));
+			report.Add("Solver", "inverse mass", m_inverseMass);
+			report.Add("Solver", "normals", VtMemoryReport::Bytes(m_normals) + VtMemoryReport::Bytes(m_triangleNormals) +
+				VtMemoryReport::Bytes(m_vertexTriangleStart) + VtMemoryReport::Bytes(m_vertexTriangles));
+			report.Add("Solver", "indices", VtMemoryReport::Bytes(m_indices) + VtMemoryReport::Bytes(m_particleOf) + VtMemoryReport::Bytes(m_meshIndexOf));
+			report.Add("Solver", "stretch constraints", m_stretchConstraints.capacityBytes() + m_stretchGrid.capacityBytes() + m_compactStretch.capacityBytes());
+			report.Add("Solver", "bending constraints", m_bendingConstraints.capacityBytes());
+			report.Add("Solver", "attachment constraints", m_attachmentConstriants.capacityBytes() + VtMemoryReport::Bytes(m_attachedIndices));
+			report.Add("Solver", "self collision constraints", m_selfCollisionConstraints);
+			report.Add("Solver", "colliders and contacts", VtMemoryReport::Bytes(m_colliders) + VtMemoryReport::Bytes(contactStats.colliderContacts));
+			report.Add("Solver", "convergence recorder", sizeof(convergence) +
+				VtMemoryReport::Bytes(convergence.samples) + VtMemoryReport::Bytes(convergence.penetrations));
+			m_spatialHash->ReportMemory(report);
+		}
+
 		void ApplyDeltas()
 		{
-			for (int i = 0; i < m_numVertices; i++)
-			{
-				float count = (float)m_deltaCounts[i];
-				if (count > 0)
-				{
-					m_predicted[i] += m_deltas[i] / count * Global::simParams.relaxationFactor;
-					m_deltas[i] = glm::vec3(0);
-					m_deltaCounts[i] = 0;
-				}
-			}
+			ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+				VtParticleKernels::ApplyDeltas(m_predicted, m_deltas, m_deltaCounts.data(), Global::simParams.relaxationFactor, begin, end);
+				});
 		}
 	private: // Generate constraints
 
 		void GenerateStretch()
 		{
 			auto VertexAt = [this](int x, int y) {
-				return x * (m_resolution + 1) + y;
+				return ParticleIndex(x * (m_resolution + 1) + y);
 			};
 
 			auto DistanceBetween = [this](int idx1, int idx2) {
 				return glm::length(m_positions[idx1] - m_positions[idx2]);
 			};
 
+			// two edges per vertex without the last row and column, plus two diagonals per quad
+			m_stretchConstraints.reserve(2 * m_resolution * (m_resolution + 1) + 2 * m_resolution * m_resolution);
+
 			for (int x = 0; x < m_resolution + 1; x++)
 			{
 				for (int y = 0; y < m_resolution + 1; y++)
@@ -185,25 +556,25 @@ namespace Velvet
 					{
 						idx1 = VertexAt(x, y);
 						idx2 = VertexAt(x, y + 1);
-						m_stretchConstraints.push_back(make_tuple(idx1, idx2, DistanceBetween(idx1, idx2)));
+						m_stretchConstraints.Add({ idx1, idx2 }, DistanceBetween(idx1, idx2));
 					}
 
 					if (x != m_resolution)
 					{
 						idx1 = VertexAt(x, y);
 						idx2 = VertexAt(x + 1, y);
-						m_stretchConstraints.push_back(make_tuple(idx1, idx2, DistanceBetween(idx1, idx2)));
+						m_stretchConstraints.Add({ idx1, idx2 }, DistanceBetween(idx1, idx2));
 					}
 
 					if (y != m_resolution && x != m_resolution)
 					{
 						idx1 = VertexAt(x, y);
 						idx2 = VertexAt(x + 1, y + 1);
-						m_stretchConstraints.push_back(make_tuple(idx1, idx2, DistanceBetween(idx1, idx2)));
+						m_stretchConstraints.Add({ idx1, idx2 }, DistanceBetween(idx1, idx2));
 
 						idx1 = VertexAt(x, y + 1);
 						idx2 = VertexAt(x + 1, y);
-						m_stretchConstraints.push_back(make_tuple(idx1, idx2, DistanceBetween(idx1, idx2)));
+						m_stretchConstraints.Add({ idx1, idx2 }, DistanceBetween(idx1, idx2));
 					}
 				}
 			}
@@ -211,9 +582,11 @@ namespace Velvet
 
 		void GenerateAttachment(vector<int> indices)
 		{
-			for (auto i : indices)
+			m_attachmentConstriants.reserve(indices.size());
+			for (auto meshIndex : indices)
 			{
-				m_attachmentConstriants.push_back({ i, m_positions[i]});
+				int i = ParticleIndex(meshIndex);
+				m_attachmentConstriants.Add(i, m_positions[i]);
 				m_inverseMass[i] = 0;
 			}
 		}
@@ -221,16 +594,17 @@ namespace Velvet
 		void GenerateBending()
 		{
 			// HACK: not for every kind of mesh
+			m_bendingConstraints.reserve(m_indices.size() / 6);
 			for (int i = 0; i < m_indices.size(); i += 6)
 			{
-				int idx1 = m_indices[i];
-				int idx2 = m_indices[i + 1];
-				int idx3 = m_indices[i + 2];
-				int idx4 = m_indices[i + 5];
+				int idx1 = ParticleIndex(m_indices[i]);
+				int idx2 = ParticleIndex(m_indices[i + 1]);
+				int idx3 = ParticleIndex(m_indices[i + 2]);
+				int idx4 = ParticleIndex(m_indices[i + 5]);
 
 				// calculate angle
 				float angle = 0;
-				m_bendingConstraints.push_back(make_tuple(idx1, idx2, idx3, idx4, angle));
+				m_bendingConstraints.Add({ idx1, idx2, idx3, idx4 }, angle);
 			}
 		}
 
@@ -241,158 +615,241 @@ namespace Velvet
 
 	private: // Core physics
 
-		void PredictPositions(vector<glm::vec3>& predicted, vector<glm::vec3>& velocities, const vector<glm::vec3>& positions, const float deltaTime)
+		void PredictPositions(const float deltaTime)
 		{
-			for (int i = 0; i < m_numVertices; i++)
+			WithVelocities([&](auto& velocities) {
+				ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+					VtParticleKernels::Predict(m_predicted, velocities, m_positions, Global::simParams.gravity, deltaTime, begin, end);
+					});
+				});
+		}
+
+		// Colors run one after another; the groups of one color share no particle and are split across the thread pool.
+		// Every group is solved exactly as in a single-threaded sweep, so results do not depend on the thread count.
+		// Without colored() there are no groups, and all constraints are solved in generation order on the calling thread.
+		template <class TBuffer, class TSolve>
+		void SolveColored(const TBuffer& constraints, const TSolve& solve)
+		{
+			if (constraints.groups.empty())
 			{
-				velocities[i] += Global::simParams.gravity * deltaTime;
-				predicted[i] = positions[i] + velocities[i] * deltaTime;
+				solve(0, -1);
+				return;
 			}
+			for (size_t c = 0; c < constraints.numColors(); c++)
+			{
+				int first = constraints.colorGroups[c];
+				ParallelFor(constraints.colorGroups[c + 1] - first, k_groupChunk, [&](int begin, int end) {
+					solve(first + begin, first + end);
+					});
+			}
+			solve(constraints.firstSerialGroup, (int)constraints.numGroups());
 		}
 
 		void SolveStretch(float deltaTime)
 		{
-			for (auto c : m_stretchConstraints)
+			if (gridStretch())
+			{
+				SolveStretchGrid();
+				return;
+			}
+			if (!m_compactStretch.empty())
+			{
+				SolveColored(m_stretchConstraints, [&](int firstGroup, int endGroup) {
+					VtConstraintKernels::SolveStretchCompact(m_predicted, m_deltas, m_deltaCounts.data(), m_inverseMass.data(), m_stretchConstraints,
+						m_compactStretch, firstGroup, endGroup);
+					});
+				return;
+			}
+			SolveColored(m_stretchConstraints, [&](int firstGroup, int endGroup) {
+				VtConstraintKernels::SolveStretch(m_predicted, m_deltas, m_deltaCounts.data(), m_inverseMass.data(), m_stretchConstraints,
+					firstGroup, endGroup);
+				});
+		}
+
+		// Index-free Gauss-Seidel sweep over m_stretchGrid: eight conflict-free passes, whose lines are split across the pool
+		void SolveStretchGrid()
+		{
+			int lineChunk = max(k_particleChunk / m_stretchGrid.stride, 1);
+			for (int direction = 0; direction < VtStretchGrid::NumDirections; direction++)
 			{
-				auto idx1 = get<0>(c);
-				auto idx2 = get<1>(c);
-				auto expectedDistance = get<2>(c);
+				for (int parity = 0; parity < 2; parity++)
+				{
+					ParallelFor(m_stretchGrid.NumLines(direction, parity), lineChunk, [&](int begin, int end) {
+						VtConstraintKernels::SolveStretchGrid(m_predicted, m_deltas, m_deltaCounts.data(), m_inverseMass.data(), m_stretchGrid,
+							direction, parity, begin, end);
+						});
+				}
+			}
+		}
 
-				glm::vec3 diff = m_predicted[idx1] - m_predicted[idx2];
-				float distance = glm::length(diff);
-				auto w1 = m_inverseMass[idx1];
-				auto w2 = m_inverseMass[idx2];
-				auto denom = w1 + w2;
+		// The iterations of one substep with tiledStretch(). Residuals are recorded once per substep.
+		template <class TFeatures>
+		void SolveTiled(TFeatures, int substep, float deltaTime)
+		{
+			int numIterations = Global::simParams.numIterations;
+			{
+				VT_PROFILE_SCOPE("Solver_SolveStretch");
+				SolveStretchTiled(substep, numIterations, Global::simParams.cacheTileKB);
+			}
+			if constexpr (TFeatures::bending)
+			{
+				VT_PROFILE_SCOPE("Solver_SolveBending");
+				for (int iteration = 0; iteration < numIterations; iteration++) SolveBending(deltaTime);
+			}
+			if (convergence.enabled)
+			{
+				VT_PROFILE_SCOPE("Solver_Residuals");
+				RecordResiduals(substep, numIterations - 1, deltaTime);
+			}
+		}
 
-				// We use unilateral constraints instead of bilateral constraints
-				// Otherwise the cloth may not look well after collision
-				if (distance != expectedDistance && denom > 0)
+		// Global::simParams.cacheTileKB: all stretch iterations of a substep, solved tile by tile. Tiles are bands of grid rows
+		// sized so that their positions, masses, deltas and rest lengths fit in tileKB. Each band runs every iteration
+		// while it stays in cache, on its own constraints and on those that connect its last row to the first row of the
+		// next band (its halo), so every constraint is solved exactly once per iteration. After each iteration it applies
+		// the attachments of the rows it wrote, as the untiled loop does. Even bands go first, then odd bands: a band writes
+		// up to the first row of the next one, so bands of one phase never share a row and run in parallel. Band boundaries
+		// move by half a band every other substep, so that no row stays on a boundary.
+		void SolveStretchTiled(int substep, int numIterations, int tileKB)
+		{
+			const auto& grid = m_stretchGrid;
+			const auto& attachments = m_attachmentConstriants;
+			constexpr int k_bytesPerParticle = 3 * sizeof(float) * 2 + sizeof(int) + sizeof(float) * (1 + VtStretchGrid::NumDirections);
+			int bandRows = max((int)((size_t)tileKB * 1024 / ((size_t)grid.stride * k_bytesPerParticle)), 2);
+			// Corrections cross a band boundary only between bands. Bands shorter than the distance they travel in the
+			// iterations of a substep lose too much convergence, so such tiles run the untiled sweep.
+			if (bandRows < k_minBandRowsPerIteration * numIterations && bandRows < grid.stride)
+			{
+				for (int iteration = 0; iteration < numIterations; iteration++)
 				{
-					auto gradient = diff / (distance + k_epsilon);
-					// compliance is zero, therefore XPBD=PBD					
-					auto lambda = (distance - expectedDistance) / denom;
-					glm::vec3 common = lambda * gradient;
-					m_predicted[idx1] -= w1 * common;
-					m_predicted[idx2] += w2 * common;
-
-					int reorder = idx1 + idx2;
-					int r1 = reorder % 3;
-					int r2 = (reorder + 1) % 3;
-					int r3 = (reorder + 2) % 3;
-					m_deltas[idx1][r1] += common[r1];
-					m_deltas[idx1][r2] += common[r2];
-					m_deltas[idx1][r3] += common[r3];
-
-					m_deltas[idx2][r1] += common[r1];
-					m_deltas[idx2][r2] += common[r2];
-					m_deltas[idx2][r3] += common[r3];
-
-					m_deltaCounts[idx1]++;
-					m_deltaCounts[idx2]++;
+					SolveStretchGrid();
+					SolveAttachment();
 				}
+				return;
+			}
+			int offset = substep % 2 == 0 ? 0 : bandRows / 2;
+			int firstBand = offset == 0 ? 0 : -1;
+			int numBands = (grid.stride - offset + bandRows - 1) / bandRows - firstBand;
+			auto bandRow = [&](int band) { return clamp(offset + (firstBand + band) * bandRows, 0, grid.stride); };
+
+			for (int phase = 0; phase < 2; phase++)
+			{
+				ParallelFor((numBands - phase + 1) / 2, 1, [&](int begin, int end) {
+					for (int band = 2 * begin + phase; band < 2 * end + phase; band += 2)
+					{
+						int firstRow = bandRow(band), endRow = bandRow(band + 1);
+						for (int iteration = 0; iteration < numIterations; iteration++)
+						{
+							for (int direction = 0; direction < VtStretchGrid::NumDirections; direction++)
+							{
+								// Horizontal lines stay within their row, the others reach one row into the next band
+								int haloRow = direction == VtStretchGrid::Horizontal ? endRow : min(endRow + 1, grid.stride);
+								for (int parity = 0; parity < 2; parity++)
+								{
+									int beginLine, endLine;
+									grid.RowLines(direction, parity, firstRow, haloRow, beginLine, endLine);
+									VtConstraintKernels::SolveStretchGrid(m_predicted, m_deltas, m_deltaCounts.data(), m_inverseMass.data(), grid,
+										direction, parity, beginLine, endLine);
+								}
+							}
+							for (size_t c = 0; c < attachments.size(); c++)
+							{
+								int row = attachments.indices[c] / grid.stride;
+								if (row >= firstRow && row <= endRow) m_predicted.Set(attachments.indices[c], attachments.rest[c]);
+							}
+						}
+					}
+					});
 			}
 		}
 
+		// Every particle gathers its own stretch corrections into m_deltas; nothing else is written
+		void SolveStretchJacobi()
+		{
+			ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+				VtConstraintKernels::GatherStretch(m_predicted, m_deltas, m_deltaCounts.data(), m_inverseMass.data(), m_stretchConstraints, begin, end);
+				});
+		}
+
+		// Bending corrections are only accumulated in m_deltas, the positions are not moved
 		void SolveBending(float deltaTime)
 		{
 			float xpbd_bend = Global::simParams.bendCompliance / deltaTime / deltaTime;
-			for (auto c : m_bendingConstraints)
-			{
-				// tri(idx1, idx3, idx2) and tri(idx1, idx2, idx4)
-				auto idx1 = get<0>(c);
-				auto idx2 = get<1>(c);
-				auto idx3 = get<2>(c);
-				auto idx4 = get<3>(c);
-				auto expectedAngle = get<4>(c);
-
-				auto w1 = m_inverseMass[idx1];
-				auto w2 = m_inverseMass[idx2];
-				auto w3 = m_inverseMass[idx3];
-				auto w4 = m_inverseMass[idx4];
-
-				auto p1 = m_predicted[idx1];
-				auto p2 = m_predicted[idx2] - p1;
-				auto p3 = m_predicted[idx3] - p1;
-				auto p4 = m_predicted[idx4] - p1;
-
-				glm::vec3 n1 = glm::normalize(glm::cross(p2, p3));
-				glm::vec3 n2 = glm::normalize(glm::cross(p2, p4));
-
-				float d = clamp(glm::dot(n1, n2), 0.0f, 1.0f);
-				float angle = acos(d);
-				// cross product for two equal vector produces NAN
-				if (angle < k_epsilon || isnan(d)) continue;
-
-				glm::vec3 q3 = (glm::cross(p2, n2) + glm::cross(n1, p2) * d) / (glm::length(glm::cross(p2, p3)) + k_epsilon);
-				glm::vec3 q4 = (glm::cross(p2, n1) + glm::cross(n2, p2) * d) / (glm::length(glm::cross(p2, p4)) + k_epsilon);
-				glm::vec3 q2 = -(glm::cross(p3, n2) + glm::cross(n1, p3) * d) / (glm::length(glm::cross(p2, p3)) + k_epsilon)
-					- (glm::cross(p4, n1) + glm::cross(n2, p4) * d) / (glm::length(glm::cross(p2, p4)) + k_epsilon);
-				glm::vec3 q1 = -q2 - q3 - q4;
-
-				float denom = xpbd_bend + (w1 * glm::dot(q1, q1) + w2 * glm::dot(q2, q2) + w3 * glm::dot(q3, q3) + w4 * glm::dot(q4, q4));
-				if (denom < k_epsilon) continue; // ?
-				float lambda = sqrt(1.0f - d * d) * (angle - expectedAngle) / denom;
-
-				//if (isnan(lambda) || glm::all(glm::isnan(q1)) || glm::all(glm::isnan(q2)) || glm::all(glm::isnan(q3)) || glm::all(glm::isnan(q4)))
-				//{
-				//	fmt::print("NAN detected\n");
-				//}
-				int reorder = idx1 + idx2 + idx3 + idx4;
-				int r1 = reorder % 3;
-				int r2 = (reorder + 1) % 3;
-				int r3 = (reorder + 2) % 3;
-				m_deltas[idx1][r1] += w1 * lambda * q1[r1];
-				m_deltas[idx1][r2] += w1 * lambda * q1[r2];
-				m_deltas[idx1][r3] += w1 * lambda * q1[r3];
-
-				m_deltas[idx2][r1] += w2 * lambda * q2[r1];
-				m_deltas[idx2][r2] += w2 * lambda * q2[r2];
-				m_deltas[idx2][r3] += w2 * lambda * q2[r3];
-
-				m_deltas[idx3][r1] += w3 * lambda * q3[r1];
-				m_deltas[idx3][r2] += w3 * lambda * q3[r2];
-				m_deltas[idx3][r3] += w3 * lambda * q3[r3];
-
-				m_deltas[idx4][r1] += w4 * lambda * q4[r1];
-				m_deltas[idx4][r2] += w4 * lambda * q4[r2];
-				m_deltas[idx4][r3] += w4 * lambda * q4[r3];
-
-				m_deltaCounts[idx1]++;
-				m_deltaCounts[idx2]++;
-				m_deltaCounts[idx3]++;
-				m_deltaCounts[idx4]++;
-
-				/*
-				m_predicted[idx1] += w1 * lambda * q1;
-				m_predicted[idx2] += w2 * lambda * q2;
-				m_predicted[idx3] += w3 * lambda * q3;
-				m_predicted[idx4] += w4 * lambda * q4;
-				*/
-			}
-		}
-
-		void CollideSDF(vector<glm::vec3>& predicted, vector<glm::vec3>& positions, const float deltaTime)
+			SolveColored(m_bendingConstraints, [&](int firstGroup, int endGroup) {
+				VtConstraintKernels::SolveBending(m_predicted, m_deltas, m_deltaCounts.data(), m_inverseMass.data(), m_bendingConstraints,
+					xpbd_bend, firstGroup, endGroup);
+				});
+		}
+
+		void CollideSDF(VtVec3Stream& predicted, const VtVec3Stream& positions, const float deltaTime)
 		{
-			// SDF collision
-			for (int i = 0; i < m_numVertices; i++)
+			WithFeatures([&](auto features) { CollideSDF(features, predicted, positions, deltaTime); });
+		}
+
+		template <class TFeatures>
+		void CollideSDF(TFeatures features, VtVec3Stream& predicted, const VtVec3Stream& positions, const float deltaTime)
+		{
+			auto& contacts = contactStats.colliderContacts;
+
+			// Friction uses the positions from before any collider moved the particle
+			const VtVec3Stream* origins = &positions;
+			if (&predicted == &positions)
 			{
-				glm::vec3 pos = positions[i];
-				auto pred = predicted[i];
+				m_collisionOrigins = positions;
+				origins = &m_collisionOrigins;
+			}
 
-				for (auto col : m_colliders)
-				{
-					glm::vec3 correction = col->ComputeSDF(pred);
-					pred += correction;
+			// Particles do not interact here, so applying one collider to all particles after another
+			// gives the same result as applying all colliders to one particle after another
+			for (int c = 0; c < m_colliders.size(); c++)
+			{
+				atomic<int> numContacts{ 0 };
+				ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+					numContacts += CollideSDF(features, m_colliders[c], predicted, *origins, deltaTime, begin, end);
+					});
+				contacts[c] = numContacts;
+			}
+		}
 
-					if (glm::dot(correction, correction) > 0)
+		// One collider against the particles [begin, end), returns the number of contacts
+		template <class TFeatures>
+		int CollideSDF(TFeatures, Collider* col, VtVec3Stream& predicted, const VtVec3Stream& origins, const float deltaTime, int begin, int end)
+		{
+			// Plane and sphere SDFs have vectorized kernels, unless a subclass overrides them
+			bool analytic = (col->type == ColliderType::Plane || col->type == ColliderType::Sphere) && typeid(*col) == typeid(Collider);
+			if (analytic && VtSimd::Active() != VtSimdLevel::Scalar)
+			{
+				VtSdfShape shape;
+				shape.velocityTransform = col->lastTransform * col->invCurTransform;
+				shape.center = col->actor->transform->position;
+				shape.radius = col->actor->transform->scale.x + Global::simParams.collisionMargin;
+				shape.margin = Global::simParams.collisionMargin;
+				return (col->type == ColliderType::Plane) ?
+					VtParticleKernels::CollidePlane<TFeatures::friction>(predicted, origins, shape, Global::simParams.friction, deltaTime, begin, end) :
+					VtParticleKernels::CollideSphere<TFeatures::friction>(predicted, origins, shape, Global::simParams.friction, deltaTime, begin, end);
+			}
+
+			int numContacts = 0;
+			for (int i = begin; i < end; i++)
+			{
+				glm::vec3 pos = origins[i];
+				glm::vec3 pred = predicted[i];
+
+				glm::vec3 correction = col->ComputeSDF(pred);
+				pred += correction;
+
+				if (glm::dot(correction, correction) > 0)
+				{
+					numContacts++;
+					if constexpr (TFeatures::friction)
 					{
 						glm::vec3 relativeVelocity = pred - pos - col->VelocityAt(pred, deltaTime) * deltaTime;
-						auto friction = ComputeFriction(correction, relativeVelocity);
-						pred += friction;
+						pred += ComputeFriction(correction, relativeVelocity);
 					}
 				}
-				predicted[i] = pred;
+				predicted.Set(i, pred);
 			}
+			return numContacts;
 		}
 		/*
 		void CollideSDF(vector<glm::vec3>& positions, float deltaTime)
@@ -421,32 +878,9 @@ namespace Velvet
 		
 		void SolveAttachment()
 		{
-			for (const auto& c : m_attachmentConstriants)
-			{
-				 
-				int idx = get<0>(c);
-				glm::vec attachPos = get<1>(c);
-				m_predicted[idx] = attachPos;
-				 
-
-				/*glm::vec3 slotPos = attachPos;
-				float dist = glm::distance(m_positions[idx], slotPos);
-				float targetDist = dist * Global::simParams.longRangeStretchiness;
-
-				if (m_inverseMass[idx] == 0 && targetDist > 0) 
-					return;
-				
-				glm::vec3 pred = m_predicted[idx];
-				glm::vec3 diff = pred - slotPos;
-				dist = glm::length(diff);
-
-				if (dist > targetDist)
-				{
-					//float coefficient = max(targetDist, dist - 0.1*d_params.particleDiameter);// 0.05 * targetDist + 0.95 * dist;
-					glm::vec3 correction = -diff + diff / dist * targetDist;
-					m_predicted[idx] += correction; 
-				} */
-			}
+			SolveColored(m_attachmentConstriants, [&](int firstGroup, int endGroup) {
+				VtConstraintKernels::SolveAttachment(m_predicted, m_attachmentConstriants, firstGroup, endGroup);
+				});
 		}
 
 		void SolveSelfCollision()
@@ -463,8 +897,16 @@ namespace Velvet
 			}
 		}
 
+		// Pairs are resolved Gauss-Seidel style, moving both particles at once, so this phase stays on one thread
 		void CollideParticles()
 		{
+			WithFeatures([&](auto features) { CollideParticles(features); });
+		}
+
+		template <class TFeatures>
+		void CollideParticles(TFeatures)
+		{
+			contactStats.particleContacts = 0;
 			for (int i = 0; i < m_numVertices; i++)
 			{
 				int deltaCount = 0;
@@ -473,21 +915,19 @@ namespace Velvet
 				glm::vec3 vel_i = (pred_i - m_positions[i]);
 				float w_i = m_inverseMass[i];
 
-				const auto neighbors = m_spatialHash->GetNeighbors(i);
-
-				for (int j : neighbors)
-				{
-					if (i >= j) continue;
+				m_spatialHash->ForEachNeighbor(i, [&](int j) {
+					if (i >= j) return;
 					
 					float w_j = m_inverseMass[j];
 					float denom = w_i + w_j;
-					if (denom <= 0) continue;
+					if (denom <= 0) return;
 
 					glm::vec3 pred_j = m_predicted[j];
 					glm::vec3 diff = pred_i - pred_j;
 					float distance = glm::length(diff);
 					if (distance >= m_particleDiameter) 
-						continue;
+						return;
+					contactStats.particleContacts++;
 					glm::vec3 gradient = diff / (distance + k_epsilon);
 					float lambda = (m_particleDiameter - distance) / denom;
 					glm::vec3 common = lambda * gradient;
@@ -495,14 +935,16 @@ namespace Velvet
 					//deltaCount++;
 					//positionDelta -= w_i * common;
 
-					glm::vec3 relativeVelocity = vel_i - (pred_j - m_positions[j]);
-					glm::vec3 friction = ComputeFriction(common, relativeVelocity);
-					//positionDelta += w_i * friction;
-
-					m_predicted[i] += w_i * common;
-					m_predicted[j] -= w_j * common;
-					m_predicted[i] += w_i * friction;
-					m_predicted[j] -= w_j * friction;
+					m_predicted.Add(i, w_i * common);
+					m_predicted.Sub(j, w_j * common);
+					if constexpr (TFeatures::friction)
+					{
+						glm::vec3 relativeVelocity = vel_i - (pred_j - m_positions[j]);
+						glm::vec3 friction = ComputeFriction(common, relativeVelocity);
+						//positionDelta += w_i * friction;
+						m_predicted.Add(i, w_i * friction);
+						m_predicted.Sub(j, w_j * friction);
+					}
 
 					/*auto idx1 = i;
 					auto idx2 = j;
@@ -533,25 +975,314 @@ namespace Velvet
 
 						positionDelta += w1 * friction; 
 					}*/
-				}
+					});
 				//m_deltas[i] = positionDelta;
 				//m_deltaCounts[i] = deltaCount; 
 			}
 		}
 
+		// Same as the GPU solver's CollideParticles: every particle gathers the corrections against all of its
+		// neighbors into its own delta, to be applied by ApplyDeltas()
+		void CollideParticlesJacobi()
+		{
+			WithFeatures([&](auto features) { CollideParticlesJacobi(features); });
+		}
+
+		template <class TFeatures>
+		void CollideParticlesJacobi(TFeatures)
+		{
+			atomic<int> numContacts{ 0 };
+			ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+				int chunkContacts = 0;
+				for (int i = begin; i < end; i++)
+				{
+					int deltaCount = 0;
+					glm::vec3 positionDelta = glm::vec3(0);
+					glm::vec3 pred_i = m_predicted[i];
+					glm::vec3 vel_i = (pred_i - m_positions[i]);
+					float w_i = m_inverseMass[i];
+
+					m_spatialHash->ForEachNeighbor(i, [&](int j) {
+						float w_j = m_inverseMass[j];
+						float denom = w_i + w_j;
+						if (denom <= 0) return;
+
+						glm::vec3 pred_j = m_predicted[j];
+						glm::vec3 diff = pred_i - pred_j;
+						float distance = glm::length(diff);
+						if (distance >= m_particleDiameter) return;
+
+						// Both particles of a pair see the contact, count it once
+						if (i < j) chunkContacts++;
+						glm::vec3 gradient = diff / (distance + k_epsilon);
+						float lambda = (distance - m_particleDiameter) / denom;
+						glm::vec3 common = lambda * gradient;
+
+						deltaCount++;
+						positionDelta -= w_i * common;
+
+						if constexpr (TFeatures::friction)
+						{
+							glm::vec3 relativeVelocity = vel_i - (pred_j - m_positions[j]);
+							positionDelta += w_i * ComputeFriction(common, relativeVelocity);
+						}
+						});
+					m_deltas.Set(i, positionDelta);
+					m_deltaCounts[i] = deltaCount;
+				}
+				numContacts += chunkContacts;
+				});
+			contactStats.particleContacts = numContacts;
+		}
+
 		void Finalize(float deltaTime)
 		{
-			// apply force and update positions
-			for (int i = 0; i < m_numVertices; i++)
+			// apply force and update positions, velocities are damped
+			WithVelocities([&](auto& velocities) {
+				ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+					VtParticleKernels::Finalize(m_positions, velocities, m_predicted, deltaTime, Global::simParams.damping, begin, end);
+					});
+				});
+		}
+
+		// Finalize, then PredictPositions and, with collide, CollideSDF of the next substep, one chunk of particles at a time,
+		// so that each step finds the chunk in cache. Per particle the steps run in the same order as separately.
+		template <class TFeatures>
+		void FinalizeAndPredict(TFeatures features, float deltaTime, bool collide)
+		{
+			int numColliders = collide ? (int)m_colliders.size() : 0;
+			for (int c = 0; c < numColliders; c++) m_sdfContacts[c] = 0;
+			WithVelocities([&](auto& velocities) {
+				ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+					VtParticleKernels::Finalize(m_positions, velocities, m_predicted, deltaTime, Global::simParams.damping, begin, end);
+					VtParticleKernels::Predict(m_predicted, velocities, m_positions, Global::simParams.gravity, deltaTime, begin, end);
+					for (int c = 0; c < numColliders; c++)
+					{
+						m_sdfContacts[c] += CollideSDF(features, m_colliders[c], m_predicted, m_positions, deltaTime, begin, end);
+					}
+					});
+				});
+			for (int c = 0; c < numColliders; c++) contactStats.colliderContacts[c] = m_sdfContacts[c];
+		}
+
+		// Finalize of the last substep, which also copies the positions to m_meshPositions like CopyToMesh
+		void FinalizeToMesh(float deltaTime)
+		{
+			WithVelocities([&](auto& velocities) {
+				ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+					VtParticleKernels::Finalize(m_positions, velocities, m_predicted, deltaTime, Global::simParams.damping, begin, end);
+					for (int i = begin; i < end; i++) m_meshPositions[MeshIndex(i)] = m_positions[i];
+					});
+				});
+		}
+
+	private: // Utility functions
+
+		// Calls body(velocities) with whichever velocity stream compact() selects
+		template <class TBody>
+		void WithVelocities(const TBody& body)
+		{
+			if (m_compact)
 			{
-				//m_velocities[i] = (m_predicted[i] - m_positions[i]) / deltaTime;
-				// damp
-				m_velocities[i] = ((m_predicted[i] - m_positions[i]) / deltaTime) * (1 - Global::simParams.damping * deltaTime);
-				m_positions[i] = m_predicted[i];
+				body(m_halfVelocities);
+			}
+			else
+			{
+				body(m_velocities);
 			}
 		}
 
-	private: // Utility functions
+		// Derives m_compactStretch from the packed m_stretchConstraints, or leaves it empty if they do not fit
+		void BuildCompactStretch()
+		{
+			if (!m_compactStretch.Build(m_stretchConstraints) && !m_stretchConstraints.groups.empty())
+			{
+				fmt::print("Info(ClothSolverCPU): Stretch lane groups span more than 65535 particles, keeping 32-bit constraints\n");
+			}
+		}
+
+		// Calls body(features) with the VtSolverFeatures instance that matches Global::simParams
+		template <class TBody>
+		static void WithFeatures(const TBody& body)
+		{
+			const auto& p = Global::simParams;
+			WithFlag(p.enableSelfCollision, [&](auto selfCollision) {
+				WithFlag(p.friction > 0, [&](auto friction) {
+					WithFlag(p.enableBending && !p.jacobiCPU, [&](auto bending) {
+						body(VtSolverFeatures<decltype(selfCollision)::value, decltype(friction)::value, decltype(bending)::value>());
+						});
+					});
+				});
+		}
+
+		template <class TBody>
+		static void WithFlag(bool flag, const TBody& body)
+		{
+			if (flag) body(true_type());
+			else body(false_type());
+		}
+
+		// Global::simParams.gridStretch applies to grid meshes whose particles are in mesh order
+		bool gridStretch() const
+		{
+			return Global::simParams.gridStretch && m_stretchGrid.resolution > 0 && m_particleOf.empty();
+		}
+
+		// Global::simParams.cacheTileKB tiles the same grid sweep, so it has the same requirements. Jacobi iterations are never tiled.
+		bool tiledStretch() const
+		{
+			return Global::simParams.cacheTileKB > 0 && !Global::simParams.jacobiCPU && m_stretchGrid.resolution > 0 && m_particleOf.empty();
+		}
+
+		void ConfigurePool()
+		{
+			VtThreadPool::Shared().Configure(Global::simParams.numThreads, (VtThreadPool::Affinity)clamp(Global::simParams.threadAffinity, 0, 2));
+		}
+
+		// Global::simParams.numaFirstTouch: moves the per-particle, constraint, normal and hash arrays into memory that is first
+		// written by the pool threads, each part by the thread whose chunks sweep it (VtFirstTouch). With pinned workers
+		// (threadAffinity) the parts then stay on the NUMA node of their worker. Allocates.
+		void FirstTouch()
+		{
+			if (!parallel()) return;
+			auto perParticle = [&](const auto& body) { ParallelFor(m_numVertices, k_particleChunk, body); };
+			for (auto* stream : { &m_positions, &m_predicted, &m_velocities, &m_deltas, &m_collisionOrigins })
+			{
+				stream->FirstTouch(perParticle);
+			}
+			m_halfVelocities.FirstTouch(perParticle);
+			VtFirstTouch(m_deltaCounts, perParticle);
+			VtFirstTouch(m_inverseMass, perParticle);
+			VtFirstTouch(m_normals, perParticle);
+			VtFirstTouch(m_meshPositions, perParticle);
+			VtFirstTouch(m_triangleNormals, [&](const auto& body) { ParallelFor((int)m_triangleNormals.size(), k_particleChunk, body); });
+			// Start arrays hold one offset past the last particle
+			VtFirstTouch(m_vertexTriangleStart, [&](const auto& body) { ParallelFor((int)m_vertexTriangleStart.size(), k_particleChunk, body); });
+			VtFirstTouch(m_vertexTriangles, [&](const auto& body) {
+				perParticle([&](int begin, int end) { body(m_vertexTriangleStart[begin], m_vertexTriangleStart[end]); });
+				});
+			if (m_stretchGrid.resolution > 0)
+			{
+				// Rest lengths are indexed by the vertex a constraint starts from
+				for (auto& rest : m_stretchGrid.rest) VtFirstTouch(rest, perParticle);
+			}
+			FirstTouchConstraints(m_stretchConstraints);
+			FirstTouchConstraints(m_bendingConstraints);
+			if (!m_compactStretch.empty())
+			{
+				auto perGroup = [&](const auto& body) {
+					SolveColored(m_stretchConstraints, [&](int firstGroup, int endGroup) {
+						body(m_stretchConstraints.groups[firstGroup], m_stretchConstraints.groups[endGroup]);
+						});
+				};
+				VtFirstTouch(m_compactStretch.offsets, perGroup);
+				VtFirstTouch(m_compactStretch.rest, perGroup);
+			}
+			m_spatialHash->FirstTouch();
+		}
+
+		// Colored sweeps solve the constraints of one color in a ParallelFor over its groups, Jacobi sweeps gather them per particle
+		template <class TBuffer>
+		void FirstTouchConstraints(TBuffer& constraints)
+		{
+			if (!constraints.groups.empty())
+			{
+				auto perGroup = [&](const auto& body) {
+					SolveColored(constraints, [&](int firstGroup, int endGroup) { body(constraints.groups[firstGroup], constraints.groups[endGroup]); });
+				};
+				VtFirstTouch(constraints.indices, perGroup);
+				VtFirstTouch(constraints.rest, perGroup);
+			}
+			if (!constraints.incidenceStart.empty())
+			{
+				auto perParticle = [&](const auto& body) { ParallelFor(m_numVertices, k_particleChunk, body); };
+				VtFirstTouch(constraints.incidenceStart, [&](const auto& body) {
+					ParallelFor((int)constraints.incidenceStart.size(), k_particleChunk, body);
+					});
+				VtFirstTouch(constraints.incidence, [&](const auto& body) {
+					perParticle([&](int begin, int end) { body(constraints.incidenceStart[begin], constraints.incidenceStart[end]); });
+					});
+			}
+		}
+
+		// Cloths below Global::simParams.minParallelParticles do not pay for waking the workers
+		bool parallel() const
+		{
+			return m_numVertices >= Global::simParams.minParallelParticles;
+		}
+
+		// Deterministic mode (Global::simParams.deterministic) cuts every phase into fixed chunks of chunkSize items.
+		// Fast mode gives every thread one share of the range instead, so partitions depend on the thread count.
+		// Applying it to its own result gives the same chunk size again.
+		int ChunkSize(int count, int chunkSize) const
+		{
+			if (Global::simParams.deterministic) return chunkSize;
+			return max(VtThreadPool::Shared().ShareSize(count, k_simdWidth), chunkSize);
+		}
+
+		template <class TBody>
+		void ParallelFor(int count, int chunkSize, const TBody& body)
+		{
+			if (parallel())
+			{
+				VtThreadPool::Shared().ParallelFor(count, ChunkSize(count, chunkSize), body);
+			}
+			else
+			{
+				body(0, count);
+			}
+		}
+
+		struct Reduction
+		{
+			double squares = 0;
+			float max = 0;
+		};
+
+		// Sum of squares and maximum of error(i) over [0, count). Deterministic mode adds the partial sums of the
+		// fixed chunks in chunk order, so the result does not depend on the thread count or on which thread
+		// finishes first. Fast mode adds them as the chunks finish.
+		template <class TError>
+		Reduction Reduce(int count, const TError& error)
+		{
+			int chunkSize = ChunkSize(count, k_particleChunk);
+			int numChunks = (count + chunkSize - 1) / chunkSize;
+			if (m_partialReductions.size() < numChunks) m_partialReductions.resize(numChunks);
+
+			Reduction total;
+			mutex totalMutex;
+			ParallelFor(count, chunkSize, [&](int begin, int end) {
+				// Ranges run inline without workers span several chunks, which are still summed one by one
+				for (int chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize)
+				{
+					Reduction partial;
+					for (int i = chunkBegin; i < min(chunkBegin + chunkSize, end); i++)
+					{
+						float e = error(i);
+						partial.squares += e * e;
+						partial.max = max(partial.max, e);
+					}
+					if (Global::simParams.deterministic)
+					{
+						m_partialReductions[chunkBegin / chunkSize] = partial;
+						continue;
+					}
+					lock_guard<mutex> lock(totalMutex);
+					total.squares += partial.squares;
+					total.max = max(total.max, partial.max);
+				}
+				});
+
+			if (Global::simParams.deterministic)
+			{
+				for (int c = 0; c < numChunks; c++)
+				{
+					total.squares += m_partialReductions[c].squares;
+					total.max = max(total.max, m_partialReductions[c].max);
+				}
+			}
+			return total;
+		}
 
 		glm::vec3 ComputeFriction(glm::vec3 correction, glm::vec3 relativeVelocity) const
 		{
@@ -570,32 +1301,153 @@ namespace Velvet
 			return friction;
 		}
 
-		vector<glm::vec3> ComputeNormals(const vector<glm::vec3> positions)
+		// m_meshPositions[i] = m_positions[ParticleIndex(i)]
+		void CopyToMesh()
 		{
-			vector<glm::vec3> normals(positions.size());
-			for (int i = 0; i < m_indices.size(); i += 3)
+			if (m_particleOf.empty())
+			{
+				m_positions.CopyTo(m_meshPositions);
+				return;
+			}
+			ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+				for (int i = begin; i < end; i++) m_meshPositions[i] = m_positions[m_particleOf[i]];
+				});
+		}
+
+		// Particles sorted by the Morton code of their position on a 1024^3 grid over the bounding box, ties by index
+		vector<int> MortonOrder() const
+		{
+			glm::vec3 lower = glm::vec3(FLT_MAX), upper = glm::vec3(-FLT_MAX);
+			for (int i = 0; i < m_numVertices; i++)
+			{
+				lower = glm::min(lower, m_positions[i]);
+				upper = glm::max(upper, m_positions[i]);
+			}
+			glm::vec3 scale = 1023.0f / glm::max(upper - lower, glm::vec3(1e-6f));
+
+			// Spreads the low 10 bits of v to every third bit
+			auto spread = [](uint64_t v) {
+				v = (v | (v << 16)) & 0x030000FF;
+				v = (v | (v << 8)) & 0x0300F00F;
+				v = (v | (v << 4)) & 0x030C30C3;
+				v = (v | (v << 2)) & 0x09249249;
+				return v;
+			};
+			vector<uint64_t> keys(m_numVertices);
+			for (int i = 0; i < m_numVertices; i++)
 			{
-				auto idx1 = m_indices[i];
-				auto idx2 = m_indices[i + 1];
-				auto idx3 = m_indices[i + 2];
+				glm::uvec3 cell = glm::uvec3(glm::clamp((m_positions[i] - lower) * scale, glm::vec3(0), glm::vec3(1023)));
+				uint64_t code = spread(cell.x) | (spread(cell.y) << 1) | (spread(cell.z) << 2);
+				keys[i] = (code << 32) | (uint64_t)i;
+			}
+			sort(keys.begin(), keys.end());
+
+			vector<int> order(m_numVertices);
+			for (int i = 0; i < m_numVertices; i++) order[i] = (int)(keys[i] & 0xFFFFFFFF);
+			return order;
+		}
 
-				auto p1 = positions[idx1];
-				auto p2 = positions[idx2];
-				auto p3 = positions[idx3];
+		// Triangles incident to each vertex, in ascending order, for gathering normals
+		void BuildVertexTriangles()
+		{
+			m_vertexTriangleStart = VtAlignedVector<int>(m_numVertices + 1, 0);
+			for (auto idx : m_indices) m_vertexTriangleStart[idx + 1]++;
+			for (int i = 0; i < m_numVertices; i++) m_vertexTriangleStart[i + 1] += m_vertexTriangleStart[i];
 
-				auto normal = glm::cross(p2 - p1, p3 - p1);
-				normals[idx1] += normal;
-				normals[idx2] += normal;
-				normals[idx3] += normal;
+			m_vertexTriangles = VtAlignedVector<int>(m_indices.size());
+			vector<int> next(m_vertexTriangleStart.begin(), m_vertexTriangleStart.end() - 1);
+			for (int i = 0; i < m_indices.size(); i++)
+			{
+				m_vertexTriangles[next[m_indices[i]]++] = i / 3;
 			}
-			for (int i = 0; i < normals.size(); i++)
+		}
+
+		// Face normals first, then every vertex sums its triangles in index order. That is the order in which
+		// a serial scatter over the triangles adds them, so the result does not depend on the thread count.
+		void ComputeNormals(const VtAlignedVector<glm::vec3>& positions, VtAlignedVector<glm::vec3>& normals)
+		{
+			int numTriangles = (int)m_triangleNormals.size();
+			ParallelFor(numTriangles, k_particleChunk, [&](int begin, int end) {
+				for (int t = begin; t < end; t++)
+				{
+					auto p1 = positions[m_indices[3 * t]];
+					auto p2 = positions[m_indices[3 * t + 1]];
+					auto p3 = positions[m_indices[3 * t + 2]];
+					m_triangleNormals[t] = glm::cross(p2 - p1, p3 - p1);
+				}
+				});
+			ParallelFor(m_numVertices, k_particleChunk, [&](int begin, int end) {
+				for (int i = begin; i < end; i++)
+				{
+					glm::vec3 normal = glm::vec3(0);
+					for (int k = m_vertexTriangleStart[i]; k < m_vertexTriangleStart[i + 1]; k++)
+					{
+						normal += m_triangleNormals[m_vertexTriangles[k]];
+					}
+					normals[i] = glm::normalize(normal);
+				}
+				});
+		}
+
+		// Measures how far the predicted positions are from satisfying each constraint type
+		void RecordResiduals(int substep, int iteration, float deltaTime)
+		{
+			auto& sample = convergence.NextSample();
+			sample = VtResidualSample();
+			sample.substep = substep;
+			sample.iteration = iteration;
+
+			int numStretch = (int)m_stretchConstraints.size();
+			auto stretch = Reduce(numStretch, [&](int c) {
+				const auto& ids = m_stretchConstraints.indices[c];
+				return fabs(glm::length(m_predicted[ids.idx1] - m_predicted[ids.idx2]) - m_stretchConstraints.rest[c]);
+				});
+			sample.stretchRms = numStretch == 0 ? 0.0f : (float)sqrt(stretch.squares / numStretch);
+			sample.stretchMax = stretch.max;
+
+			int numBending = (int)m_bendingConstraints.size();
+			auto bending = Reduce(numBending, [&](int c) {
+				const auto& ids = m_bendingConstraints.indices[c];
+				auto p1 = m_predicted[ids.idx1];
+				auto p2 = m_predicted[ids.idx2] - p1;
+				glm::vec3 n1 = glm::normalize(glm::cross(p2, m_predicted[ids.idx3] - p1));
+				glm::vec3 n2 = glm::normalize(glm::cross(p2, m_predicted[ids.idx4] - p1));
+				float d = clamp(glm::dot(n1, n2), -1.0f, 1.0f);
+				return isnan(d) ? 0.0f : fabs(acos(d) - m_bendingConstraints.rest[c]);
+				});
+			sample.bendingRms = numBending == 0 ? 0.0f : (float)sqrt(bending.squares / numBending);
+			sample.bendingMax = bending.max;
+
+			int numAttachments = (int)m_attachmentConstriants.size();
+			auto attachment = Reduce(numAttachments, [&](int c) {
+				return glm::length(m_predicted[m_attachmentConstriants.indices[c]] - m_attachmentConstriants.rest[c]);
+				});
+			sample.attachmentRms = numAttachments == 0 ? 0.0f : (float)sqrt(attachment.squares / numAttachments);
+			sample.attachmentMax = attachment.max;
+
+			float* penetrations = convergence.PenetrationsOf(sample);
+			for (int c = 0; c < m_colliders.size(); c++)
 			{
-				normals[i] = glm::normalize(normals[i]);
+				float depth = 0;
+				if (m_colliders[c]->enabled)
+				{
+					depth = Reduce(m_numVertices, [&](int i) {
+						return max(glm::length(m_colliders[c]->ComputeSDF(m_predicted[i])) - Global::simParams.collisionMargin, 0.0f);
+						}).max;
+				}
+				penetrations[c] = depth;
+				sample.maxPenetration = max(sample.maxPenetration, depth);
 			}
-			return normals;
+
+			auto speed = Reduce(m_numVertices, [&](int i) {
+				return glm::length((m_predicted[i] - m_positions[i]) / deltaTime);
+				});
+			sample.kineticEnergy = (float)(0.5 * speed.squares);
+
+			sample.maxViolation = max({ sample.stretchMax, sample.attachmentMax, sample.maxPenetration });
 		}
 
-		inline bool CheckNAN(const vector<glm::vec3> positions)
+		inline bool CheckNAN(const VtVec3Stream& positions)
 		{
 			for (int i = 0; i < positions.size(); i++)
 			{
@@ -611,17 +1463,40 @@ namespace Velvet
 	private:
 
 		const float k_epsilon = 1e-6f;
+		// Arena reservation at Initialize. Address space only: pages are committed as buffers reach them.
+		static constexpr size_t k_arenaBaseBytes = size_t(4) << 20;
+		static constexpr size_t k_arenaBytesPerParticle = 1024;
+		// Work items per ParallelFor chunk. Particle chunks are a multiple of the SIMD width, so kernels stay aligned.
+		static constexpr int k_particleChunk = 1024;
+		static constexpr int k_simdWidth = 16;
+		static constexpr int k_groupChunk = 16;
+		static constexpr int k_minBandRowsPerIteration = 4;
 
 		int m_numVertices;
 		int m_resolution;
 		float m_particleDiameter;
 
-		vector<unsigned int> m_indices;
+		VtAlignedVector<unsigned int> m_indices;	// triangles in mesh order, see ParticleIndex()
+		vector<int> m_particleOf;				// empty until ReorderParticles()
+		vector<int> m_meshIndexOf;
+		int m_framesSinceReorder = 0;
+		bool m_colored = false;					// Global::simParams.coloredConstraints at Initialize()
+		bool m_compact = false;					// Global::simParams.compactState at Initialize()
+		VtHalfStream m_halfVelocities;			// instead of m_velocities with m_compact
 		vector<Collider*> m_colliders;
 		vector<int> m_attachedIndices;
+		VtAlignedVector<glm::vec3> m_normals;
+		VtAlignedVector<Reduction> m_partialReductions;	// one per chunk of the latest Reduce()
+		VtAlignedVector<glm::vec3> m_triangleNormals;	// unnormalized, one per triangle
+		VtAlignedVector<int> m_vertexTriangleStart;		// triangles of vertex i are m_vertexTriangles[start[i], start[i + 1])
+		VtAlignedVector<int> m_vertexTriangles;
+		VtAlignedVector<glm::vec3> m_meshPositions;		// interleaved copy of m_positions for normals and mesh upload
+		VtVec3Stream m_collisionOrigins;		// scratch for CollideSDF on m_positions itself
+		vector<atomic<int>> m_sdfContacts;		// per collider, summed over the chunks of FinalizeAndPredict()
 		//vector<glm::vec3> m_attachSlotPositions;
 
 		shared_ptr<Mesh> m_mesh;
 		shared_ptr<SpatialHashCPU> m_spatialHash;
+		VtArenaHandle m_arena;					// null with solverArena off; buffers stay valid after it is released
 	};
 }
\ No newline at end of file
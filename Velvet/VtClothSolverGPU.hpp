@@ -204,6 +204,12 @@ namespace Velvet
 			}
 		}
 
+		// nullptr until the first cloth is added
+		shared_ptr<SpatialHashGPU> spatialHash() const
+		{
+			return m_spatialHash;
+		}
+
 	public: // Sim buffers
 
 		VtMergedBuffer<glm::vec3> positions;
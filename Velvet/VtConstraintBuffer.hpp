@@ -0,0 +1,422 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "VtParticleStore.hpp"
+
+namespace Velvet
+{
+	using namespace std;
+
+	struct VtStretchIndices
+	{
+		int idx1, idx2;
+	};
+
+	// tri(idx1, idx3, idx2) and tri(idx1, idx2, idx4) share the edge idx1-idx2
+	struct VtBendingIndices
+	{
+		int idx1, idx2, idx3, idx4;
+	};
+
+	// Constraints of one kind, stored as two aligned arrays: the particle indices of every constraint,
+	// packed together because a sweep always reads them together, and the rest parameter
+	// (distance, angle or target position). Sweeps index both arrays with the same constraint index.
+	//
+	// PackLanes() reorders the constraints into lane groups for the vectorized sweeps (VtConstraintKernels).
+	// BuildIncidence() lists the constraints of every particle for the gather-based Jacobi sweeps.
+	template <class TIndices, class TRest>
+	class VtConstraintBuffer
+	{
+	public:
+		// AVX-512 width. AVX2 kernels process a group as two halves, which are conflict-free as well.
+		static constexpr int k_laneWidth = 16;
+		static constexpr int k_numParticles = sizeof(TIndices) / sizeof(int);
+
+		VtAlignedVector<TIndices> indices;
+		VtAlignedVector<TRest> rest;
+
+		// Constraint ranges [groups[g], groups[g + 1]), empty until PackLanes()
+		vector<int> groups;
+		// Group ranges [colorGroups[c], colorGroups[c + 1]) of one color each. Groups of the same color share no particle,
+		// so they can be solved in parallel. Groups from firstSerialGroup on conflict with each other and run in order.
+		vector<int> colorGroups;
+		int firstSerialGroup = 0;
+		// Position of each constraint after packing or sorting, by the order of Add()
+		vector<int> packedSlot;
+		// Constraints of particle i are incidence[incidenceStart[i], incidenceStart[i + 1]), in ascending order and
+		// encoded as constraint * k_numParticles + k, where k is the particle's position within the constraint.
+		// Empty until BuildIncidence().
+		VtAlignedVector<int> incidenceStart;
+		VtAlignedVector<int> incidence;
+
+		size_t size() const
+		{
+			return indices.size();
+		}
+
+		bool empty() const
+		{
+			return indices.empty();
+		}
+
+		void reserve(size_t n)
+		{
+			indices.reserve(n);
+			rest.reserve(n);
+		}
+
+		void clear()
+		{
+			indices.clear();
+			rest.clear();
+			groups.clear();
+			colorGroups.clear();
+			firstSerialGroup = 0;
+			packedSlot.clear();
+			incidenceStart.clear();
+			incidence.clear();
+		}
+
+		size_t numGroups() const
+		{
+			return groups.empty() ? 0 : groups.size() - 1;
+		}
+
+		size_t numColors() const
+		{
+			return colorGroups.empty() ? 0 : colorGroups.size() - 1;
+		}
+
+		// Where the constraint that was added as the index-th one is stored now
+		size_t Slot(size_t index) const
+		{
+			return packedSlot.empty() ? index : packedSlot[index];
+		}
+
+		// Reorders the constraints so that no particle appears twice within a lane group of up to k_laneWidth constraints.
+		// Greedy coloring in the order of Add(): a constraint gets the first color none of its particles has yet.
+		// Constraints are then sorted by color (stable) and each color is cut into groups. Constraints that find no
+		// free color, or that name a particle twice, form groups of one. Sweeps over the packed order are still
+		// Gauss-Seidel, only in a different order than generation.
+		void PackLanes(int numParticles)
+		{
+			static_assert(sizeof(TIndices) == k_numParticles * sizeof(int), "constraint indices must be plain ints");
+			constexpr int k_maxColors = 64;
+			constexpr int k_serial = k_maxColors;
+
+			vector<uint64_t> usedColors(numParticles, 0);
+			vector<int> colors(size());
+			vector<int> colorOffsets(k_maxColors + 2, 0);
+			for (size_t c = 0; c < size(); c++)
+			{
+				int particles[k_numParticles];
+				memcpy(particles, &indices[c], sizeof(TIndices));
+
+				uint64_t used = 0;
+				bool repeated = false;
+				for (int i = 0; i < k_numParticles; i++)
+				{
+					used |= usedColors[particles[i]];
+					for (int j = 0; j < i; j++) repeated |= particles[i] == particles[j];
+				}
+
+				int color = 0;
+				while (color < k_maxColors && (used >> color) & 1) color++;
+				if (repeated) color = k_serial;
+				if (color != k_serial)
+				{
+					for (int i = 0; i < k_numParticles; i++) usedColors[particles[i]] |= uint64_t(1) << color;
+				}
+				colors[c] = color;
+				colorOffsets[color + 1]++;
+			}
+			for (int color = 0; color <= k_maxColors; color++) colorOffsets[color + 1] += colorOffsets[color];
+
+			vector<int> slots(size());
+			vector<int> next(colorOffsets.begin(), colorOffsets.end() - 1);
+			for (size_t c = 0; c < size(); c++)
+			{
+				slots[c] = next[colors[c]]++;
+			}
+			Reorder(slots);
+
+			groups.clear();
+			colorGroups.clear();
+			for (int color = 0; color <= k_maxColors; color++)
+			{
+				if (color == k_serial)
+				{
+					firstSerialGroup = (int)groups.size();
+				}
+				else if (colorOffsets[color] < colorOffsets[color + 1])
+				{
+					colorGroups.push_back((int)groups.size());
+				}
+
+				int width = color == k_serial ? 1 : k_laneWidth;
+				for (int begin = colorOffsets[color]; begin < colorOffsets[color + 1]; begin += width)
+				{
+					groups.push_back(begin);
+				}
+			}
+			colorGroups.push_back(firstSerialGroup);
+			groups.push_back((int)size());
+		}
+
+		// Renames particle p to newIndex[p] in every constraint, e.g. after the solver reordered its particles
+		void RemapParticles(const vector<int>& newIndex)
+		{
+			int* particles = reinterpret_cast<int*>(indices.data());
+			for (size_t e = 0; e < size() * k_numParticles; e++) particles[e] = newIndex[particles[e]];
+		}
+
+		// Stable sort by the first particle of each constraint, so that sweeps walk the particles in memory order.
+		// Groups and incidence lists are invalid afterwards, until PackLanes() and BuildIncidence().
+		void SortByFirstParticle()
+		{
+			vector<pair<int, int>> keys(size());
+			for (size_t c = 0; c < size(); c++)
+			{
+				keys[c] = { *reinterpret_cast<const int*>(&indices[c]), (int)c };
+			}
+			sort(keys.begin(), keys.end());
+
+			vector<int> slots(size());
+			for (size_t slot = 0; slot < size(); slot++) slots[keys[slot].second] = (int)slot;
+			Reorder(slots);
+			groups.clear();
+			colorGroups.clear();
+			firstSerialGroup = 0;
+			incidenceStart.clear();
+			incidence.clear();
+		}
+
+		// Has to be called again after PackLanes(), which moves the constraints
+		void BuildIncidence(int numParticles)
+		{
+			incidenceStart.assign(numParticles + 1, 0);
+			const int* particles = reinterpret_cast<const int*>(indices.data());
+			int numEntries = (int)size() * k_numParticles;
+			for (int e = 0; e < numEntries; e++) incidenceStart[particles[e] + 1]++;
+			for (int i = 0; i < numParticles; i++) incidenceStart[i + 1] += incidenceStart[i];
+
+			incidence.resize(numEntries);
+			vector<int> next(incidenceStart.begin(), incidenceStart.end() - 1);
+			for (int e = 0; e < numEntries; e++) incidence[next[particles[e]]++] = e;
+		}
+
+		void Add(const TIndices& constraintIndices, const TRest& restValue)
+		{
+			indices.push_back(constraintIndices);
+			rest.push_back(restValue);
+		}
+
+		// Moves constraint c to slots[c]. Slot() keeps pointing at the order of Add() across any number of moves.
+		void Reorder(const vector<int>& slots)
+		{
+			VtAlignedVector<TIndices> movedIndices(size());
+			VtAlignedVector<TRest> movedRest(size());
+			for (size_t c = 0; c < size(); c++)
+			{
+				movedIndices[slots[c]] = indices[c];
+				movedRest[slots[c]] = rest[c];
+			}
+			if (!packedSlot.empty())
+			{
+				for (auto& slot : packedSlot) slot = slots[slot];
+			}
+			else
+			{
+				packedSlot = slots;
+			}
+			indices = move(movedIndices);
+			rest = move(movedRest);
+		}
+
+		size_t capacityBytes() const
+		{
+			return indices.capacity() * sizeof(TIndices) + rest.capacity() * sizeof(TRest) +
+				(groups.capacity() + colorGroups.capacity() + packedSlot.capacity() + incidenceStart.capacity() + incidence.capacity()) * sizeof(int);
+		}
+	};
+
+	using VtStretchConstraints = VtConstraintBuffer<VtStretchIndices, float>;		// rest distance
+	using VtBendingConstraints = VtConstraintBuffer<VtBendingIndices, float>;		// rest angle
+	using VtAttachmentConstraints = VtConstraintBuffer<int, glm::vec3>;				// attachment position
+
+	// Compact copy of lane-packed stretch constraints (VtSimParams::compactState) for the colored sweeps: each lane group
+	// keeps the smallest particle index of its constraints as a base, each constraint its endpoints as 16-bit offsets
+	// from that base and its rest distance in fp16. That is 6 bytes per constraint instead of 12. The full-precision
+	// buffer stays the reference for recoloring, Jacobi sweeps and residuals.
+	struct VtCompactStretch
+	{
+		struct Offsets
+		{
+			uint16_t first, second;
+		};
+
+		VtAlignedVector<int> base;			// per lane group
+		VtAlignedVector<Offsets> offsets;	// per constraint
+		VtAlignedVector<uint16_t> rest;		// per constraint, fp16
+
+		bool empty() const
+		{
+			return offsets.empty();
+		}
+
+		void clear()
+		{
+			base.clear();
+			offsets.clear();
+			rest.clear();
+		}
+
+		// Fails, and stays empty, unless constraints are packed and every group spans at most 65536 particles
+		bool Build(const VtStretchConstraints& constraints)
+		{
+			clear();
+			if (constraints.groups.empty()) return false;
+
+			base.resize(constraints.numGroups());
+			offsets.resize(constraints.size());
+			rest.resize(constraints.size());
+			for (size_t g = 0; g < constraints.numGroups(); g++)
+			{
+				int first = constraints.groups[g], end = constraints.groups[g + 1];
+				if (first == end)
+				{
+					base[g] = 0;
+					continue;
+				}
+				int low = INT_MAX, high = INT_MIN;
+				for (int c = first; c < end; c++)
+				{
+					low = min(low, min(constraints.indices[c].idx1, constraints.indices[c].idx2));
+					high = max(high, max(constraints.indices[c].idx1, constraints.indices[c].idx2));
+				}
+				if (high - low > UINT16_MAX)
+				{
+					clear();
+					return false;
+				}
+				base[g] = low;
+				for (int c = first; c < end; c++)
+				{
+					offsets[c] = { (uint16_t)(constraints.indices[c].idx1 - low), (uint16_t)(constraints.indices[c].idx2 - low) };
+					rest[c] = VtHalf::Pack(constraints.rest[c]);
+				}
+			}
+			return true;
+		}
+
+		size_t capacityBytes() const
+		{
+			return base.capacity() * sizeof(int) + offsets.capacity() * sizeof(Offsets) + rest.capacity() * sizeof(uint16_t);
+		}
+	};
+
+	// Stretch constraints of a (resolution + 1)^2 vertex grid, as generated by VtClothSolverCPU::GenerateStretch, without
+	// particle indices: vertex (x, y) is particle x * stride + y, and the endpoints of a constraint follow from its direction.
+	// Rest distances are kept in one planar array per direction, indexed by the vertex the constraint starts from.
+	//
+	// A sweep runs in passes of conflict-free lines. Horizontal constraints form one line per row and alternate between
+	// even and odd y; the other directions connect row x to row x + 1 and alternate between even and odd x. Along a line,
+	// positions, masses and rest distances are all read contiguously.
+	struct VtStretchGrid
+	{
+		enum Direction
+		{
+			Horizontal,		// (x, y) - (x, y + 1)
+			Vertical,		// (x, y) - (x + 1, y)
+			Diagonal,		// (x, y) - (x + 1, y + 1)
+			AntiDiagonal,	// (x, y + 1) - (x + 1, y)
+			NumDirections
+		};
+
+		// Constraint j of a line connects particles first + j and second + j. With parity >= 0 only constraints with
+		// j % 2 == parity belong to the line; the others belong to the other pass.
+		struct Line
+		{
+			int first, second;
+			int count;
+			int parity;
+			const float* rest;
+		};
+
+		int resolution = 0;		// quads per side, 0 until Build()
+		int stride = 0;
+		VtAlignedVector<float> rest[NumDirections];
+
+		void Build(int resolution, const VtVec3Stream& positions)
+		{
+			this->resolution = resolution;
+			stride = resolution + 1;
+			for (int d = 0; d < NumDirections; d++)
+			{
+				rest[d] = VtAlignedVector<float>((size_t)stride * stride, 0.0f);
+				for (int parity = 0; parity < 2; parity++)
+				{
+					for (int i = 0; i < NumLines(d, parity); i++)
+					{
+						Line line = GetLine(d, parity, i);
+						float* lineRest = rest[d].data() + (line.rest - rest[d].data());
+						for (int j = 0; j < line.count; j++)
+						{
+							if (line.parity >= 0 && j % 2 != line.parity) continue;
+							lineRest[j] = glm::length(positions[line.first + j] - positions[line.second + j]);
+						}
+					}
+				}
+			}
+		}
+
+		int NumLines(int direction, int parity) const
+		{
+			return direction == Horizontal ? stride : (resolution - parity + 1) / 2;
+		}
+
+		// Line i of the pass (direction, parity)
+		Line GetLine(int direction, int parity, int i) const
+		{
+			if (direction == Horizontal)
+			{
+				return { i * stride, i * stride + 1, resolution, parity, rest[Horizontal].data() + i * stride };
+			}
+			int x = 2 * i + parity;
+			const float* lineRest = rest[direction].data() + x * stride;
+			switch (direction)
+			{
+			case Vertical: return { x * stride, (x + 1) * stride, stride, -1, lineRest };
+			case Diagonal: return { x * stride, (x + 1) * stride + 1, resolution, -1, lineRest };
+			default: return { x * stride + 1, (x + 1) * stride, resolution, -1, lineRest };
+			}
+		}
+
+		// Lines [begin, end) of the pass (direction, parity) that only connect rows within [firstRow, endRow)
+		void RowLines(int direction, int parity, int firstRow, int endRow, int& begin, int& end) const
+		{
+			if (direction == Horizontal)
+			{
+				begin = firstRow;
+				end = endRow;
+				return;
+			}
+			begin = (firstRow - parity + 1) / 2;
+			end = max((endRow - parity) / 2, begin);
+		}
+
+		size_t capacityBytes() const
+		{
+			size_t bytes = 0;
+			for (const auto& r : rest) bytes += r.capacity() * sizeof(float);
+			return bytes;
+		}
+	};
+}
@@ -0,0 +1,870 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "VtSimd.hpp"
+#include "VtParticleStore.hpp"
+#include "VtConstraintBuffer.hpp"
+
+namespace Velvet
+{
+	// Constraint sweeps of VtClothSolverCPU over lane groups (see VtConstraintBuffer::PackLanes).
+	// No particle appears twice within a group, so a full group is gathered, solved and scattered at once:
+	// one AVX-512 vector or two AVX2 vectors per group, with the same result as solving its constraints one
+	// after another. Groups run in order; groups with fewer than k_laneWidth constraints run scalar.
+	// As in VtParticleKernels, all variants perform the same float operations in the same order (no FMA,
+	// no reciprocal approximations), so results do not depend on the active level.
+	class VtConstraintKernels
+	{
+	public:
+		static constexpr float k_epsilon = 1e-6f;
+
+		// acos for x in [0, 1]: sqrt(1 - x) * polynomial, absolute error about 2.3e-7 in float (Abramowitz & Stegun 4.4.45).
+		// Used instead of std::acos so that the vectorized bending sweeps can evaluate the same expression.
+		static float Acos(float x)
+		{
+			float p = k_acos[7];
+			for (int i = 6; i >= 0; i--) p = p * x + k_acos[i];
+			return sqrt(1.0f - x) * p;
+		}
+
+		// Gauss-Seidel distance constraints: moves both particles, and accumulates the correction in deltas.
+		// Solves the lane groups [firstGroup, endGroup), or every constraint if endGroup is -1.
+		static void SolveStretch(VtVec3Stream& predicted, VtVec3Stream& deltas, int* deltaCounts, const float* inverseMass,
+			const VtStretchConstraints& constraints, int firstGroup = 0, int endGroup = -1)
+		{
+			StretchArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), deltas.x.data(), deltas.y.data(), deltas.z.data(),
+				deltaCounts, inverseMass, constraints.indices.data(), constraints.rest.data() };
+			ForEachGroup(constraints, firstGroup, endGroup, a, StretchScalar
+#ifdef VT_SIMD_X86
+				, StretchAvx2, StretchAvx512
+#endif
+			);
+		}
+
+		// SolveStretch over the compact copy of the same constraints. Only the rest distances differ (fp16); the
+		// corrections are computed in float as in SolveStretch. The AVX2 variant needs F16C and runs scalar without it.
+		static void SolveStretchCompact(VtVec3Stream& predicted, VtVec3Stream& deltas, int* deltaCounts, const float* inverseMass,
+			const VtStretchConstraints& constraints, const VtCompactStretch& compact, int firstGroup = 0, int endGroup = -1)
+		{
+			StretchArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), deltas.x.data(), deltas.y.data(), deltas.z.data(),
+				deltaCounts, inverseMass, nullptr, nullptr };
+			auto level = VtSimd::Active();
+			if (level == VtSimdLevel::AVX2 && !VtSimd::HalfConversions()) level = VtSimdLevel::Scalar;
+			if (endGroup < 0) endGroup = (int)constraints.numGroups();
+			for (int g = firstGroup; g < endGroup; g++)
+			{
+				int begin = constraints.groups[g], end = constraints.groups[g + 1];
+				int base = compact.base[g];
+				if (end - begin != VtStretchConstraints::k_laneWidth || level == VtSimdLevel::Scalar)
+				{
+					for (int c = begin; c < end; c++)
+					{
+						StretchPair(a, base + compact.offsets[c].first, base + compact.offsets[c].second, VtHalf::Unpack(compact.rest[c]));
+					}
+					continue;
+				}
+#ifdef VT_SIMD_X86
+				if (level == VtSimdLevel::AVX512)
+				{
+					StretchCompactAvx512(a, compact, base, begin);
+				}
+				else
+				{
+					StretchCompactAvx2(a, compact, base, begin);
+					StretchCompactAvx2(a, compact, base, begin + 8);
+				}
+#endif
+			}
+		}
+
+		// The stretch constraints of the lines [beginLine, endLine) of one grid pass (see VtStretchGrid), with the same
+		// corrections as SolveStretch. Lines only read and write contiguous particle ranges, and no index is loaded.
+		static void SolveStretchGrid(VtVec3Stream& predicted, VtVec3Stream& deltas, int* deltaCounts, const float* inverseMass,
+			const VtStretchGrid& grid, int direction, int parity, int beginLine, int endLine)
+		{
+			StretchArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), deltas.x.data(), deltas.y.data(), deltas.z.data(),
+				deltaCounts, inverseMass, nullptr, nullptr };
+			auto level = VtSimd::Active();
+			for (int i = beginLine; i < endLine; i++)
+			{
+				VtStretchGrid::Line line = grid.GetLine(direction, parity, i);
+				int begin = 0;
+				switch (level)
+				{
+#ifdef VT_SIMD_X86
+				case VtSimdLevel::AVX512: begin = StretchLineAvx512(a, line); break;
+				case VtSimdLevel::AVX2: begin = StretchLineAvx2(a, line); break;
+#endif
+				default: break;
+				}
+				StretchLineScalar(a, line, begin);
+			}
+		}
+
+		// Dihedral angle constraints between tri(idx1, idx3, idx2) and tri(idx1, idx2, idx4), accumulated in deltas
+		static void SolveBending(const VtVec3Stream& predicted, VtVec3Stream& deltas, int* deltaCounts, const float* inverseMass,
+			const VtBendingConstraints& constraints, float compliance, int firstGroup = 0, int endGroup = -1)
+		{
+			BendingArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), deltas.x.data(), deltas.y.data(), deltas.z.data(),
+				deltaCounts, inverseMass, constraints.indices.data(), constraints.rest.data(), compliance };
+			ForEachGroup(constraints, firstGroup, endGroup, a, BendingScalar
+#ifdef VT_SIMD_X86
+				, BendingAvx2, BendingAvx512
+#endif
+			);
+		}
+
+		// Moves attached particles onto their attachment position. AVX2 has no scatter, so it uses the scalar loop.
+		static void SolveAttachment(VtVec3Stream& predicted, const VtAttachmentConstraints& constraints, int firstGroup = 0, int endGroup = -1)
+		{
+			AttachmentArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), constraints.indices.data(), constraints.rest.data() };
+			ForEachGroup(constraints, firstGroup, endGroup, a, AttachmentScalar
+#ifdef VT_SIMD_X86
+				, AttachmentScalarGroup, AttachmentAvx512
+#endif
+			);
+		}
+
+		// Jacobi distance constraints over the particles [begin, end), see VtConstraintBuffer::BuildIncidence.
+		// Every particle sums the corrections of its own constraints, computed from predicted positions that are
+		// not modified during the sweep, and writes only its own delta and count. The corrections are those of the
+		// GPU solver's SolveStretch; VtParticleKernels::ApplyDeltas applies them.
+		static void GatherStretch(const VtVec3Stream& predicted, VtVec3Stream& deltas, int* deltaCounts, const float* inverseMass,
+			const VtStretchConstraints& constraints, int begin, int end)
+		{
+			constexpr int k_numParticles = VtStretchConstraints::k_numParticles;
+			for (int i = begin; i < end; i++)
+			{
+				glm::vec3 delta = glm::vec3(0);
+				int count = 0;
+				for (int k = constraints.incidenceStart[i]; k < constraints.incidenceStart[i + 1]; k++)
+				{
+					int c = constraints.incidence[k] / k_numParticles;
+					bool first = constraints.incidence[k] % k_numParticles == 0;
+					int idx1 = constraints.indices[c].idx1;
+					int idx2 = constraints.indices[c].idx2;
+					float expectedDistance = constraints.rest[c];
+
+					glm::vec3 diff = predicted[idx1] - predicted[idx2];
+					float distance = glm::length(diff);
+					float w1 = inverseMass[idx1];
+					float w2 = inverseMass[idx2];
+					float denom = w1 + w2;
+
+					if (distance != expectedDistance && denom > 0)
+					{
+						glm::vec3 gradient = diff / (distance + k_epsilon);
+						float lambda = (distance - expectedDistance) / denom;
+						glm::vec3 common = lambda * gradient;
+						delta += first ? -w1 * common : w2 * common;
+						count++;
+					}
+				}
+				deltas.Set(i, delta);
+				deltaCounts[i] = count;
+			}
+		}
+
+	private:
+		static constexpr float k_acos[8] = { 1.5707963050f, -0.2145988016f, 0.0889789874f, -0.0501743046f,
+			0.0308918810f, -0.0170881256f, 0.0066700901f, -0.0012624911f };
+
+		struct StretchArgs
+		{
+			float* qx, * qy, * qz;
+			float* dx, * dy, * dz;
+			int* counts;
+			const float* invMass;
+			const VtStretchIndices* indices;
+			const float* rest;
+		};
+
+		struct BendingArgs
+		{
+			const float* qx, * qy, * qz;
+			float* dx, * dy, * dz;
+			int* counts;
+			const float* invMass;
+			const VtBendingIndices* indices;
+			const float* rest;
+			float compliance;
+		};
+
+		struct AttachmentArgs
+		{
+			float* qx, * qy, * qz;
+			const int* indices;
+			const glm::vec3* rest;
+		};
+
+		// scalar(a, begin, end) solves any range; avx2(a, begin) solves 8 constraints and avx512(a, begin) 16
+		template <class TBuffer, class TArgs, class TScalar
+#ifdef VT_SIMD_X86
+			, class TAvx2, class TAvx512
+#endif
+		>
+		static void ForEachGroup(const TBuffer& constraints, int firstGroup, int endGroup, const TArgs& a, TScalar scalar
+#ifdef VT_SIMD_X86
+			, TAvx2 avx2, TAvx512 avx512
+#endif
+		)
+		{
+			// Unpacked buffers keep the order of generation and run scalar
+			if (constraints.groups.empty())
+			{
+				scalar(a, 0, (int)constraints.size());
+				return;
+			}
+
+			auto level = VtSimd::Active();
+			const auto& groups = constraints.groups;
+			if (endGroup < 0) endGroup = (int)constraints.numGroups();
+			for (int g = firstGroup; g < endGroup; g++)
+			{
+				int begin = groups[g], end = groups[g + 1];
+				if (end - begin != TBuffer::k_laneWidth || level == VtSimdLevel::Scalar)
+				{
+					scalar(a, begin, end);
+					continue;
+				}
+#ifdef VT_SIMD_X86
+				if (level == VtSimdLevel::AVX512)
+				{
+					avx512(a, begin);
+				}
+				else
+				{
+					avx2(a, begin);
+					avx2(a, begin + 8);
+				}
+#endif
+			}
+		}
+
+	private: // Scalar
+
+		static void StretchScalar(const StretchArgs& a, int begin, int end)
+		{
+			for (int c = begin; c < end; c++)
+			{
+				StretchPair(a, a.indices[c].idx1, a.indices[c].idx2, a.rest[c]);
+			}
+		}
+
+		// Constraints [begin, line.count) of a grid line
+		static void StretchLineScalar(const StretchArgs& a, const VtStretchGrid::Line& line, int begin)
+		{
+			for (int j = begin; j < line.count; j++)
+			{
+				if (line.parity >= 0 && j % 2 != line.parity) continue;
+				StretchPair(a, line.first + j, line.second + j, line.rest[j]);
+			}
+		}
+
+		static void StretchPair(const StretchArgs& a, int idx1, int idx2, float expectedDistance)
+		{
+			glm::vec3 diff = glm::vec3(a.qx[idx1], a.qy[idx1], a.qz[idx1]) - glm::vec3(a.qx[idx2], a.qy[idx2], a.qz[idx2]);
+			float distance = glm::length(diff);
+			float w1 = a.invMass[idx1];
+			float w2 = a.invMass[idx2];
+			float denom = w1 + w2;
+
+			// We use unilateral constraints instead of bilateral constraints
+			// Otherwise the cloth may not look well after collision
+			if (distance != expectedDistance && denom > 0)
+			{
+				glm::vec3 gradient = diff / (distance + k_epsilon);
+				// compliance is zero, therefore XPBD=PBD
+				float lambda = (distance - expectedDistance) / denom;
+				glm::vec3 common = lambda * gradient;
+				a.qx[idx1] -= w1 * common.x;
+				a.qy[idx1] -= w1 * common.y;
+				a.qz[idx1] -= w1 * common.z;
+				a.qx[idx2] += w2 * common.x;
+				a.qy[idx2] += w2 * common.y;
+				a.qz[idx2] += w2 * common.z;
+
+				a.dx[idx1] += common.x;
+				a.dy[idx1] += common.y;
+				a.dz[idx1] += common.z;
+				a.dx[idx2] += common.x;
+				a.dy[idx2] += common.y;
+				a.dz[idx2] += common.z;
+				a.counts[idx1]++;
+				a.counts[idx2]++;
+			}
+		}
+
+		static void BendingScalar(const BendingArgs& a, int begin, int end)
+		{
+			for (int c = begin; c < end; c++)
+			{
+				const int idx[4] = { a.indices[c].idx1, a.indices[c].idx2, a.indices[c].idx3, a.indices[c].idx4 };
+				float expectedAngle = a.rest[c];
+
+				float w[4];
+				for (int k = 0; k < 4; k++) w[k] = a.invMass[idx[k]];
+
+				glm::vec3 p1 = glm::vec3(a.qx[idx[0]], a.qy[idx[0]], a.qz[idx[0]]);
+				glm::vec3 p2 = glm::vec3(a.qx[idx[1]], a.qy[idx[1]], a.qz[idx[1]]) - p1;
+				glm::vec3 p3 = glm::vec3(a.qx[idx[2]], a.qy[idx[2]], a.qz[idx[2]]) - p1;
+				glm::vec3 p4 = glm::vec3(a.qx[idx[3]], a.qy[idx[3]], a.qz[idx[3]]) - p1;
+
+				glm::vec3 n1 = glm::normalize(glm::cross(p2, p3));
+				glm::vec3 n2 = glm::normalize(glm::cross(p2, p4));
+
+				float d = clamp(glm::dot(n1, n2), 0.0f, 1.0f);
+				float angle = Acos(d);
+				// cross product for two equal vector produces NAN
+				if (angle < k_epsilon || isnan(d)) continue;
+
+				float length23 = glm::length(glm::cross(p2, p3)) + k_epsilon;
+				float length24 = glm::length(glm::cross(p2, p4)) + k_epsilon;
+				glm::vec3 q[4];
+				q[2] = (glm::cross(p2, n2) + glm::cross(n1, p2) * d) / length23;
+				q[3] = (glm::cross(p2, n1) + glm::cross(n2, p2) * d) / length24;
+				q[1] = -(glm::cross(p3, n2) + glm::cross(n1, p3) * d) / length23
+					- (glm::cross(p4, n1) + glm::cross(n2, p4) * d) / length24;
+				q[0] = -q[1] - q[2] - q[3];
+
+				float denom = a.compliance + (w[0] * glm::dot(q[0], q[0]) + w[1] * glm::dot(q[1], q[1]) + w[2] * glm::dot(q[2], q[2]) + w[3] * glm::dot(q[3], q[3]));
+				if (denom < k_epsilon) continue; // ?
+				float lambda = sqrt(1.0f - d * d) * (angle - expectedAngle) / denom;
+
+				for (int k = 0; k < 4; k++)
+				{
+					float scale = w[k] * lambda;
+					a.dx[idx[k]] += scale * q[k].x;
+					a.dy[idx[k]] += scale * q[k].y;
+					a.dz[idx[k]] += scale * q[k].z;
+					a.counts[idx[k]]++;
+				}
+			}
+		}
+
+		static void AttachmentScalar(const AttachmentArgs& a, int begin, int end)
+		{
+			for (int c = begin; c < end; c++)
+			{
+				int idx = a.indices[c];
+				a.qx[idx] = a.rest[c].x;
+				a.qy[idx] = a.rest[c].y;
+				a.qz[idx] = a.rest[c].z;
+			}
+		}
+
+#ifdef VT_SIMD_X86
+		static void AttachmentScalarGroup(const AttachmentArgs& a, int begin)
+		{
+			AttachmentScalar(a, begin, begin + 8);
+		}
+
+	private: // AVX2, 8 constraints per call
+
+		struct Vec8
+		{
+			__m256 x, y, z;
+		};
+
+		VT_TARGET_AVX2 static Vec8 Gather8(const float* x, const float* y, const float* z, __m256i idx)
+		{
+			return { _mm256_i32gather_ps(x, idx, 4), _mm256_i32gather_ps(y, idx, 4), _mm256_i32gather_ps(z, idx, 4) };
+		}
+
+		VT_TARGET_AVX2 static Vec8 Sub8(const Vec8& a, const Vec8& b)
+		{
+			return { _mm256_sub_ps(a.x, b.x), _mm256_sub_ps(a.y, b.y), _mm256_sub_ps(a.z, b.z) };
+		}
+
+		VT_TARGET_AVX2 static Vec8 Add8(const Vec8& a, const Vec8& b)
+		{
+			return { _mm256_add_ps(a.x, b.x), _mm256_add_ps(a.y, b.y), _mm256_add_ps(a.z, b.z) };
+		}
+
+		VT_TARGET_AVX2 static Vec8 Scale8(const Vec8& a, __m256 s)
+		{
+			return { _mm256_mul_ps(a.x, s), _mm256_mul_ps(a.y, s), _mm256_mul_ps(a.z, s) };
+		}
+
+		VT_TARGET_AVX2 static Vec8 Div8(const Vec8& a, __m256 s)
+		{
+			return { _mm256_div_ps(a.x, s), _mm256_div_ps(a.y, s), _mm256_div_ps(a.z, s) };
+		}
+
+		VT_TARGET_AVX2 static Vec8 Neg8(const Vec8& a)
+		{
+			const __m256 sign = _mm256_set1_ps(-0.0f);
+			return { _mm256_xor_ps(a.x, sign), _mm256_xor_ps(a.y, sign), _mm256_xor_ps(a.z, sign) };
+		}
+
+		// glm::dot: (x * x' + y * y') + z * z'
+		VT_TARGET_AVX2 static __m256 Dot8(const Vec8& a, const Vec8& b)
+		{
+			return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a.x, b.x), _mm256_mul_ps(a.y, b.y)), _mm256_mul_ps(a.z, b.z));
+		}
+
+		VT_TARGET_AVX2 static Vec8 Cross8(const Vec8& a, const Vec8& b)
+		{
+			return {
+				_mm256_sub_ps(_mm256_mul_ps(a.y, b.z), _mm256_mul_ps(b.y, a.z)),
+				_mm256_sub_ps(_mm256_mul_ps(a.z, b.x), _mm256_mul_ps(b.z, a.x)),
+				_mm256_sub_ps(_mm256_mul_ps(a.x, b.y), _mm256_mul_ps(b.x, a.y)) };
+		}
+
+		// glm::normalize: v * (1 / sqrt(dot(v, v)))
+		VT_TARGET_AVX2 static Vec8 Normalize8(const Vec8& a)
+		{
+			return Scale8(a, _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(Dot8(a, a))));
+		}
+
+		VT_TARGET_AVX2 static __m256 Acos8(__m256 x)
+		{
+			__m256 p = _mm256_set1_ps(k_acos[7]);
+			for (int i = 6; i >= 0; i--) p = _mm256_add_ps(_mm256_mul_ps(p, x), _mm256_set1_ps(k_acos[i]));
+			return _mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), x)), p);
+		}
+
+		// AVX2 has no scatter: lanes are stored one by one
+		VT_TARGET_AVX2 static void Scatter8(float* base, const int* idx, __m256 value)
+		{
+			alignas(32) float out[8];
+			_mm256_store_ps(out, value);
+			for (int l = 0; l < 8; l++) base[idx[l]] = out[l];
+		}
+
+		// Adds value to the lanes selected by mask. Other lanes are written back unchanged, which is safe within a group.
+		VT_TARGET_AVX2 static void ScatterAdd8(float* base, const int* idx, __m256 value, __m256 mask)
+		{
+			__m256 old = _mm256_i32gather_ps(base, _mm256_load_si256((const __m256i*)idx), 4);
+			Scatter8(base, idx, _mm256_blendv_ps(old, _mm256_add_ps(old, value), mask));
+		}
+
+		VT_TARGET_AVX2 static void ScatterAdd8(float* x, float* y, float* z, const int* idx, const Vec8& value, __m256 mask)
+		{
+			ScatterAdd8(x, idx, value.x, mask);
+			ScatterAdd8(y, idx, value.y, mask);
+			ScatterAdd8(z, idx, value.z, mask);
+		}
+
+		VT_TARGET_AVX2 static void Increment8(int* counts, const int* idx, __m256 mask)
+		{
+			alignas(32) int out[8];
+			__m256i old = _mm256_i32gather_epi32(counts, _mm256_load_si256((const __m256i*)idx), 4);
+			_mm256_store_si256((__m256i*)out, _mm256_sub_epi32(old, _mm256_castps_si256(mask)));
+			for (int l = 0; l < 8; l++) counts[idx[l]] = out[l];
+		}
+
+		VT_TARGET_AVX2 static void StretchAvx2(const StretchArgs& a, int begin)
+		{
+			const __m256i stride = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+			const int* pairs = &a.indices[begin].idx1;
+			StretchLanes8(a, _mm256_i32gather_epi32(pairs, stride, 4), _mm256_i32gather_epi32(pairs + 1, stride, 4), _mm256_loadu_ps(a.rest + begin));
+		}
+
+		VT_TARGET_AVX2_F16C static void StretchCompactAvx2(const StretchArgs& a, const VtCompactStretch& compact, int base, int begin)
+		{
+			__m256i pairs = _mm256_loadu_si256((const __m256i*)(compact.offsets.data() + begin));
+			__m256i b = _mm256_set1_epi32(base);
+			__m256i i1 = _mm256_add_epi32(b, _mm256_and_si256(pairs, _mm256_set1_epi32(0xFFFF)));
+			__m256i i2 = _mm256_add_epi32(b, _mm256_srli_epi32(pairs, 16));
+			StretchLanes8(a, i1, i2, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(compact.rest.data() + begin))));
+		}
+
+		// 8 distance constraints between particles i1 and i2, none of which appears twice
+		VT_TARGET_AVX2 static void StretchLanes8(const StretchArgs& a, __m256i i1, __m256i i2, __m256 expectedDistance)
+		{
+			alignas(32) int idx1[8], idx2[8];
+			_mm256_store_si256((__m256i*)idx1, i1);
+			_mm256_store_si256((__m256i*)idx2, i2);
+
+			Vec8 p1 = Gather8(a.qx, a.qy, a.qz, i1);
+			Vec8 p2 = Gather8(a.qx, a.qy, a.qz, i2);
+			Vec8 diff = Sub8(p1, p2);
+			__m256 distance = _mm256_sqrt_ps(Dot8(diff, diff));
+			__m256 w1 = _mm256_i32gather_ps(a.invMass, i1, 4);
+			__m256 w2 = _mm256_i32gather_ps(a.invMass, i2, 4);
+			__m256 denom = _mm256_add_ps(w1, w2);
+
+			__m256 active = _mm256_and_ps(_mm256_cmp_ps(distance, expectedDistance, _CMP_NEQ_UQ), _mm256_cmp_ps(denom, _mm256_setzero_ps(), _CMP_GT_OQ));
+			if (_mm256_movemask_ps(active) == 0) return;
+
+			Vec8 gradient = Div8(diff, _mm256_add_ps(distance, _mm256_set1_ps(k_epsilon)));
+			__m256 lambda = _mm256_div_ps(_mm256_sub_ps(distance, expectedDistance), denom);
+			Vec8 common = Scale8(gradient, lambda);
+
+			Scatter8(a.qx, idx1, _mm256_blendv_ps(p1.x, _mm256_sub_ps(p1.x, _mm256_mul_ps(w1, common.x)), active));
+			Scatter8(a.qy, idx1, _mm256_blendv_ps(p1.y, _mm256_sub_ps(p1.y, _mm256_mul_ps(w1, common.y)), active));
+			Scatter8(a.qz, idx1, _mm256_blendv_ps(p1.z, _mm256_sub_ps(p1.z, _mm256_mul_ps(w1, common.z)), active));
+			Scatter8(a.qx, idx2, _mm256_blendv_ps(p2.x, _mm256_add_ps(p2.x, _mm256_mul_ps(w2, common.x)), active));
+			Scatter8(a.qy, idx2, _mm256_blendv_ps(p2.y, _mm256_add_ps(p2.y, _mm256_mul_ps(w2, common.y)), active));
+			Scatter8(a.qz, idx2, _mm256_blendv_ps(p2.z, _mm256_add_ps(p2.z, _mm256_mul_ps(w2, common.z)), active));
+
+			ScatterAdd8(a.dx, a.dy, a.dz, idx1, common, active);
+			ScatterAdd8(a.dx, a.dy, a.dz, idx2, common, active);
+			Increment8(a.counts, idx1, active);
+			Increment8(a.counts, idx2, active);
+		}
+
+		VT_TARGET_AVX2 static Vec8 Load8(const float* x, const float* y, const float* z, int i)
+		{
+			return { _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i) };
+		}
+
+		VT_TARGET_AVX2 static void MaskStore8(float* x, float* y, float* z, int i, const Vec8& value, __m256 mask)
+		{
+			__m256i m = _mm256_castps_si256(mask);
+			_mm256_maskstore_ps(x + i, m, value.x);
+			_mm256_maskstore_ps(y + i, m, value.y);
+			_mm256_maskstore_ps(z + i, m, value.z);
+		}
+
+		// Grid line in blocks of 8 constraints; returns where the scalar remainder starts. Parity lines write every
+		// other lane only, so that the second particles of skipped lanes (the first particles of their neighbors)
+		// are not written back.
+		VT_TARGET_AVX2 static int StretchLineAvx2(const StretchArgs& a, const VtStretchGrid::Line& line)
+		{
+			const __m256 lanes = line.parity < 0 ? _mm256_castsi256_ps(_mm256_set1_epi32(-1)) :
+				_mm256_castsi256_ps(line.parity == 0 ? _mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0) : _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+			int j = 0;
+			for (; j + 8 <= line.count; j += 8)
+			{
+				int i1 = line.first + j, i2 = line.second + j;
+				__m256 expectedDistance = _mm256_loadu_ps(line.rest + j);
+
+				Vec8 p1 = Load8(a.qx, a.qy, a.qz, i1);
+				Vec8 p2 = Load8(a.qx, a.qy, a.qz, i2);
+				Vec8 diff = Sub8(p1, p2);
+				__m256 distance = _mm256_sqrt_ps(Dot8(diff, diff));
+				__m256 w1 = _mm256_loadu_ps(a.invMass + i1);
+				__m256 w2 = _mm256_loadu_ps(a.invMass + i2);
+				__m256 denom = _mm256_add_ps(w1, w2);
+
+				__m256 active = _mm256_and_ps(lanes, _mm256_and_ps(_mm256_cmp_ps(distance, expectedDistance, _CMP_NEQ_UQ),
+					_mm256_cmp_ps(denom, _mm256_setzero_ps(), _CMP_GT_OQ)));
+				if (_mm256_movemask_ps(active) == 0) continue;
+
+				Vec8 gradient = Div8(diff, _mm256_add_ps(distance, _mm256_set1_ps(k_epsilon)));
+				__m256 lambda = _mm256_div_ps(_mm256_sub_ps(distance, expectedDistance), denom);
+				Vec8 common = Scale8(gradient, lambda);
+
+				MaskStore8(a.qx, a.qy, a.qz, i1, Sub8(p1, Scale8(common, w1)), active);
+				MaskStore8(a.qx, a.qy, a.qz, i2, Add8(p2, Scale8(common, w2)), active);
+				MaskStore8(a.dx, a.dy, a.dz, i1, Add8(Load8(a.dx, a.dy, a.dz, i1), common), active);
+				MaskStore8(a.dx, a.dy, a.dz, i2, Add8(Load8(a.dx, a.dy, a.dz, i2), common), active);
+				__m256i m = _mm256_castps_si256(active);
+				_mm256_maskstore_epi32(a.counts + i1, m, _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(a.counts + i1)), m));
+				_mm256_maskstore_epi32(a.counts + i2, m, _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(a.counts + i2)), m));
+			}
+			return j;
+		}
+
+		VT_TARGET_AVX2 static void BendingAvx2(const BendingArgs& a, int begin)
+		{
+			const __m256i stride = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+			const int* quads = &a.indices[begin].idx1;
+			alignas(32) int idx[4][8];
+			__m256i ids[4];
+			__m256 w[4];
+			for (int k = 0; k < 4; k++)
+			{
+				ids[k] = _mm256_i32gather_epi32(quads + k, stride, 4);
+				_mm256_store_si256((__m256i*)idx[k], ids[k]);
+				w[k] = _mm256_i32gather_ps(a.invMass, ids[k], 4);
+			}
+			__m256 expectedAngle = _mm256_loadu_ps(a.rest + begin);
+
+			Vec8 p1 = Gather8(a.qx, a.qy, a.qz, ids[0]);
+			Vec8 p2 = Sub8(Gather8(a.qx, a.qy, a.qz, ids[1]), p1);
+			Vec8 p3 = Sub8(Gather8(a.qx, a.qy, a.qz, ids[2]), p1);
+			Vec8 p4 = Sub8(Gather8(a.qx, a.qy, a.qz, ids[3]), p1);
+
+			Vec8 c23 = Cross8(p2, p3);
+			Vec8 c24 = Cross8(p2, p4);
+			Vec8 n1 = Normalize8(c23);
+			Vec8 n2 = Normalize8(c24);
+
+			// clamp(v, 0, 1) keeps -0 and NaN like std::clamp: max returns its second operand unless the first is greater
+			__m256 dot = Dot8(n1, n2);
+			__m256 d = _mm256_min_ps(_mm256_max_ps(_mm256_setzero_ps(), dot), _mm256_set1_ps(1.0f));
+			__m256 angle = Acos8(d);
+			const __m256 epsilon = _mm256_set1_ps(k_epsilon);
+			__m256 active = _mm256_and_ps(_mm256_cmp_ps(angle, epsilon, _CMP_NLT_UQ), _mm256_cmp_ps(dot, dot, _CMP_ORD_Q));
+			if (_mm256_movemask_ps(active) == 0) return;
+
+			__m256 length23 = _mm256_add_ps(_mm256_sqrt_ps(Dot8(c23, c23)), epsilon);
+			__m256 length24 = _mm256_add_ps(_mm256_sqrt_ps(Dot8(c24, c24)), epsilon);
+			Vec8 q[4];
+			q[2] = Div8(Add8(Cross8(p2, n2), Scale8(Cross8(n1, p2), d)), length23);
+			q[3] = Div8(Add8(Cross8(p2, n1), Scale8(Cross8(n2, p2), d)), length24);
+			q[1] = Sub8(Div8(Neg8(Add8(Cross8(p3, n2), Scale8(Cross8(n1, p3), d))), length23),
+				Div8(Add8(Cross8(p4, n1), Scale8(Cross8(n2, p4), d)), length24));
+			q[0] = Sub8(Sub8(Neg8(q[1]), q[2]), q[3]);
+
+			__m256 sum = _mm256_mul_ps(w[0], Dot8(q[0], q[0]));
+			for (int k = 1; k < 4; k++) sum = _mm256_add_ps(sum, _mm256_mul_ps(w[k], Dot8(q[k], q[k])));
+			__m256 denom = _mm256_add_ps(_mm256_set1_ps(a.compliance), sum);
+			active = _mm256_and_ps(active, _mm256_cmp_ps(denom, epsilon, _CMP_NLT_UQ));
+			if (_mm256_movemask_ps(active) == 0) return;
+
+			__m256 lambda = _mm256_div_ps(_mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(d, d))),
+				_mm256_sub_ps(angle, expectedAngle)), denom);
+			for (int k = 0; k < 4; k++)
+			{
+				ScatterAdd8(a.dx, a.dy, a.dz, idx[k], Scale8(q[k], _mm256_mul_ps(w[k], lambda)), active);
+				Increment8(a.counts, idx[k], active);
+			}
+		}
+
+	private: // AVX-512, 16 constraints per call
+
+		struct Vec16
+		{
+			__m512 x, y, z;
+		};
+
+		VT_TARGET_AVX512 static Vec16 Gather16(const float* x, const float* y, const float* z, __m512i idx)
+		{
+			return { _mm512_i32gather_ps(idx, x, 4), _mm512_i32gather_ps(idx, y, 4), _mm512_i32gather_ps(idx, z, 4) };
+		}
+
+		VT_TARGET_AVX512 static Vec16 Sub16(const Vec16& a, const Vec16& b)
+		{
+			return { _mm512_sub_ps(a.x, b.x), _mm512_sub_ps(a.y, b.y), _mm512_sub_ps(a.z, b.z) };
+		}
+
+		VT_TARGET_AVX512 static Vec16 Add16(const Vec16& a, const Vec16& b)
+		{
+			return { _mm512_add_ps(a.x, b.x), _mm512_add_ps(a.y, b.y), _mm512_add_ps(a.z, b.z) };
+		}
+
+		VT_TARGET_AVX512 static Vec16 Scale16(const Vec16& a, __m512 s)
+		{
+			return { _mm512_mul_ps(a.x, s), _mm512_mul_ps(a.y, s), _mm512_mul_ps(a.z, s) };
+		}
+
+		VT_TARGET_AVX512 static Vec16 Div16(const Vec16& a, __m512 s)
+		{
+			return { _mm512_div_ps(a.x, s), _mm512_div_ps(a.y, s), _mm512_div_ps(a.z, s) };
+		}
+
+		// AVX-512F has no float xor, so the sign bit is flipped as integers
+		VT_TARGET_AVX512 static __m512 Neg16(__m512 v)
+		{
+			return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v), _mm512_set1_epi32((int)0x80000000)));
+		}
+
+		VT_TARGET_AVX512 static Vec16 Neg16(const Vec16& a)
+		{
+			return { Neg16(a.x), Neg16(a.y), Neg16(a.z) };
+		}
+
+		VT_TARGET_AVX512 static __m512 Dot16(const Vec16& a, const Vec16& b)
+		{
+			return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a.x, b.x), _mm512_mul_ps(a.y, b.y)), _mm512_mul_ps(a.z, b.z));
+		}
+
+		VT_TARGET_AVX512 static Vec16 Cross16(const Vec16& a, const Vec16& b)
+		{
+			return {
+				_mm512_sub_ps(_mm512_mul_ps(a.y, b.z), _mm512_mul_ps(b.y, a.z)),
+				_mm512_sub_ps(_mm512_mul_ps(a.z, b.x), _mm512_mul_ps(b.z, a.x)),
+				_mm512_sub_ps(_mm512_mul_ps(a.x, b.y), _mm512_mul_ps(b.x, a.y)) };
+		}
+
+		VT_TARGET_AVX512 static Vec16 Normalize16(const Vec16& a)
+		{
+			return Scale16(a, _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(Dot16(a, a))));
+		}
+
+		VT_TARGET_AVX512 static __m512 Acos16(__m512 x)
+		{
+			__m512 p = _mm512_set1_ps(k_acos[7]);
+			for (int i = 6; i >= 0; i--) p = _mm512_add_ps(_mm512_mul_ps(p, x), _mm512_set1_ps(k_acos[i]));
+			return _mm512_mul_ps(_mm512_sqrt_ps(_mm512_sub_ps(_mm512_set1_ps(1.0f), x)), p);
+		}
+
+		VT_TARGET_AVX512 static void ScatterAdd16(float* base, __m512i idx, __m512 value, __mmask16 mask)
+		{
+			__m512 old = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, idx, base, 4);
+			_mm512_mask_i32scatter_ps(base, mask, idx, _mm512_add_ps(old, value), 4);
+		}
+
+		VT_TARGET_AVX512 static void ScatterAdd16(float* x, float* y, float* z, __m512i idx, const Vec16& value, __mmask16 mask)
+		{
+			ScatterAdd16(x, idx, value.x, mask);
+			ScatterAdd16(y, idx, value.y, mask);
+			ScatterAdd16(z, idx, value.z, mask);
+		}
+
+		VT_TARGET_AVX512 static void Increment16(int* counts, __m512i idx, __mmask16 mask)
+		{
+			__m512i old = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, idx, counts, 4);
+			_mm512_mask_i32scatter_epi32(counts, mask, idx, _mm512_add_epi32(old, _mm512_set1_epi32(1)), 4);
+		}
+
+		VT_TARGET_AVX512 static void StretchAvx512(const StretchArgs& a, int begin)
+		{
+			const __m512i stride = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+			const int* pairs = &a.indices[begin].idx1;
+			StretchLanes16(a, _mm512_i32gather_epi32(stride, pairs, 4), _mm512_i32gather_epi32(stride, pairs + 1, 4), _mm512_loadu_ps(a.rest + begin));
+		}
+
+		VT_TARGET_AVX512 static void StretchCompactAvx512(const StretchArgs& a, const VtCompactStretch& compact, int base, int begin)
+		{
+			__m512i pairs = _mm512_loadu_si512(compact.offsets.data() + begin);
+			__m512i b = _mm512_set1_epi32(base);
+			__m512i i1 = _mm512_add_epi32(b, _mm512_and_si512(pairs, _mm512_set1_epi32(0xFFFF)));
+			__m512i i2 = _mm512_add_epi32(b, _mm512_srli_epi32(pairs, 16));
+			StretchLanes16(a, i1, i2, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(compact.rest.data() + begin))));
+		}
+
+		// 16 distance constraints between particles i1 and i2, none of which appears twice
+		VT_TARGET_AVX512 static void StretchLanes16(const StretchArgs& a, __m512i i1, __m512i i2, __m512 expectedDistance)
+		{
+			Vec16 p1 = Gather16(a.qx, a.qy, a.qz, i1);
+			Vec16 p2 = Gather16(a.qx, a.qy, a.qz, i2);
+			Vec16 diff = Sub16(p1, p2);
+			__m512 distance = _mm512_sqrt_ps(Dot16(diff, diff));
+			__m512 w1 = _mm512_i32gather_ps(i1, a.invMass, 4);
+			__m512 w2 = _mm512_i32gather_ps(i2, a.invMass, 4);
+			__m512 denom = _mm512_add_ps(w1, w2);
+
+			__mmask16 active = _mm512_cmp_ps_mask(distance, expectedDistance, _CMP_NEQ_UQ) & _mm512_cmp_ps_mask(denom, _mm512_setzero_ps(), _CMP_GT_OQ);
+			if (active == 0) return;
+
+			Vec16 gradient = Div16(diff, _mm512_add_ps(distance, _mm512_set1_ps(k_epsilon)));
+			__m512 lambda = _mm512_div_ps(_mm512_sub_ps(distance, expectedDistance), denom);
+			Vec16 common = Scale16(gradient, lambda);
+
+			_mm512_mask_i32scatter_ps(a.qx, active, i1, _mm512_sub_ps(p1.x, _mm512_mul_ps(w1, common.x)), 4);
+			_mm512_mask_i32scatter_ps(a.qy, active, i1, _mm512_sub_ps(p1.y, _mm512_mul_ps(w1, common.y)), 4);
+			_mm512_mask_i32scatter_ps(a.qz, active, i1, _mm512_sub_ps(p1.z, _mm512_mul_ps(w1, common.z)), 4);
+			_mm512_mask_i32scatter_ps(a.qx, active, i2, _mm512_add_ps(p2.x, _mm512_mul_ps(w2, common.x)), 4);
+			_mm512_mask_i32scatter_ps(a.qy, active, i2, _mm512_add_ps(p2.y, _mm512_mul_ps(w2, common.y)), 4);
+			_mm512_mask_i32scatter_ps(a.qz, active, i2, _mm512_add_ps(p2.z, _mm512_mul_ps(w2, common.z)), 4);
+
+			ScatterAdd16(a.dx, a.dy, a.dz, i1, common, active);
+			ScatterAdd16(a.dx, a.dy, a.dz, i2, common, active);
+			Increment16(a.counts, i1, active);
+			Increment16(a.counts, i2, active);
+		}
+
+		VT_TARGET_AVX512 static Vec16 Load16(const float* x, const float* y, const float* z, int i)
+		{
+			return { _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), _mm512_loadu_ps(z + i) };
+		}
+
+		VT_TARGET_AVX512 static void MaskStore16(float* x, float* y, float* z, int i, const Vec16& value, __mmask16 mask)
+		{
+			_mm512_mask_storeu_ps(x + i, mask, value.x);
+			_mm512_mask_storeu_ps(y + i, mask, value.y);
+			_mm512_mask_storeu_ps(z + i, mask, value.z);
+		}
+
+		// Same as StretchLineAvx2 with 16 constraints per block
+		VT_TARGET_AVX512 static int StretchLineAvx512(const StretchArgs& a, const VtStretchGrid::Line& line)
+		{
+			const __mmask16 lanes = line.parity < 0 ? 0xFFFF : line.parity == 0 ? 0x5555 : 0xAAAA;
+			const __m512i one = _mm512_set1_epi32(1);
+			int j = 0;
+			for (; j + 16 <= line.count; j += 16)
+			{
+				int i1 = line.first + j, i2 = line.second + j;
+				__m512 expectedDistance = _mm512_loadu_ps(line.rest + j);
+
+				Vec16 p1 = Load16(a.qx, a.qy, a.qz, i1);
+				Vec16 p2 = Load16(a.qx, a.qy, a.qz, i2);
+				Vec16 diff = Sub16(p1, p2);
+				__m512 distance = _mm512_sqrt_ps(Dot16(diff, diff));
+				__m512 w1 = _mm512_loadu_ps(a.invMass + i1);
+				__m512 w2 = _mm512_loadu_ps(a.invMass + i2);
+				__m512 denom = _mm512_add_ps(w1, w2);
+
+				__mmask16 active = lanes & _mm512_cmp_ps_mask(distance, expectedDistance, _CMP_NEQ_UQ) &
+					_mm512_cmp_ps_mask(denom, _mm512_setzero_ps(), _CMP_GT_OQ);
+				if (active == 0) continue;
+
+				Vec16 gradient = Div16(diff, _mm512_add_ps(distance, _mm512_set1_ps(k_epsilon)));
+				__m512 lambda = _mm512_div_ps(_mm512_sub_ps(distance, expectedDistance), denom);
+				Vec16 common = Scale16(gradient, lambda);
+
+				MaskStore16(a.qx, a.qy, a.qz, i1, Sub16(p1, Scale16(common, w1)), active);
+				MaskStore16(a.qx, a.qy, a.qz, i2, Add16(p2, Scale16(common, w2)), active);
+				MaskStore16(a.dx, a.dy, a.dz, i1, Add16(Load16(a.dx, a.dy, a.dz, i1), common), active);
+				MaskStore16(a.dx, a.dy, a.dz, i2, Add16(Load16(a.dx, a.dy, a.dz, i2), common), active);
+				_mm512_mask_storeu_epi32(a.counts + i1, active, _mm512_add_epi32(_mm512_loadu_si512(a.counts + i1), one));
+				_mm512_mask_storeu_epi32(a.counts + i2, active, _mm512_add_epi32(_mm512_loadu_si512(a.counts + i2), one));
+			}
+			return j;
+		}
+
+		VT_TARGET_AVX512 static void BendingAvx512(const BendingArgs& a, int begin)
+		{
+			const __m512i stride = _mm512_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48, 52, 56, 60);
+			const int* quads = &a.indices[begin].idx1;
+			__m512i ids[4];
+			__m512 w[4];
+			for (int k = 0; k < 4; k++)
+			{
+				ids[k] = _mm512_i32gather_epi32(stride, quads + k, 4);
+				w[k] = _mm512_i32gather_ps(ids[k], a.invMass, 4);
+			}
+			__m512 expectedAngle = _mm512_loadu_ps(a.rest + begin);
+
+			Vec16 p1 = Gather16(a.qx, a.qy, a.qz, ids[0]);
+			Vec16 p2 = Sub16(Gather16(a.qx, a.qy, a.qz, ids[1]), p1);
+			Vec16 p3 = Sub16(Gather16(a.qx, a.qy, a.qz, ids[2]), p1);
+			Vec16 p4 = Sub16(Gather16(a.qx, a.qy, a.qz, ids[3]), p1);
+
+			Vec16 c23 = Cross16(p2, p3);
+			Vec16 c24 = Cross16(p2, p4);
+			Vec16 n1 = Normalize16(c23);
+			Vec16 n2 = Normalize16(c24);
+
+			__m512 dot = Dot16(n1, n2);
+			__m512 d = _mm512_min_ps(_mm512_max_ps(_mm512_setzero_ps(), dot), _mm512_set1_ps(1.0f));
+			__m512 angle = Acos16(d);
+			const __m512 epsilon = _mm512_set1_ps(k_epsilon);
+			__mmask16 active = _mm512_cmp_ps_mask(angle, epsilon, _CMP_NLT_UQ) & _mm512_cmp_ps_mask(dot, dot, _CMP_ORD_Q);
+			if (active == 0) return;
+
+			__m512 length23 = _mm512_add_ps(_mm512_sqrt_ps(Dot16(c23, c23)), epsilon);
+			__m512 length24 = _mm512_add_ps(_mm512_sqrt_ps(Dot16(c24, c24)), epsilon);
+			Vec16 q[4];
+			q[2] = Div16(Add16(Cross16(p2, n2), Scale16(Cross16(n1, p2), d)), length23);
+			q[3] = Div16(Add16(Cross16(p2, n1), Scale16(Cross16(n2, p2), d)), length24);
+			q[1] = Sub16(Div16(Neg16(Add16(Cross16(p3, n2), Scale16(Cross16(n1, p3), d))), length23),
+				Div16(Add16(Cross16(p4, n1), Scale16(Cross16(n2, p4), d)), length24));
+			q[0] = Sub16(Sub16(Neg16(q[1]), q[2]), q[3]);
+
+			__m512 sum = _mm512_mul_ps(w[0], Dot16(q[0], q[0]));
+			for (int k = 1; k < 4; k++) sum = _mm512_add_ps(sum, _mm512_mul_ps(w[k], Dot16(q[k], q[k])));
+			__m512 denom = _mm512_add_ps(_mm512_set1_ps(a.compliance), sum);
+			active &= _mm512_cmp_ps_mask(denom, epsilon, _CMP_NLT_UQ);
+			if (active == 0) return;
+
+			__m512 lambda = _mm512_div_ps(_mm512_mul_ps(_mm512_sqrt_ps(_mm512_sub_ps(_mm512_set1_ps(1.0f), _mm512_mul_ps(d, d))),
+				_mm512_sub_ps(angle, expectedAngle)), denom);
+			for (int k = 0; k < 4; k++)
+			{
+				ScatterAdd16(a.dx, a.dy, a.dz, ids[k], Scale16(q[k], _mm512_mul_ps(w[k], lambda)), active);
+				Increment16(a.counts, ids[k], active);
+			}
+		}
+
+		VT_TARGET_AVX512 static void AttachmentAvx512(const AttachmentArgs& a, int begin)
+		{
+			const __m512i stride = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45);
+			const float* rest = &a.rest[begin].x;
+			__m512i idx = _mm512_loadu_si512(a.indices + begin);
+			_mm512_i32scatter_ps(a.qx, idx, _mm512_i32gather_ps(stride, rest, 4), 4);
+			_mm512_i32scatter_ps(a.qy, idx, _mm512_i32gather_ps(stride, rest + 1, 4), 4);
+			_mm512_i32scatter_ps(a.qz, idx, _mm512_i32gather_ps(stride, rest + 2, 4), 4);
+		}
+#endif
+	};
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+namespace Velvet
+{
+	using namespace std;
+
+	// Constraint residuals of the predicted positions after one solver iteration
+	struct VtResidualSample
+	{
+		int substep = 0;
+		int iteration = 0;
+		float stretchRms = 0;		//!< |d - d0| over stretch constraints
+		float stretchMax = 0;
+		float bendingRms = 0;		//!< |angle - angle0| over bending constraints (radians)
+		float bendingMax = 0;
+		float attachmentRms = 0;	//!< Distance of attached particles to their slots
+		float attachmentMax = 0;
+		float maxViolation = 0;		//!< Largest positional error: stretch, attachment or penetration
+		float maxPenetration = 0;	//!< Deepest particle penetration over all colliders (collision margin excluded)
+		float kineticEnergy = 0;	//!< 0.5 * sum(v^2) with v estimated from predicted positions, unit mass
+	};
+
+	// Per-iteration convergence data of one cloth solver. Disabled by default; when enabled,
+	// the solver fills one sample per substep and iteration of the latest frame.
+	class VtConvergenceRecorder
+	{
+	public:
+		static constexpr int k_historyLength = 180;
+
+		bool enabled = false;
+
+		// Samples of the latest frame, ordered by substep then iteration
+		vector<VtResidualSample> samples;
+		// Penetration depth per sample and collider: penetrations[sample * numColliders + collider]
+		vector<float> penetrations;
+		int numColliders = 0;
+
+		// Last sample of each of the latest frames, oldest first once the ring is full (see historyStart)
+		VtResidualSample history[k_historyLength];
+		int historyStart = 0;
+		int historySize = 0;
+
+		void BeginFrame(int numSamples, int _numColliders)
+		{
+			// Buffers keep their size between frames, so recording only allocates when the solver settings change
+			numColliders = _numColliders;
+			samples.resize(numSamples);
+			penetrations.resize((size_t)numSamples * numColliders);
+			m_numRecorded = 0;
+		}
+
+		VtResidualSample& NextSample()
+		{
+			return samples[min(m_numRecorded++, (int)samples.size() - 1)];
+		}
+
+		float* PenetrationsOf(const VtResidualSample& sample)
+		{
+			return penetrations.data() + (&sample - samples.data()) * numColliders;
+		}
+
+		const float* PenetrationsOf(const VtResidualSample& sample) const
+		{
+			return penetrations.data() + (&sample - samples.data()) * numColliders;
+		}
+
+		void EndFrame()
+		{
+			if (samples.empty()) return;
+
+			int index = (historyStart + historySize) % k_historyLength;
+			history[index] = samples.back();
+			if (historySize < k_historyLength) historySize++;
+			else historyStart = (historyStart + 1) % k_historyLength;
+		}
+
+		const VtResidualSample& HistoryAt(int i) const
+		{
+			return history[(historyStart + i) % k_historyLength];
+		}
+
+	private:
+		int m_numRecorded = 0;
+	};
+}
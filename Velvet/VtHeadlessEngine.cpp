@@ -0,0 +1,941 @@
+#include "VtHeadlessEngine.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <filesystem>
+#include <fmt/core.h>
+
+#include "Scene.hpp"
+#include "GameInstance.hpp"
+#include "Timer.hpp"
+#include "VtProfiler.hpp"
+#include "VtAllocationTracker.hpp"
+#include "VtSimd.hpp"
+
+using namespace Velvet;
+
+namespace
+{
+	// Profiler scopes reported per frame. Phases are recorded by VtClothSolverCPU and SpatialHashCPU.
+	const vector<string> k_phaseLabels = {
+		"Solver_CollideSDFs",
+		"Solver_Predict",
+		"Solver_HashObjects",
+		"Solver_CollideParticles",
+		"Solver_SolveStretch",
+		"Solver_SolveBending",
+		"Solver_SolveAttach",
+		"Solver_ApplyDeltas",
+		"Solver_Finalize",
+		"Solver_UpdateNormals",
+	};
+
+	// Metrics compared against the baseline. For "higherIsBetter" metrics a drop counts as regression.
+	struct BenchmarkMetric
+	{
+		string key;
+		bool higherIsBetter;
+	};
+
+	const vector<BenchmarkMetric> k_benchmarkMetrics = {
+		{ "p50_ms", false },
+		{ "p95_ms", false },
+		{ "p99_ms", false },
+		{ "max_ms", false },
+		{ "steps_per_sec", true },
+	};
+
+	// Simulation parameters that can be overridden from the command line with --set name=value
+	struct ParameterBinding
+	{
+		const char* name;
+		int* intValue;
+		float* floatValue;
+		bool* boolValue;
+	};
+
+	vector<ParameterBinding> ParameterBindings()
+	{
+		auto& p = Global::simParams;
+		return {
+			{ "numSubsteps", &p.numSubsteps, nullptr, nullptr },
+			{ "numIterations", &p.numIterations, nullptr, nullptr },
+			{ "maxNumNeighbors", &p.maxNumNeighbors, nullptr, nullptr },
+			{ "interleavedHash", &p.interleavedHash, nullptr, nullptr },
+			{ "numThreads", &p.numThreads, nullptr, nullptr },
+			{ "threadAffinity", &p.threadAffinity, nullptr, nullptr },
+			{ "minParallelParticles", &p.minParallelParticles, nullptr, nullptr },
+			{ "reorderInterval", &p.reorderInterval, nullptr, nullptr },
+			{ "cacheTileKB", &p.cacheTileKB, nullptr, nullptr },
+			{ "arenaHugePages", &p.arenaHugePages, nullptr, nullptr },
+			{ "maxSpeed", nullptr, &p.maxSpeed, nullptr },
+			{ "bendCompliance", nullptr, &p.bendCompliance, nullptr },
+			{ "damping", nullptr, &p.damping, nullptr },
+			{ "relaxationFactor", nullptr, &p.relaxationFactor, nullptr },
+			{ "collisionMargin", nullptr, &p.collisionMargin, nullptr },
+			{ "friction", nullptr, &p.friction, nullptr },
+			{ "enableSelfCollision", nullptr, nullptr, &p.enableSelfCollision },
+			{ "enableBending", nullptr, nullptr, &p.enableBending },
+			{ "numaFirstTouch", nullptr, nullptr, &p.numaFirstTouch },
+			{ "deterministic", nullptr, nullptr, &p.deterministic },
+			{ "coloredConstraints", nullptr, nullptr, &p.coloredConstraints },
+			{ "jacobiCPU", nullptr, nullptr, &p.jacobiCPU },
+			{ "gridStretch", nullptr, nullptr, &p.gridStretch },
+			{ "reorderParticles", nullptr, nullptr, &p.reorderParticles },
+			{ "fusedSweeps", nullptr, nullptr, &p.fusedSweeps },
+			{ "solverArena", nullptr, nullptr, &p.solverArena },
+			{ "compactState", nullptr, nullptr, &p.compactState },
+		};
+	}
+
+	bool ApplyParameter(const string& assignment)
+	{
+		auto pos = assignment.find('=');
+		string name = assignment.substr(0, pos);
+		string value = pos == string::npos ? "" : assignment.substr(pos + 1);
+
+		for (const auto& binding : ParameterBindings())
+		{
+			if (name != binding.name || value.empty()) continue;
+
+			if (binding.intValue) *binding.intValue = atoi(value.c_str());
+			if (binding.floatValue) *binding.floatValue = (float)atof(value.c_str());
+			if (binding.boolValue) *binding.boolValue = (value == "1" || value == "true");
+			return true;
+		}
+		fmt::print("Error(Headless): Unknown parameter assignment [{}].\n", assignment);
+		return false;
+	}
+
+	// Scene names contain spaces and slashes, keep alphanumerics only for file names
+	string SceneFileName(const string& sceneName)
+	{
+		string result;
+		for (char c : sceneName)
+		{
+			if (isalnum((unsigned char)c)) result += c;
+			else if (!result.empty() && result.back() != '_') result += '_';
+		}
+		return result + ".traj";
+	}
+
+	vector<int> ParseIntList(const string& text)
+	{
+		vector<int> result;
+		stringstream ss(text);
+		string item;
+		while (getline(ss, item, ','))
+		{
+			if (!item.empty()) result.push_back(max(atoi(item.c_str()), 1));
+		}
+		return result;
+	}
+
+	// Nearest-rank percentile of sorted values
+	double Percentile(const vector<double>& sorted, double percent)
+	{
+		if (sorted.empty()) return 0;
+		size_t rank = (size_t)ceil(percent / 100.0 * sorted.size());
+		return sorted[clamp(rank, (size_t)1, sorted.size()) - 1];
+	}
+
+	// Minimal lookup for the one-record-per-line json written by RunBenchmark
+	bool FindJsonValue(const string& line, const string& key, string& value)
+	{
+		auto pos = line.find("\"" + key + "\":");
+		if (pos == string::npos) return false;
+		pos = line.find_first_not_of(' ', pos + key.size() + 3);
+		if (pos == string::npos) return false;
+
+		if (line[pos] == '"')
+		{
+			auto end = line.find('"', pos + 1);
+			value = line.substr(pos + 1, end - pos - 1);
+		}
+		else
+		{
+			auto end = line.find_first_of(",}", pos);
+			value = line.substr(pos, end - pos);
+		}
+		return true;
+	}
+}
+
+VtHeadlessEngine::VtHeadlessEngine(int argc, char** argv)
+{
+	double flightThreshold = 0;
+	int flightFrames = 16;
+	bool framesSpecified = false, warmupSpecified = false;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+
+		if (arg == "--scene" && hasValue)
+		{
+			m_sceneArgs.push_back(argv[++i]);
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			m_numFrames = max(atoi(argv[++i]), 1);
+			framesSpecified = true;
+		}
+		else if (arg == "--warmup" && hasValue)
+		{
+			m_numWarmupFrames = max(atoi(argv[++i]), 0);
+			warmupSpecified = true;
+		}
+		else if (arg == "--list")
+		{
+			m_listScenes = true;
+		}
+		else if (arg == "--trace" && hasValue)
+		{
+			m_tracePath = argv[++i];
+		}
+		else if (arg == "--flight-recorder" && hasValue)
+		{
+			flightThreshold = atof(argv[++i]);
+		}
+		else if (arg == "--flight-frames" && hasValue)
+		{
+			flightFrames = atoi(argv[++i]);
+		}
+		else if (arg == "--residuals" && hasValue)
+		{
+			m_residualPath = argv[++i];
+		}
+		else if (arg == "--broadphase-stats")
+		{
+			m_broadphaseStats = true;
+		}
+		else if (arg == "--memory-report")
+		{
+			m_memoryReport = true;
+		}
+		else if (arg == "--perf-counters")
+		{
+			m_perfCounters = true;
+		}
+		else if (arg == "--benchmark" && hasValue)
+		{
+			m_benchmarkPath = argv[++i];
+		}
+		else if (arg == "--baseline" && hasValue)
+		{
+			m_baselinePath = argv[++i];
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			m_threadCounts = ParseIntList(argv[++i]);
+		}
+		else if (arg == "--threshold" && hasValue)
+		{
+			m_regressionThreshold = atof(argv[++i]);
+		}
+		else if (arg == "--record" && hasValue)
+		{
+			m_recordDir = argv[++i];
+		}
+		else if (arg == "--validate" && hasValue)
+		{
+			m_validateDir = argv[++i];
+		}
+		else if (arg == "--determinism")
+		{
+			m_determinism = true;
+		}
+		else if (arg == "--overhead-budget" && hasValue)
+		{
+			m_overheadBudget = atof(argv[++i]);
+		}
+		else if (arg == "--tol-position" && hasValue)
+		{
+			m_tolerance.position = (float)atof(argv[++i]);
+		}
+		else if (arg == "--tol-stretch" && hasValue)
+		{
+			m_tolerance.stretch = (float)atof(argv[++i]);
+		}
+		else if (arg == "--tol-penetration" && hasValue)
+		{
+			m_tolerance.penetration = (float)atof(argv[++i]);
+		}
+		else if (arg == "--tol-energy" && hasValue)
+		{
+			m_tolerance.energy = (float)atof(argv[++i]);
+		}
+		else if (arg == "--simd" && hasValue)
+		{
+			VtSimdLevel level;
+			if (VtSimd::Parse(argv[++i], level))
+			{
+				if (VtSimd::SetLevel(level) != level)
+				{
+					fmt::print("Warning(Headless): This CPU does not support {}, using {}.\n", argv[i], VtSimd::Name(VtSimd::Active()));
+				}
+			}
+			else
+			{
+				fmt::print("Error(Headless): Unknown SIMD level [{}].\n", argv[i]);
+				m_validArgs = false;
+			}
+		}
+		else if (arg == "--set" && hasValue)
+		{
+			m_parameterOverrides.push_back(argv[++i]);
+		}
+		else
+		{
+			fmt::print("Error(Headless): Unknown or incomplete argument [{}].\n", arg);
+			m_validArgs = false;
+		}
+	}
+
+	// Benchmarks skip the first frames by default, where the cloth is still at rest
+	if (!m_benchmarkPath.empty() && !warmupSpecified)
+	{
+		m_numWarmupFrames = 30;
+	}
+	if (m_numWarmupFrames >= m_numFrames && framesSpecified)
+	{
+		fmt::print("Error(Headless): Warmup frames ({}) must be less than frames ({}).\n", m_numWarmupFrames, m_numFrames);
+		m_validArgs = false;
+	}
+	m_numFrames = max(m_numFrames, m_numWarmupFrames + 1);
+	if (m_threadCounts.empty())
+	{
+		m_validArgs = false;
+	}
+	if (!m_recordDir.empty() + !m_validateDir.empty() + !m_benchmarkPath.empty() + m_determinism > 1)
+	{
+		fmt::print("Error(Headless): --benchmark, --record, --validate and --determinism can not be combined.\n");
+		m_validArgs = false;
+	}
+
+	Profiler::SetFlightRecorder(flightThreshold, flightFrames, "velvet_flight");
+}
+
+void VtHeadlessEngine::SetScenes(const vector<shared_ptr<Scene>>& initializers)
+{
+	scenes = initializers;
+}
+
+void VtHeadlessEngine::PrintUsage()
+{
+	fmt::print("Usage: VelvetHeadless [--scene <index|name>]... [--frames <n>] [--warmup <n>] [--list]\n"
+		"                      [--trace <file>] [--flight-recorder <threshold ms>] [--flight-frames <n>] [--perf-counters]\n"
+		"                      [--residuals <file>] [--broadphase-stats] [--memory-report]\n"
+		"                      [--benchmark <result file> [--threads 1,2,4,...] [--baseline <file>] [--threshold <percent>]]\n"
+		"                      [--record <dir>] [--validate <dir> [--tol-position <m>] [--tol-stretch <ratio>] [--tol-penetration <m>] [--tol-energy <ratio>]]\n"
+		"                      [--determinism [--threads 1,2,4,...] [--overhead-budget <percent>]]\n"
+		"                      [--set <param>=<value>]... [--simd scalar|avx2|avx512]\n");
+}
+
+bool VtHeadlessEngine::ResolveScenes()
+{
+	m_sceneIndices.clear();
+	if (m_sceneArgs.empty())
+	{
+		for (unsigned int i = 0; i < scenes.size(); i++) m_sceneIndices.push_back(i);
+		return true;
+	}
+
+	for (const auto& arg : m_sceneArgs)
+	{
+		bool isNumber = !arg.empty() && all_of(arg.begin(), arg.end(), ::isdigit);
+		if (isNumber && (unsigned int)stoi(arg) < scenes.size())
+		{
+			m_sceneIndices.push_back(stoi(arg));
+			continue;
+		}
+
+		auto it = find_if(scenes.begin(), scenes.end(), [&arg](const shared_ptr<Scene>& scene) {
+			return scene->name == arg;
+			});
+		if (it == scenes.end())
+		{
+			fmt::print("Error(Headless): Scene [{}] not found. Use --list to show available scenes.\n", arg);
+			return false;
+		}
+		m_sceneIndices.push_back((unsigned int)(it - scenes.begin()));
+	}
+	return true;
+}
+
+int VtHeadlessEngine::Run()
+{
+	if (!m_validArgs)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (m_listScenes)
+	{
+		for (unsigned int i = 0; i < scenes.size(); i++)
+		{
+			fmt::print("{}: {}\n", i, scenes[i]->name);
+		}
+		return 0;
+	}
+
+	if (!ResolveScenes())
+	{
+		return 1;
+	}
+
+#ifdef VT_PROFILER
+	if (m_perfCounters && !PerfCounters::Enable())
+	{
+		m_perfCounters = false;
+	}
+#else
+	if (m_perfCounters)
+	{
+		fmt::print("Warning(Headless): --perf-counters requires VT_PROFILER, ignored.\n");
+		m_perfCounters = false;
+	}
+#endif
+
+	// Check assignments once up front; RunScene applies them again after every onEnter
+	auto defaultParams = Global::simParams;
+	bool validOverrides = ApplyParameterOverrides();
+	Global::simParams = defaultParams;
+	if (!validOverrides)
+	{
+		return 1;
+	}
+
+	int result = 0;
+	if (!m_benchmarkPath.empty())
+	{
+		result = RunBenchmark();
+	}
+	else if (!m_recordDir.empty() || !m_validateDir.empty())
+	{
+		result = RunTrajectories();
+	}
+	else if (m_determinism)
+	{
+		result = RunDeterminism();
+	}
+	else
+	{
+		for (auto sceneIndex : m_sceneIndices)
+		{
+			PrintReport(RunScene(sceneIndex));
+		}
+	}
+
+	if (!m_tracePath.empty() && Profiler::ExportChromeTrace(m_tracePath))
+	{
+		fmt::print("Info(Headless): Profiler trace written to [{}].\n", m_tracePath);
+	}
+	if (!m_residualPath.empty() && !WriteResiduals())
+	{
+		result = (result == 0) ? 1 : result;
+	}
+	if (m_numAllocationFailures > 0)
+	{
+		fmt::print("Error(Headless): {} scene run(s) allocated inside solver scopes after the first frame.\n", m_numAllocationFailures);
+		result = (result == 0) ? 4 : result;
+	}
+	return result;
+}
+
+bool VtHeadlessEngine::ApplyParameterOverrides()
+{
+	bool result = true;
+	for (const auto& assignment : m_parameterOverrides)
+	{
+		result &= ApplyParameter(assignment);
+	}
+	return result;
+}
+
+VtHeadlessEngine::SceneReport VtHeadlessEngine::RunScene(unsigned int sceneIndex, function<void(GameInstance*)> onFrame)
+{
+	auto scene = scenes[sceneIndex];
+	fmt::print("Info(Headless): Running scene [{}] for {} frames.\n", scene->name, m_numFrames);
+
+	// Animation callbacks only depend on the physics frame count, seed rand() so that anything random repeats as well
+	srand(0);
+
+	auto game = make_shared<GameInstance>(nullptr, nullptr);
+	scene->PopulateActors(game.get());
+	scene->onEnter.Invoke();
+	ApplyParameterOverrides();
+	game->Initialize();
+
+	SceneReport report;
+	report.name = scene->name;
+	report.numThreads = Global::simParams.numThreads;
+	report.phaseTimes = vector<double>(k_phaseLabels.size(), 0.0);
+	for (auto cloth : game->FindComponents<VtClothObjectCPU>())
+	{
+		report.numParticles += cloth->solver()->m_positions.size();
+	}
+	report.particleIterationsPerFrame = (double)report.numParticles * Global::simParams.numSubsteps * Global::simParams.numIterations;
+
+	auto cloths = game->FindComponents<VtClothObjectCPU>();
+	if (m_determinism)
+	{
+		for (auto cloth : cloths) cloth->solver()->convergence.enabled = true;
+	}
+	if (!m_residualPath.empty())
+	{
+		for (int c = 0; c < cloths.size(); c++)
+		{
+			auto solver = cloths[c]->solver();
+			solver->convergence.enabled = true;
+
+			string colliders;
+			for (auto collider : game->FindComponents<Collider>())
+			{
+				colliders += fmt::format("{}\"{}\"", colliders.empty() ? "" : ", ", collider->actor->name);
+			}
+			m_residualScenes.push_back(fmt::format("{{ \"scene\": \"{}\", \"cloth\": {}, \"particles\": {}, \"substeps\": {}, \"iterations\": {}, \"colliders\": [{}] }}",
+				scene->name, c, solver->m_positions.size(), Global::simParams.numSubsteps, Global::simParams.numIterations, colliders));
+		}
+	}
+
+	if (m_broadphaseStats)
+	{
+		for (auto cloth : cloths)
+		{
+			cloth->solver()->spatialHash()->collectStats = true;
+			report.broadphase.push_back(SceneReport::Broadphase());
+			report.broadphase.back().colliderContacts.resize(cloth->solver()->colliders().size());
+		}
+		for (auto collider : game->FindComponents<Collider>())
+		{
+			report.colliderNames.push_back(collider->actor->name);
+		}
+	}
+
+	double startTime = Timer::CurrentTime();
+	VT_PROFILE_FRAME();
+	for (int frame = 0; frame < m_numFrames; frame++)
+	{
+		if (frame == m_numWarmupFrames)
+		{
+			startTime = Timer::CurrentTime();
+			PerfCounters::Reset();
+		}
+
+		Timer::NextFixedFrameHeadless();
+		game->FixedStep();
+		VT_PROFILE_FRAME();
+
+		// First frame may still size buffers (e.g. the neighbor list), later frames must not allocate in solver scopes
+		if (frame == 0) AllocationTracker::Enable(true);
+
+		if (onFrame) onFrame(game.get());
+		if (m_memoryReport) report.memory.Sample(game.get());
+		if (!m_residualPath.empty())
+		{
+			for (int c = 0; c < cloths.size(); c++)
+			{
+				const auto& convergence = cloths[c]->solver()->convergence;
+				for (const auto& sample : convergence.samples)
+				{
+					const float* penetrations = convergence.PenetrationsOf(sample);
+					string penetrationText;
+					for (int i = 0; i < convergence.numColliders; i++)
+					{
+						penetrationText += fmt::format("{}{:.6g}", i > 0 ? ", " : "", penetrations[i]);
+					}
+					m_residualSamples.push_back(fmt::format("{{ \"scene\": \"{}\", \"cloth\": {}, \"frame\": {}, \"substep\": {}, \"iteration\": {}, "
+						"\"stretch_rms\": {:.6g}, \"stretch_max\": {:.6g}, \"bending_rms\": {:.6g}, \"bending_max\": {:.6g}, "
+						"\"attachment_rms\": {:.6g}, \"attachment_max\": {:.6g}, \"max_violation\": {:.6g}, \"penetration\": [{}], \"kinetic_energy\": {:.6g} }}",
+						scene->name, c, frame, sample.substep, sample.iteration, sample.stretchRms, sample.stretchMax, sample.bendingRms, sample.bendingMax,
+						sample.attachmentRms, sample.attachmentMax, sample.maxViolation, penetrationText, sample.kineticEnergy));
+				}
+			}
+		}
+		if (frame < m_numWarmupFrames) continue;
+
+		// Timer history and profiler frame times hold the accumulated time of the latest frame
+		report.frameTimes.push_back(Timer::GetTimer("Solver_Total") * 1000);
+		for (int i = 0; i < k_phaseLabels.size(); i++)
+		{
+			report.phaseTimes[i] += Profiler::FrameTime(k_phaseLabels[i]);
+		}
+		for (int c = 0; c < report.broadphase.size(); c++)
+		{
+			const auto& contacts = cloths[c]->solver()->contactStats;
+			auto& broadphase = report.broadphase[c];
+			broadphase.particleContacts += contacts.particleContacts;
+			for (int i = 0; i < contacts.colliderContacts.size(); i++)
+			{
+				broadphase.colliderContacts[i] += contacts.colliderContacts[i];
+			}
+		}
+	}
+	report.measuredWallTime = Timer::CurrentTime() - startTime;
+	report.numMeasuredFrames = (int)report.frameTimes.size();
+	for (int c = 0; c < report.broadphase.size(); c++)
+	{
+		auto& broadphase = report.broadphase[c];
+		broadphase.hash = cloths[c]->solver()->spatialHash()->stats;
+		broadphase.particleContacts /= max(report.numMeasuredFrames, 1);
+		for (auto& count : broadphase.colliderContacts) count /= max(report.numMeasuredFrames, 1);
+	}
+	if (m_perfCounters)
+	{
+		for (const auto& label : k_phaseLabels)
+		{
+			int id = Profiler::FindScope(label);
+			report.phaseCounters.push_back(id >= 0 ? PerfCounters::Totals(id) : PerfCounters::ScopeTotals());
+		}
+	}
+
+	AllocationTracker::Enable(false);
+	if (!AllocationTracker::Report(scene->name))
+	{
+		m_numAllocationFailures++;
+	}
+
+	game->Finalize();
+	scene->onExit.Invoke();
+	scene->ClearCallbacks();
+
+	return report;
+}
+
+void VtHeadlessEngine::PrintReport(const SceneReport& report)
+{
+	int frames = report.numMeasuredFrames;
+	double solverTime = accumulate(report.frameTimes.begin(), report.frameTimes.end(), 0.0) / 1000;
+
+	fmt::print("Info(Headless): Scene [{}] done\n", report.name);
+	fmt::print("  particles    : {}\n", report.numParticles);
+	fmt::print("  wall time    : {:.3f} s\n", report.measuredWallTime);
+	fmt::print("  steps/sec    : {:.2f}\n", frames / report.measuredWallTime);
+	fmt::print("  solver/frame : {:.3f} ms\n", solverTime * 1000 / frames);
+#ifdef VT_PROFILER
+	for (int i = 0; i < k_phaseLabels.size(); i++)
+	{
+		double avg = report.phaseTimes[i] * 1000 / frames;
+		double percent = solverTime > 0 ? report.phaseTimes[i] / solverTime * 100 : 0;
+		fmt::print("  {:<24} {:>8.3f} ms {:>6.1f}%\n", k_phaseLabels[i], avg, percent);
+	}
+#else
+	fmt::print("  (per-phase timing requires VT_PROFILER)\n");
+#endif
+
+	for (int c = 0; c < report.broadphase.size(); c++)
+	{
+		const auto& broadphase = report.broadphase[c];
+		fmt::print("  broadphase (cloth {})\n", c);
+		if (broadphase.hash.valid)
+		{
+			fmt::print("    hash       : {}\n", broadphase.hash.Summary());
+			string histogram;
+			for (int i = 0; i < VtBroadphaseStats::k_numHistogramBins; i++)
+			{
+				histogram += fmt::format("{}{}: {}", i > 0 ? ", " : "", VtBroadphaseStats::BinLabel(i), broadphase.hash.histogram[i]);
+			}
+			fmt::print("    neighbors  : {}\n", histogram);
+		}
+		else
+		{
+			fmt::print("    hash       : not rebuilt (self collision disabled)\n");
+		}
+		fmt::print("    contacts   : particles {:.1f}", broadphase.particleContacts);
+		for (int i = 0; i < broadphase.colliderContacts.size() && i < report.colliderNames.size(); i++)
+		{
+			fmt::print(", {} {:.1f}", report.colliderNames[i], broadphase.colliderContacts[i]);
+		}
+		fmt::print(" (mean per frame, latest pass)\n");
+	}
+
+	if (report.memory.numSamples > 0)
+	{
+		report.memory.Print();
+	}
+
+	if (report.phaseCounters.empty()) return;
+
+	// Counter values per call of a phase, divided by the number of particles.
+	// Counters the CPU or kernel did not provide are shown as n/a.
+	auto perParticle = [&](const PerfCounters::ScopeTotals& c, int counter) {
+		if (!PerfCounters::Available(counter) || c.calls == 0) return string("     n/a");
+		return fmt::format("{:>8.3f}", (double)c.values[counter] / c.calls / max(report.numParticles, (size_t)1));
+	};
+	fmt::print("  {:<24} {:>6} {:>8} {:>8} {:>8} {:>8}   (per particle and call)\n", "hardware counters", "IPC", "cycles", "L1D", "LLC", "branch");
+	for (int i = 0; i < k_phaseLabels.size(); i++)
+	{
+		const auto& c = report.phaseCounters[i];
+		if (c.calls == 0) continue;
+
+		double ipc = c.values[PerfCounters::Cycles] > 0 ? (double)c.values[PerfCounters::Instructions] / c.values[PerfCounters::Cycles] : 0;
+		string ipcText = PerfCounters::Available(PerfCounters::Instructions) ? fmt::format("{:>6.2f}", ipc) : "   n/a";
+		fmt::print("  {:<24} {} {} {} {} {}\n", k_phaseLabels[i], ipcText, perParticle(c, PerfCounters::Cycles),
+			perParticle(c, PerfCounters::L1DMisses), perParticle(c, PerfCounters::LLCMisses), perParticle(c, PerfCounters::BranchMisses));
+	}
+}
+
+int VtHeadlessEngine::RunBenchmark()
+{
+	// result records: one json object per line so that baselines can be read back without a json library
+	vector<string> records;
+	map<pair<string, int>, map<string, double>> current;
+	map<string, double> singleThreadSteps;
+
+	int defaultThreads = Global::simParams.numThreads;
+	for (int threads : m_threadCounts)
+	{
+		Global::simParams.numThreads = threads;
+		for (auto sceneIndex : m_sceneIndices)
+		{
+			auto report = RunScene(sceneIndex);
+
+			auto sorted = report.frameTimes;
+			sort(sorted.begin(), sorted.end());
+			double mean = accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+			double stepsPerSec = report.numMeasuredFrames / report.measuredWallTime;
+
+			// strong scaling is measured relative to the first thread count of the sweep
+			if (!singleThreadSteps.count(report.name)) singleThreadSteps[report.name] = stepsPerSec;
+			double speedup = stepsPerSec / singleThreadSteps[report.name];
+			double efficiency = speedup * m_threadCounts[0] / threads;
+
+			auto& metrics = current[{ report.name, threads }];
+			metrics["p50_ms"] = Percentile(sorted, 50);
+			metrics["p95_ms"] = Percentile(sorted, 95);
+			metrics["p99_ms"] = Percentile(sorted, 99);
+			metrics["max_ms"] = sorted.back();
+			metrics["steps_per_sec"] = stepsPerSec;
+
+			records.push_back(fmt::format("{{ \"scene\": \"{}\", \"threads\": {}, \"particles\": {}, \"frames\": {}, "
+				"\"mean_ms\": {:.4f}, \"p50_ms\": {:.4f}, \"p95_ms\": {:.4f}, \"p99_ms\": {:.4f}, \"max_ms\": {:.4f}, "
+				"\"steps_per_sec\": {:.2f}, \"particle_iterations_per_sec\": {:.4g}, \"speedup\": {:.3f}, \"efficiency\": {:.3f} }}",
+				report.name, threads, report.numParticles, report.numMeasuredFrames,
+				mean, metrics["p50_ms"], metrics["p95_ms"], metrics["p99_ms"], metrics["max_ms"],
+				stepsPerSec, report.particleIterationsPerFrame * stepsPerSec, speedup, efficiency));
+
+			fmt::print("Info(Benchmark): [{}] threads {} | p50 {:.3f} ms | p95 {:.3f} ms | p99 {:.3f} ms | max {:.3f} ms | {:.1f} steps/s | speedup {:.2f}\n",
+				report.name, threads, metrics["p50_ms"], metrics["p95_ms"], metrics["p99_ms"], metrics["max_ms"], stepsPerSec, speedup);
+		}
+	}
+	Global::simParams.numThreads = defaultThreads;
+
+	ofstream file(m_benchmarkPath);
+	if (!file.is_open())
+	{
+		fmt::print("Error(Benchmark): Unable to open [{}] for writing.\n", m_benchmarkPath);
+		return 1;
+	}
+	file << fmt::format("{{\n  \"frames\": {},\n  \"warmup\": {},\n  \"simd\": \"{}\",\n  \"results\": [\n", m_numFrames, m_numWarmupFrames, VtSimd::Name(VtSimd::Active()));
+	for (int i = 0; i < records.size(); i++)
+	{
+		file << "    " << records[i] << (i + 1 < records.size() ? ",\n" : "\n");
+	}
+	file << "  ]\n}\n";
+	file.close();
+	fmt::print("Info(Benchmark): Results written to [{}].\n", m_benchmarkPath);
+
+	if (m_baselinePath.empty())
+	{
+		return 0;
+	}
+
+	ifstream baselineFile(m_baselinePath);
+	if (!baselineFile.is_open())
+	{
+		fmt::print("Error(Benchmark): Unable to open baseline [{}].\n", m_baselinePath);
+		return 1;
+	}
+
+	int numRegressions = 0, numCompared = 0;
+	string line;
+	while (getline(baselineFile, line))
+	{
+		string scene, threads;
+		if (!FindJsonValue(line, "scene", scene) || !FindJsonValue(line, "threads", threads)) continue;
+
+		auto it = current.find({ scene, atoi(threads.c_str()) });
+		if (it == current.end()) continue;
+
+		for (const auto& metric : k_benchmarkMetrics)
+		{
+			string text;
+			if (!FindJsonValue(line, metric.key, text)) continue;
+			double base = atof(text.c_str());
+			double value = it->second[metric.key];
+			if (base <= 0) continue;
+
+			double change = (value - base) / base * 100.0;
+			double worse = metric.higherIsBetter ? -change : change;
+			numCompared++;
+			if (worse > m_regressionThreshold)
+			{
+				numRegressions++;
+				fmt::print("Warning(Benchmark): Regression [{}] threads {} {}: {:.4f} -> {:.4f} ({:+.1f}%)\n",
+					scene, threads, metric.key, base, value, change);
+			}
+		}
+	}
+
+	fmt::print("Info(Benchmark): Compared {} metrics against [{}], {} regression(s) above {:.1f}%.\n",
+		numCompared, m_baselinePath, numRegressions, m_regressionThreshold);
+	return numRegressions > 0 ? 2 : 0;
+}
+
+int VtHeadlessEngine::RunTrajectories()
+{
+	bool recording = !m_recordDir.empty();
+	const string& dir = recording ? m_recordDir : m_validateDir;
+	if (recording)
+	{
+		filesystem::create_directories(dir);
+	}
+
+	int numFailed = 0;
+	for (auto sceneIndex : m_sceneIndices)
+	{
+		auto path = (filesystem::path(dir) / SceneFileName(scenes[sceneIndex]->name)).string();
+
+		VtTrajectory reference;
+		if (!recording && !reference.Load(path))
+		{
+			numFailed++;
+			continue;
+		}
+		VtTrajectory trajectory;
+		RunScene(sceneIndex, [&trajectory](GameInstance* game) {
+			trajectory.frames.push_back(VtTrajectory::Capture(game));
+			trajectory.jacobi = Global::simParams.jacobiCPU;
+			});
+
+		if (recording)
+		{
+			if (trajectory.Save(path))
+			{
+				fmt::print("Info(Trajectory): Recorded {} frames of [{}] to [{}].\n", trajectory.frames.size(), scenes[sceneIndex]->name, path);
+			}
+			continue;
+		}
+
+		// Jacobi and Gauss-Seidel runs drift apart far beyond any tolerance that would still catch a regression in either
+		if (reference.jacobi != trajectory.jacobi)
+		{
+			const char* solvers[] = { "Gauss-Seidel", "Jacobi" };
+			fmt::print("Error(Trajectory): [{}] was recorded with the {} solver but [{}] ran {}. Record a reference with --set jacobiCPU={}.\n",
+				path, solvers[reference.jacobi], scenes[sceneIndex]->name, solvers[trajectory.jacobi], trajectory.jacobi ? 1 : 0);
+			numFailed++;
+			continue;
+		}
+
+		auto c = reference.Compare(trajectory, m_tolerance);
+		fmt::print("Info(Trajectory): [{}] {} over {} frames | position {:.5f} / {:.5f} | stretch {:+.5f} / {:.5f} | penetration {:+.5f} / {:.5f} | energy {:.4f} / {:.4f}\n",
+			scenes[sceneIndex]->name, c.Passed() ? "PASS" : fmt::format("FAIL at frame {}", c.firstFailedFrame), c.numFrames,
+			c.position, m_tolerance.position, c.stretch, m_tolerance.stretch, c.penetration, m_tolerance.penetration, c.energy, m_tolerance.energy);
+		if (!c.Passed() || c.numFrames < reference.frames.size())
+		{
+			numFailed++;
+		}
+	}
+
+	if (!recording)
+	{
+		fmt::print("Info(Trajectory): {} of {} scene(s) failed validation.\n", numFailed, m_sceneIndices.size());
+	}
+	return numFailed > 0 ? 3 : 0;
+}
+
+int VtHeadlessEngine::RunDeterminism()
+{
+	// Trajectory plus the residual samples of every iteration, which check the solver's fixed reduction order
+	struct Run
+	{
+		VtTrajectory trajectory;
+		vector<VtResidualSample> residuals;
+		double frameTime = 0;
+	};
+	auto run = [this](unsigned int sceneIndex, int threads, bool deterministic) {
+		Global::simParams.numThreads = threads;
+		Global::simParams.deterministic = deterministic;
+		Run result;
+		auto report = RunScene(sceneIndex, [&result](GameInstance* game) {
+			result.trajectory.frames.push_back(VtTrajectory::Capture(game));
+			for (auto cloth : game->FindComponents<VtClothObjectCPU>())
+			{
+				const auto& samples = cloth->solver()->convergence.samples;
+				result.residuals.insert(result.residuals.end(), samples.begin(), samples.end());
+			}
+			});
+		// Median solver time per frame, less noisy than the wall time of the run
+		sort(report.frameTimes.begin(), report.frameTimes.end());
+		result.frameTime = Percentile(report.frameTimes, 50);
+		return result;
+	};
+	auto sameResiduals = [](const vector<VtResidualSample>& a, const vector<VtResidualSample>& b) {
+		return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(VtResidualSample)) == 0;
+	};
+
+	auto defaultParams = Global::simParams;
+	int maxThreads = *max_element(m_threadCounts.begin(), m_threadCounts.end());
+	int numFailed = 0, numOverBudget = 0;
+	for (auto sceneIndex : m_sceneIndices)
+	{
+		const string& name = scenes[sceneIndex]->name;
+		Run reference = run(sceneIndex, m_threadCounts[0], true);
+		double deterministicTime = reference.frameTime;
+		for (size_t t = 1; t < m_threadCounts.size(); t++)
+		{
+			Run candidate = run(sceneIndex, m_threadCounts[t], true);
+			int frame = reference.trajectory.FirstMismatch(candidate.trajectory);
+			bool residualsMatch = sameResiduals(reference.residuals, candidate.residuals);
+			if (frame >= 0 || !residualsMatch)
+			{
+				fmt::print("Error(Determinism): [{}] {} threads differ from {} threads: {}.\n", name, m_threadCounts[t], m_threadCounts[0],
+					frame >= 0 ? fmt::format("positions at frame {}", frame) : string("residuals"));
+				numFailed++;
+			}
+			if (m_threadCounts[t] == maxThreads) deterministicTime = candidate.frameTime;
+		}
+
+		Run fast = run(sceneIndex, maxThreads, false);
+		double overhead = (deterministicTime / fast.frameTime - 1) * 100;
+		bool withinBudget = overhead <= m_overheadBudget;
+		numOverBudget += !withinBudget;
+		fmt::print("{}(Determinism): [{}] {} threads: deterministic {:.3f} ms, fast {:.3f} ms per frame, overhead {:+.1f}% (budget {:.1f}%)\n",
+			withinBudget ? "Info" : "Error", name, maxThreads, deterministicTime, fast.frameTime, overhead, m_overheadBudget);
+	}
+	Global::simParams = defaultParams;
+
+	fmt::print("Info(Determinism): {} of {} scene(s) not deterministic, {} over the overhead budget.\n", numFailed, m_sceneIndices.size(), numOverBudget);
+	return numFailed > 0 ? 5 : (numOverBudget > 0 ? 6 : 0);
+}
+
+bool VtHeadlessEngine::WriteResiduals()
+{
+	ofstream file(m_residualPath);
+	if (!file.is_open())
+	{
+		fmt::print("Error(Headless): Unable to open [{}] for writing.\n", m_residualPath);
+		return false;
+	}
+
+	auto writeArray = [&file](const char* name, const vector<string>& records, bool last) {
+		file << fmt::format("  \"{}\": [\n", name);
+		for (int i = 0; i < records.size(); i++)
+		{
+			file << "    " << records[i] << (i + 1 < records.size() ? ",\n" : "\n");
+		}
+		file << (last ? "  ]\n" : "  ],\n");
+	};
+
+	file << "{\n";
+	writeArray("scenes", m_residualScenes, false);
+	writeArray("samples", m_residualSamples, true);
+	file << "}\n";
+	fmt::print("Info(Headless): {} residual samples written to [{}].\n", m_residualSamples.size(), m_residualPath);
+	return true;
+}
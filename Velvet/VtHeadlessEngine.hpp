@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "VtTrajectory.hpp"
+#include "VtPerfCounters.hpp"
+#include "VtBroadphaseStats.hpp"
+#include "VtMemoryReport.hpp"
+
+using namespace std;
+
+namespace Velvet
+{
+	class Scene;
+	class GameInstance;
+
+	// Runs scenes without a window or graphics context.
+	// Each scene is stepped for a fixed number of physics frames and a timing report is printed.
+	// Only available when compiled with VT_HEADLESS (see VelvetHeadless project).
+	class VtHeadlessEngine
+	{
+	public:
+		// Run VelvetHeadless without arguments or with --help to print all options
+		VtHeadlessEngine(int argc, char** argv);
+
+		int Run();
+
+		void SetScenes(const vector<shared_ptr<Scene>>& scenes);
+
+		vector<shared_ptr<Scene>> scenes;
+	private:
+		struct SceneReport
+		{
+			string name;
+			int numThreads = 1;
+			size_t numParticles = 0;
+			int numMeasuredFrames = 0;
+			double measuredWallTime = 0;			// seconds, warmup frames excluded
+			double particleIterationsPerFrame = 0;	// particles * substeps * iterations
+			vector<double> frameTimes;				// solver time of each measured frame in ms
+			vector<double> phaseTimes;				// accumulated per-phase time in seconds
+			vector<PerfCounters::ScopeTotals> phaseCounters; // hardware counters per phase, empty without --perf-counters
+
+			// Per cloth, empty without --broadphase-stats
+			struct Broadphase
+			{
+				VtBroadphaseStats hash;				// latest rehash
+				double particleContacts = 0;		// mean over measured frames
+				vector<double> colliderContacts;	// mean over measured frames
+			};
+			vector<Broadphase> broadphase;
+			vector<string> colliderNames;
+
+			// Sampled after every frame with --memory-report, peaks include warmup frames
+			VtMemoryReport memory;
+		};
+
+		// onFrame is called after every physics frame, including warmup frames
+		SceneReport RunScene(unsigned int sceneIndex, function<void(GameInstance*)> onFrame = nullptr);
+		void PrintReport(const SceneReport& report);
+		int RunBenchmark();
+		int RunTrajectories();
+		int RunDeterminism();
+		bool WriteResiduals();
+		bool ApplyParameterOverrides();
+		bool ResolveScenes();
+		static void PrintUsage();
+
+		vector<string> m_sceneArgs;
+		vector<unsigned int> m_sceneIndices;
+		string m_tracePath;
+		int m_numFrames = 300;
+		int m_numWarmupFrames = 0;
+		bool m_listScenes = false;
+		bool m_perfCounters = false;
+		bool m_broadphaseStats = false;
+		bool m_memoryReport = false;
+		bool m_validArgs = true;
+		int m_numAllocationFailures = 0;	// only counted with VT_TRACK_ALLOCATIONS
+
+		// Macro benchmark: every scene x thread count, percentiles written to file and compared against a baseline
+		string m_benchmarkPath;
+		string m_baselinePath;
+		vector<int> m_threadCounts = { 1 };
+		double m_regressionThreshold = 10.0;
+
+		// Golden trajectories: record reference runs or validate the current solver variant against them
+		string m_recordDir;
+		string m_validateDir;
+		VtTrajectoryTolerance m_tolerance;
+
+		// Determinism check: every --threads count reproduces the first bit for bit, fast mode measures the overhead
+		bool m_determinism = false;
+		double m_overheadBudget = 5.0;
+
+		// Per-iteration solver residuals: one json record per scene and per sample
+		string m_residualPath;
+		vector<string> m_residualScenes;
+		vector<string> m_residualSamples;
+
+		// "name=value" assignments applied to Global::simParams after a scene sets its own parameters
+		vector<string> m_parameterOverrides;
+	};
+}
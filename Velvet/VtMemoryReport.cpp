@@ -0,0 +1,76 @@
+#include "VtMemoryReport.hpp"
+
+#include "GameInstance.hpp"
+#include "VtClothObjectCPU.hpp"
+#ifndef VT_HEADLESS
+#include "MeshRenderer.hpp"
+#include "Resource.hpp"
+#endif
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace Velvet;
+
+void VtMemoryReport::Sample(GameInstance* game)
+{
+	Begin();
+
+	// Cloth meshes are also drawn by a MeshRenderer, and cached meshes are reported with the resource cache
+	vector<const Mesh*> meshes;
+	auto addMesh = [&](const Mesh* mesh) {
+		if (mesh == nullptr || find(meshes.begin(), meshes.end(), mesh) != meshes.end()) return;
+		meshes.push_back(mesh);
+#ifndef VT_HEADLESS
+		if (Resource::IsCached(mesh)) return;
+#endif
+		Add("Mesh", "CPU arrays", mesh->cpuBytes());
+		Add("Mesh", "GL buffers", mesh->gpuBytes());
+	};
+
+	for (auto cloth : game->FindComponents<VtClothObjectCPU>())
+	{
+		auto solver = cloth->solver();
+		numParticles += solver->m_positions.size();
+		solver->ReportMemory(*this);
+		addMesh(cloth->mesh().get());
+	}
+#ifndef VT_HEADLESS
+	for (auto renderer : game->FindComponents<MeshRenderer>())
+	{
+		addMesh(renderer->mesh().get());
+	}
+	Resource::ReportMemory(*this);
+#endif
+
+	End();
+}
+
+size_t VtMemoryReport::ProcessPeakBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#elif defined(__linux__) || defined(__APPLE__)
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#include <fmt/core.h>
+
+namespace Velvet
+{
+	using namespace std;
+
+	class GameInstance;
+
+	// Bytes held by each subsystem, summed over all objects of a scene.
+	// A report is sampled repeatedly: Begin() clears the current bytes, Add() fills them and End() updates the
+	// high-water marks. Entries are keyed by string literals and kept between samples, so resampling does not allocate.
+	class VtMemoryReport
+	{
+	public:
+		struct Entry
+		{
+			const char* subsystem;
+			const char* name;
+			size_t bytes = 0;
+			size_t peakBytes = 0;
+		};
+
+		struct Subsystem
+		{
+			const char* name;
+			size_t bytes = 0;
+			size_t peakBytes = 0;
+		};
+
+		vector<Entry> entries;			// in order of first use
+		vector<Subsystem> subsystems;	// totals of the entries above
+		size_t numParticles = 0;		// of the latest sample
+		size_t totalBytes = 0;
+		size_t peakTotalBytes = 0;
+		size_t numSamples = 0;
+
+		// Allocated capacity, which is what a million-particle job has to fit in
+		template <class T, class Allocator>
+		static size_t Bytes(const vector<T, Allocator>& v)
+		{
+			return v.capacity() * sizeof(T);
+		}
+
+		void Begin()
+		{
+			for (auto& entry : entries) entry.bytes = 0;
+			numParticles = 0;
+		}
+
+		void Add(const char* subsystem, const char* name, size_t bytes)
+		{
+			auto it = find_if(entries.begin(), entries.end(), [&](const Entry& e) {
+				return strcmp(e.subsystem, subsystem) == 0 && strcmp(e.name, name) == 0;
+				});
+			if (it == entries.end())
+			{
+				entries.push_back({ subsystem, name });
+				it = entries.end() - 1;
+			}
+			it->bytes += bytes;
+		}
+
+		template <class T, class Allocator>
+		void Add(const char* subsystem, const char* name, const vector<T, Allocator>& v)
+		{
+			Add(subsystem, name, Bytes(v));
+		}
+
+		void End()
+		{
+			totalBytes = 0;
+			for (auto& subsystem : subsystems) subsystem.bytes = 0;
+			for (auto& entry : entries)
+			{
+				entry.peakBytes = max(entry.peakBytes, entry.bytes);
+				totalBytes += entry.bytes;
+
+				auto it = find_if(subsystems.begin(), subsystems.end(), [&](const Subsystem& s) {
+					return strcmp(s.name, entry.subsystem) == 0;
+					});
+				if (it == subsystems.end())
+				{
+					subsystems.push_back({ entry.subsystem });
+					it = subsystems.end() - 1;
+				}
+				it->bytes += entry.bytes;
+			}
+			for (auto& subsystem : subsystems) subsystem.peakBytes = max(subsystem.peakBytes, subsystem.bytes);
+			peakTotalBytes = max(peakTotalBytes, totalBytes);
+			numSamples++;
+		}
+
+		double BytesPerParticle(size_t bytes) const
+		{
+			return numParticles > 0 ? (double)bytes / numParticles : 0;
+		}
+
+		static string FormatBytes(size_t bytes)
+		{
+			if (bytes >= (1 << 20)) return fmt::format("{:.2f} MB", bytes / (1024.0 * 1024.0));
+			if (bytes >= (1 << 10)) return fmt::format("{:.1f} KB", bytes / 1024.0);
+			return fmt::format("{} B", bytes);
+		}
+
+		// Adds every solver, spatial hash and mesh of the game, plus the resource caches when rendering is compiled in
+		void Sample(GameInstance* game);
+
+		// Peak resident set size of the whole process, 0 where the platform does not report it
+		static size_t ProcessPeakBytes();
+
+		void Print() const
+		{
+			fmt::print("  {:<32} {:>12} {:>10} {:>12}\n", "memory (capacity)", "current", "B/particle", "peak");
+			for (const auto& subsystem : subsystems)
+			{
+				fmt::print("  {:<32} {:>12} {:>10.1f} {:>12}\n", subsystem.name, FormatBytes(subsystem.bytes),
+					BytesPerParticle(subsystem.bytes), FormatBytes(subsystem.peakBytes));
+				for (const auto& entry : entries)
+				{
+					if (strcmp(entry.subsystem, subsystem.name) != 0) continue;
+					fmt::print("    {:<30} {:>12} {:>10.1f} {:>12}\n", entry.name, FormatBytes(entry.bytes),
+						BytesPerParticle(entry.bytes), FormatBytes(entry.peakBytes));
+				}
+			}
+			fmt::print("  {:<32} {:>12} {:>10.1f} {:>12}\n", "total", FormatBytes(totalBytes),
+				BytesPerParticle(totalBytes), FormatBytes(peakTotalBytes));
+			size_t processPeak = ProcessPeakBytes();
+			if (processPeak > 0)
+			{
+				fmt::print("  {:<32} {:>12}\n", "process peak RSS", FormatBytes(processPeak));
+			}
+		}
+	};
+}
@@ -0,0 +1,714 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "VtSimd.hpp"
+#include "VtParticleStore.hpp"
+
+namespace Velvet
+{
+	// Analytic collider shape as seen by the vectorized CollideSDF branches
+	struct VtSdfShape
+	{
+		glm::mat4 velocityTransform;	// lastTransform * invCurTransform, see Collider::VelocityAt
+		glm::vec3 center;				// sphere only
+		float radius = 0;				// sphere only, collision margin included
+		float margin = 0;				// plane only
+	};
+
+	// Per-particle loops of VtClothSolverCPU over SoA streams, one variant per instruction set.
+	// Every variant performs the same float operations in the same order as the scalar code (no FMA,
+	// no reciprocal approximations), so results are bitwise identical whichever level is active.
+	// Kernels work on the particle range [begin, end); the remainder that does not fill a vector runs scalar.
+	class VtParticleKernels
+	{
+	public:
+		// v += g * dt; predicted = positions + v * dt
+		static void Predict(VtVec3Stream& predicted, VtVec3Stream& velocities, const VtVec3Stream& positions,
+			glm::vec3 gravity, float deltaTime, int begin, int end)
+		{
+			PredictArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), velocities.x.data(), velocities.y.data(), velocities.z.data(),
+				positions.x.data(), positions.y.data(), positions.z.data(), gravity * deltaTime, deltaTime };
+			switch (VtSimd::Active())
+			{
+#ifdef VT_SIMD_X86
+			case VtSimdLevel::AVX512: begin = PredictAvx512(a, begin, end); break;
+			case VtSimdLevel::AVX2: begin = PredictAvx2(a, begin, end); break;
+#endif
+			default: break;
+			}
+			PredictScalar(a, begin, end);
+		}
+
+		// v = (predicted - positions) / dt * (1 - damping * dt); positions = predicted
+		static void Finalize(VtVec3Stream& positions, VtVec3Stream& velocities, const VtVec3Stream& predicted,
+			float deltaTime, float damping, int begin, int end)
+		{
+			FinalizeArgs a{ positions.x.data(), positions.y.data(), positions.z.data(), velocities.x.data(), velocities.y.data(), velocities.z.data(),
+				predicted.x.data(), predicted.y.data(), predicted.z.data(), deltaTime, 1 - damping * deltaTime };
+			switch (VtSimd::Active())
+			{
+#ifdef VT_SIMD_X86
+			case VtSimdLevel::AVX512: begin = FinalizeAvx512(a, begin, end); break;
+			case VtSimdLevel::AVX2: begin = FinalizeAvx2(a, begin, end); break;
+#endif
+			default: break;
+			}
+			FinalizeScalar(a, begin, end);
+		}
+
+		// Predict with half-precision velocities: the velocity is updated in float, rounded once when stored, and the
+		// prediction uses the float value. The AVX2 variant needs F16C and falls back to scalar without it.
+		static void Predict(VtVec3Stream& predicted, VtHalfStream& velocities, const VtVec3Stream& positions,
+			glm::vec3 gravity, float deltaTime, int begin, int end)
+		{
+			PredictHalfArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), velocities.x.data(), velocities.y.data(), velocities.z.data(),
+				positions.x.data(), positions.y.data(), positions.z.data(), gravity * deltaTime, deltaTime };
+			switch (VtSimd::Active())
+			{
+#ifdef VT_SIMD_X86
+			case VtSimdLevel::AVX512: begin = PredictHalfAvx512(a, begin, end); break;
+			case VtSimdLevel::AVX2: if (VtSimd::HalfConversions()) begin = PredictHalfAvx2(a, begin, end); break;
+#endif
+			default: break;
+			}
+			PredictHalfScalar(a, begin, end);
+		}
+
+		static void Finalize(VtVec3Stream& positions, VtHalfStream& velocities, const VtVec3Stream& predicted,
+			float deltaTime, float damping, int begin, int end)
+		{
+			FinalizeHalfArgs a{ positions.x.data(), positions.y.data(), positions.z.data(), velocities.x.data(), velocities.y.data(), velocities.z.data(),
+				predicted.x.data(), predicted.y.data(), predicted.z.data(), deltaTime, 1 - damping * deltaTime };
+			switch (VtSimd::Active())
+			{
+#ifdef VT_SIMD_X86
+			case VtSimdLevel::AVX512: begin = FinalizeHalfAvx512(a, begin, end); break;
+			case VtSimdLevel::AVX2: if (VtSimd::HalfConversions()) begin = FinalizeHalfAvx2(a, begin, end); break;
+#endif
+			default: break;
+			}
+			FinalizeHalfScalar(a, begin, end);
+		}
+
+		// predicted += deltas / count * relaxation for particles with count > 0, then clears deltas and counts
+		static void ApplyDeltas(VtVec3Stream& predicted, VtVec3Stream& deltas, int* deltaCounts, float relaxation, int begin, int end)
+		{
+			DeltaArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), deltas.x.data(), deltas.y.data(), deltas.z.data(),
+				deltaCounts, relaxation };
+			switch (VtSimd::Active())
+			{
+#ifdef VT_SIMD_X86
+			case VtSimdLevel::AVX512: begin = ApplyDeltasAvx512(a, begin, end); break;
+			case VtSimdLevel::AVX2: begin = ApplyDeltasAvx2(a, begin, end); break;
+#endif
+			default: break;
+			}
+			ApplyDeltasScalar(a, begin, end);
+		}
+
+		// Same as Collider::ComputePlaneSDF / ComputeSphereSDF followed by friction (VtClothSolverCPU::CollideSDF).
+		// Returns the number of particles pushed out. TFriction has to match friction > 0; the variants without
+		// friction skip the collider velocity altogether.
+		template <bool TFriction>
+		static int CollidePlane(VtVec3Stream& predicted, const VtVec3Stream& positions, const VtSdfShape& shape,
+			float friction, float deltaTime, int begin, int end)
+		{
+			return Collide<false, TFriction>(predicted, positions, shape, friction, deltaTime, begin, end);
+		}
+
+		template <bool TFriction>
+		static int CollideSphere(VtVec3Stream& predicted, const VtVec3Stream& positions, const VtSdfShape& shape,
+			float friction, float deltaTime, int begin, int end)
+		{
+			return Collide<true, TFriction>(predicted, positions, shape, friction, deltaTime, begin, end);
+		}
+
+	private:
+		struct PredictArgs
+		{
+			float* qx, * qy, * qz;
+			float* vx, * vy, * vz;
+			const float* px, * py, * pz;
+			glm::vec3 gravityStep;
+			float dt;
+		};
+
+		struct FinalizeArgs
+		{
+			float* px, * py, * pz;
+			float* vx, * vy, * vz;
+			const float* qx, * qy, * qz;
+			float dt;
+			float damp;
+		};
+
+		struct PredictHalfArgs
+		{
+			float* qx, * qy, * qz;
+			uint16_t* vx, * vy, * vz;
+			const float* px, * py, * pz;
+			glm::vec3 gravityStep;
+			float dt;
+		};
+
+		struct FinalizeHalfArgs
+		{
+			float* px, * py, * pz;
+			uint16_t* vx, * vy, * vz;
+			const float* qx, * qy, * qz;
+			float dt;
+			float damp;
+		};
+
+		struct DeltaArgs
+		{
+			float* qx, * qy, * qz;
+			float* dx, * dy, * dz;
+			int* counts;
+			float relaxation;
+		};
+
+		struct CollideArgs
+		{
+			float* qx, * qy, * qz;
+			const float* px, * py, * pz;
+			const VtSdfShape* shape;
+			float friction;
+			float dt;
+		};
+
+		template <bool TSphere, bool TFriction>
+		static int Collide(VtVec3Stream& predicted, const VtVec3Stream& positions, const VtSdfShape& shape,
+			float friction, float deltaTime, int begin, int end)
+		{
+			CollideArgs a{ predicted.x.data(), predicted.y.data(), predicted.z.data(), positions.x.data(), positions.y.data(), positions.z.data(),
+				&shape, friction, deltaTime };
+			int contacts = 0;
+			switch (VtSimd::Active())
+			{
+#ifdef VT_SIMD_X86
+			case VtSimdLevel::AVX512: begin = CollideAvx512<TSphere, TFriction>(a, begin, end, contacts); break;
+			case VtSimdLevel::AVX2: begin = CollideAvx2<TSphere, TFriction>(a, begin, end, contacts); break;
+#endif
+			default: break;
+			}
+			return contacts + CollideScalar<TSphere, TFriction>(a, begin, end);
+		}
+
+	private: // Scalar
+
+		static void PredictScalar(const PredictArgs& a, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				a.vx[i] += a.gravityStep.x;
+				a.vy[i] += a.gravityStep.y;
+				a.vz[i] += a.gravityStep.z;
+				a.qx[i] = a.px[i] + a.vx[i] * a.dt;
+				a.qy[i] = a.py[i] + a.vy[i] * a.dt;
+				a.qz[i] = a.pz[i] + a.vz[i] * a.dt;
+			}
+		}
+
+		static void FinalizeScalar(const FinalizeArgs& a, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				a.vx[i] = (a.qx[i] - a.px[i]) / a.dt * a.damp;
+				a.vy[i] = (a.qy[i] - a.py[i]) / a.dt * a.damp;
+				a.vz[i] = (a.qz[i] - a.pz[i]) / a.dt * a.damp;
+				a.px[i] = a.qx[i];
+				a.py[i] = a.qy[i];
+				a.pz[i] = a.qz[i];
+			}
+		}
+
+		static void PredictHalfScalar(const PredictHalfArgs& a, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				float vx = VtHalf::Unpack(a.vx[i]) + a.gravityStep.x;
+				float vy = VtHalf::Unpack(a.vy[i]) + a.gravityStep.y;
+				float vz = VtHalf::Unpack(a.vz[i]) + a.gravityStep.z;
+				a.vx[i] = VtHalf::Pack(vx);
+				a.vy[i] = VtHalf::Pack(vy);
+				a.vz[i] = VtHalf::Pack(vz);
+				a.qx[i] = a.px[i] + vx * a.dt;
+				a.qy[i] = a.py[i] + vy * a.dt;
+				a.qz[i] = a.pz[i] + vz * a.dt;
+			}
+		}
+
+		static void FinalizeHalfScalar(const FinalizeHalfArgs& a, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				a.vx[i] = VtHalf::Pack((a.qx[i] - a.px[i]) / a.dt * a.damp);
+				a.vy[i] = VtHalf::Pack((a.qy[i] - a.py[i]) / a.dt * a.damp);
+				a.vz[i] = VtHalf::Pack((a.qz[i] - a.pz[i]) / a.dt * a.damp);
+				a.px[i] = a.qx[i];
+				a.py[i] = a.qy[i];
+				a.pz[i] = a.qz[i];
+			}
+		}
+
+		static void ApplyDeltasScalar(const DeltaArgs& a, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				float count = (float)a.counts[i];
+				if (count > 0)
+				{
+					a.qx[i] += a.dx[i] / count * a.relaxation;
+					a.qy[i] += a.dy[i] / count * a.relaxation;
+					a.qz[i] += a.dz[i] / count * a.relaxation;
+					a.dx[i] = a.dy[i] = a.dz[i] = 0;
+					a.counts[i] = 0;
+				}
+			}
+		}
+
+		template <bool TSphere, bool TFriction>
+		static int CollideScalar(const CollideArgs& a, int begin, int end)
+		{
+			const auto& shape = *a.shape;
+			int contacts = 0;
+			for (int i = begin; i < end; i++)
+			{
+				glm::vec3 pred(a.qx[i], a.qy[i], a.qz[i]);
+				glm::vec3 pos(a.px[i], a.py[i], a.pz[i]);
+
+				glm::vec3 correction(0);
+				if constexpr (TSphere)
+				{
+					auto diff = pred - shape.center;
+					float distance = glm::length(diff);
+					if (distance < shape.radius)
+					{
+						auto direction = diff / distance;
+						correction = (shape.radius - distance) * direction;
+					}
+				}
+				else if (pred.y < shape.margin)
+				{
+					correction = glm::vec3(0, shape.margin - pred.y, 0);
+				}
+				pred += correction;
+
+				if (glm::dot(correction, correction) > 0)
+				{
+					contacts++;
+					float correctionLength = glm::length(correction);
+					if (TFriction && correctionLength > 0)
+					{
+						glm::vec4 lastPos = shape.velocityTransform * glm::vec4(pred, 1.0);
+						glm::vec3 velocity = (pred - glm::vec3(lastPos)) / a.dt;
+						glm::vec3 relativeVelocity = pred - pos - velocity * a.dt;
+
+						glm::vec3 correctionNorm = correction / correctionLength;
+						glm::vec3 tangentialVelocity = relativeVelocity - correctionNorm * glm::dot(relativeVelocity, correctionNorm);
+						float tangentialLength = glm::length(tangentialVelocity);
+						float maxTangential = correctionLength * a.friction;
+						pred += -tangentialVelocity * min(maxTangential / tangentialLength, 1.0f);
+					}
+				}
+				a.qx[i] = pred.x;
+				a.qy[i] = pred.y;
+				a.qz[i] = pred.z;
+			}
+			return contacts;
+		}
+
+#ifdef VT_SIMD_X86
+	private: // AVX2, 8 particles per iteration
+
+		VT_TARGET_AVX2 static int PredictAvx2(const PredictArgs& a, int begin, int end)
+		{
+			const __m256 gx = _mm256_set1_ps(a.gravityStep.x), gy = _mm256_set1_ps(a.gravityStep.y), gz = _mm256_set1_ps(a.gravityStep.z);
+			const __m256 dt = _mm256_set1_ps(a.dt);
+			int i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				__m256 vx = _mm256_add_ps(_mm256_loadu_ps(a.vx + i), gx);
+				__m256 vy = _mm256_add_ps(_mm256_loadu_ps(a.vy + i), gy);
+				__m256 vz = _mm256_add_ps(_mm256_loadu_ps(a.vz + i), gz);
+				_mm256_storeu_ps(a.vx + i, vx);
+				_mm256_storeu_ps(a.vy + i, vy);
+				_mm256_storeu_ps(a.vz + i, vz);
+				_mm256_storeu_ps(a.qx + i, _mm256_add_ps(_mm256_loadu_ps(a.px + i), _mm256_mul_ps(vx, dt)));
+				_mm256_storeu_ps(a.qy + i, _mm256_add_ps(_mm256_loadu_ps(a.py + i), _mm256_mul_ps(vy, dt)));
+				_mm256_storeu_ps(a.qz + i, _mm256_add_ps(_mm256_loadu_ps(a.pz + i), _mm256_mul_ps(vz, dt)));
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX2 static int FinalizeAvx2(const FinalizeArgs& a, int begin, int end)
+		{
+			const __m256 dt = _mm256_set1_ps(a.dt), damp = _mm256_set1_ps(a.damp);
+			int i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				__m256 qx = _mm256_loadu_ps(a.qx + i), qy = _mm256_loadu_ps(a.qy + i), qz = _mm256_loadu_ps(a.qz + i);
+				_mm256_storeu_ps(a.vx + i, _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qx, _mm256_loadu_ps(a.px + i)), dt), damp));
+				_mm256_storeu_ps(a.vy + i, _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qy, _mm256_loadu_ps(a.py + i)), dt), damp));
+				_mm256_storeu_ps(a.vz + i, _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qz, _mm256_loadu_ps(a.pz + i)), dt), damp));
+				_mm256_storeu_ps(a.px + i, qx);
+				_mm256_storeu_ps(a.py + i, qy);
+				_mm256_storeu_ps(a.pz + i, qz);
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX2_F16C static __m256 LoadHalf8(const uint16_t* h)
+		{
+			return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)h));
+		}
+
+		VT_TARGET_AVX2_F16C static void StoreHalf8(uint16_t* h, __m256 value)
+		{
+			_mm_storeu_si128((__m128i*)h, _mm256_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+		}
+
+		VT_TARGET_AVX2_F16C static int PredictHalfAvx2(const PredictHalfArgs& a, int begin, int end)
+		{
+			const __m256 gx = _mm256_set1_ps(a.gravityStep.x), gy = _mm256_set1_ps(a.gravityStep.y), gz = _mm256_set1_ps(a.gravityStep.z);
+			const __m256 dt = _mm256_set1_ps(a.dt);
+			int i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				__m256 vx = _mm256_add_ps(LoadHalf8(a.vx + i), gx);
+				__m256 vy = _mm256_add_ps(LoadHalf8(a.vy + i), gy);
+				__m256 vz = _mm256_add_ps(LoadHalf8(a.vz + i), gz);
+				StoreHalf8(a.vx + i, vx);
+				StoreHalf8(a.vy + i, vy);
+				StoreHalf8(a.vz + i, vz);
+				_mm256_storeu_ps(a.qx + i, _mm256_add_ps(_mm256_loadu_ps(a.px + i), _mm256_mul_ps(vx, dt)));
+				_mm256_storeu_ps(a.qy + i, _mm256_add_ps(_mm256_loadu_ps(a.py + i), _mm256_mul_ps(vy, dt)));
+				_mm256_storeu_ps(a.qz + i, _mm256_add_ps(_mm256_loadu_ps(a.pz + i), _mm256_mul_ps(vz, dt)));
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX2_F16C static int FinalizeHalfAvx2(const FinalizeHalfArgs& a, int begin, int end)
+		{
+			const __m256 dt = _mm256_set1_ps(a.dt), damp = _mm256_set1_ps(a.damp);
+			int i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				__m256 qx = _mm256_loadu_ps(a.qx + i), qy = _mm256_loadu_ps(a.qy + i), qz = _mm256_loadu_ps(a.qz + i);
+				StoreHalf8(a.vx + i, _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qx, _mm256_loadu_ps(a.px + i)), dt), damp));
+				StoreHalf8(a.vy + i, _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qy, _mm256_loadu_ps(a.py + i)), dt), damp));
+				StoreHalf8(a.vz + i, _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qz, _mm256_loadu_ps(a.pz + i)), dt), damp));
+				_mm256_storeu_ps(a.px + i, qx);
+				_mm256_storeu_ps(a.py + i, qy);
+				_mm256_storeu_ps(a.pz + i, qz);
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX2 static int ApplyDeltasAvx2(const DeltaArgs& a, int begin, int end)
+		{
+			const __m256 relaxation = _mm256_set1_ps(a.relaxation), zero = _mm256_setzero_ps();
+			int i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				__m256i counts = _mm256_loadu_si256((const __m256i*)(a.counts + i));
+				__m256 count = _mm256_cvtepi32_ps(counts);
+				__m256 active = _mm256_cmp_ps(count, zero, _CMP_GT_OQ);
+				if (_mm256_movemask_ps(active) == 0) continue;
+
+				float* q[3] = { a.qx, a.qy, a.qz };
+				float* d[3] = { a.dx, a.dy, a.dz };
+				for (int axis = 0; axis < 3; axis++)
+				{
+					__m256 pred = _mm256_loadu_ps(q[axis] + i), delta = _mm256_loadu_ps(d[axis] + i);
+					__m256 updated = _mm256_add_ps(pred, _mm256_mul_ps(_mm256_div_ps(delta, count), relaxation));
+					_mm256_storeu_ps(q[axis] + i, _mm256_blendv_ps(pred, updated, active));
+					_mm256_storeu_ps(d[axis] + i, _mm256_blendv_ps(delta, zero, active));
+				}
+				_mm256_storeu_si256((__m256i*)(a.counts + i), _mm256_andnot_si256(_mm256_castps_si256(active), counts));
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX2 static __m256 LengthAvx2(__m256 x, __m256 y, __m256 z)
+		{
+			return _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+		}
+
+		template <bool TSphere, bool TFriction>
+		VT_TARGET_AVX2 static int CollideAvx2(const CollideArgs& a, int begin, int end, int& contacts)
+		{
+			const auto& shape = *a.shape;
+			const auto& m = shape.velocityTransform;
+			const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+			const __m256 dt = _mm256_set1_ps(a.dt), friction = _mm256_set1_ps(a.friction);
+			const __m256 cx = _mm256_set1_ps(shape.center.x), cy = _mm256_set1_ps(shape.center.y), cz = _mm256_set1_ps(shape.center.z);
+			const __m256 radius = _mm256_set1_ps(shape.radius), margin = _mm256_set1_ps(shape.margin);
+
+			int i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				__m256 qx = _mm256_loadu_ps(a.qx + i), qy = _mm256_loadu_ps(a.qy + i), qz = _mm256_loadu_ps(a.qz + i);
+
+				// correction, zero outside the shape
+				__m256 corrX, corrY, corrZ;
+				if constexpr (TSphere)
+				{
+					__m256 diffX = _mm256_sub_ps(qx, cx), diffY = _mm256_sub_ps(qy, cy), diffZ = _mm256_sub_ps(qz, cz);
+					__m256 distance = LengthAvx2(diffX, diffY, diffZ);
+					__m256 inside = _mm256_cmp_ps(distance, radius, _CMP_LT_OQ);
+					__m256 depth = _mm256_sub_ps(radius, distance);
+					corrX = _mm256_and_ps(inside, _mm256_mul_ps(depth, _mm256_div_ps(diffX, distance)));
+					corrY = _mm256_and_ps(inside, _mm256_mul_ps(depth, _mm256_div_ps(diffY, distance)));
+					corrZ = _mm256_and_ps(inside, _mm256_mul_ps(depth, _mm256_div_ps(diffZ, distance)));
+				}
+				else
+				{
+					__m256 below = _mm256_cmp_ps(qy, margin, _CMP_LT_OQ);
+					corrX = zero;
+					corrY = _mm256_and_ps(below, _mm256_sub_ps(margin, qy));
+					corrZ = zero;
+				}
+				qx = _mm256_add_ps(qx, corrX);
+				qy = _mm256_add_ps(qy, corrY);
+				qz = _mm256_add_ps(qz, corrZ);
+
+				__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(corrX, corrX), _mm256_mul_ps(corrY, corrY)), _mm256_mul_ps(corrZ, corrZ));
+				__m256 contact = _mm256_cmp_ps(dot, zero, _CMP_GT_OQ);
+				int mask = _mm256_movemask_ps(contact);
+				if (mask != 0)
+				{
+					contacts += VtSimd::PopCount(mask);
+
+					if constexpr (TFriction)
+					{
+						// collider velocity at the corrected position (Collider::VelocityAt)
+						__m256 lastX = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0][0]), qx), _mm256_mul_ps(_mm256_set1_ps(m[1][0]), qy)),
+							_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2][0]), qz), _mm256_set1_ps(m[3][0])));
+						__m256 lastY = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0][1]), qx), _mm256_mul_ps(_mm256_set1_ps(m[1][1]), qy)),
+							_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2][1]), qz), _mm256_set1_ps(m[3][1])));
+						__m256 lastZ = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0][2]), qx), _mm256_mul_ps(_mm256_set1_ps(m[1][2]), qy)),
+							_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2][2]), qz), _mm256_set1_ps(m[3][2])));
+						__m256 relX = _mm256_sub_ps(_mm256_sub_ps(qx, _mm256_loadu_ps(a.px + i)), _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qx, lastX), dt), dt));
+						__m256 relY = _mm256_sub_ps(_mm256_sub_ps(qy, _mm256_loadu_ps(a.py + i)), _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qy, lastY), dt), dt));
+						__m256 relZ = _mm256_sub_ps(_mm256_sub_ps(qz, _mm256_loadu_ps(a.pz + i)), _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(qz, lastZ), dt), dt));
+
+						__m256 correctionLength = _mm256_sqrt_ps(dot);
+						__m256 nx = _mm256_div_ps(corrX, correctionLength), ny = _mm256_div_ps(corrY, correctionLength), nz = _mm256_div_ps(corrZ, correctionLength);
+						__m256 normalVelocity = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(relX, nx), _mm256_mul_ps(relY, ny)), _mm256_mul_ps(relZ, nz));
+						__m256 tx = _mm256_sub_ps(relX, _mm256_mul_ps(nx, normalVelocity));
+						__m256 ty = _mm256_sub_ps(relY, _mm256_mul_ps(ny, normalVelocity));
+						__m256 tz = _mm256_sub_ps(relZ, _mm256_mul_ps(nz, normalVelocity));
+						__m256 tangentialLength = LengthAvx2(tx, ty, tz);
+						__m256 maxTangential = _mm256_mul_ps(correctionLength, friction);
+						__m256 scale = _mm256_min_ps(one, _mm256_div_ps(maxTangential, tangentialLength));
+						const __m256 sign = _mm256_set1_ps(-0.0f);
+						qx = _mm256_blendv_ps(qx, _mm256_add_ps(qx, _mm256_mul_ps(_mm256_xor_ps(tx, sign), scale)), contact);
+						qy = _mm256_blendv_ps(qy, _mm256_add_ps(qy, _mm256_mul_ps(_mm256_xor_ps(ty, sign), scale)), contact);
+						qz = _mm256_blendv_ps(qz, _mm256_add_ps(qz, _mm256_mul_ps(_mm256_xor_ps(tz, sign), scale)), contact);
+					}
+				}
+				_mm256_storeu_ps(a.qx + i, qx);
+				_mm256_storeu_ps(a.qy + i, qy);
+				_mm256_storeu_ps(a.qz + i, qz);
+			}
+			return i;
+		}
+
+	private: // AVX-512, 16 particles per iteration
+
+		VT_TARGET_AVX512 static int PredictAvx512(const PredictArgs& a, int begin, int end)
+		{
+			const __m512 gx = _mm512_set1_ps(a.gravityStep.x), gy = _mm512_set1_ps(a.gravityStep.y), gz = _mm512_set1_ps(a.gravityStep.z);
+			const __m512 dt = _mm512_set1_ps(a.dt);
+			int i = begin;
+			for (; i + 16 <= end; i += 16)
+			{
+				__m512 vx = _mm512_add_ps(_mm512_loadu_ps(a.vx + i), gx);
+				__m512 vy = _mm512_add_ps(_mm512_loadu_ps(a.vy + i), gy);
+				__m512 vz = _mm512_add_ps(_mm512_loadu_ps(a.vz + i), gz);
+				_mm512_storeu_ps(a.vx + i, vx);
+				_mm512_storeu_ps(a.vy + i, vy);
+				_mm512_storeu_ps(a.vz + i, vz);
+				_mm512_storeu_ps(a.qx + i, _mm512_add_ps(_mm512_loadu_ps(a.px + i), _mm512_mul_ps(vx, dt)));
+				_mm512_storeu_ps(a.qy + i, _mm512_add_ps(_mm512_loadu_ps(a.py + i), _mm512_mul_ps(vy, dt)));
+				_mm512_storeu_ps(a.qz + i, _mm512_add_ps(_mm512_loadu_ps(a.pz + i), _mm512_mul_ps(vz, dt)));
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX512 static int FinalizeAvx512(const FinalizeArgs& a, int begin, int end)
+		{
+			const __m512 dt = _mm512_set1_ps(a.dt), damp = _mm512_set1_ps(a.damp);
+			int i = begin;
+			for (; i + 16 <= end; i += 16)
+			{
+				__m512 qx = _mm512_loadu_ps(a.qx + i), qy = _mm512_loadu_ps(a.qy + i), qz = _mm512_loadu_ps(a.qz + i);
+				_mm512_storeu_ps(a.vx + i, _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qx, _mm512_loadu_ps(a.px + i)), dt), damp));
+				_mm512_storeu_ps(a.vy + i, _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qy, _mm512_loadu_ps(a.py + i)), dt), damp));
+				_mm512_storeu_ps(a.vz + i, _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qz, _mm512_loadu_ps(a.pz + i)), dt), damp));
+				_mm512_storeu_ps(a.px + i, qx);
+				_mm512_storeu_ps(a.py + i, qy);
+				_mm512_storeu_ps(a.pz + i, qz);
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX512 static __m512 LoadHalf16(const uint16_t* h)
+		{
+			return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)h));
+		}
+
+		VT_TARGET_AVX512 static void StoreHalf16(uint16_t* h, __m512 value)
+		{
+			_mm256_storeu_si256((__m256i*)h, _mm512_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+		}
+
+		VT_TARGET_AVX512 static int PredictHalfAvx512(const PredictHalfArgs& a, int begin, int end)
+		{
+			const __m512 gx = _mm512_set1_ps(a.gravityStep.x), gy = _mm512_set1_ps(a.gravityStep.y), gz = _mm512_set1_ps(a.gravityStep.z);
+			const __m512 dt = _mm512_set1_ps(a.dt);
+			int i = begin;
+			for (; i + 16 <= end; i += 16)
+			{
+				__m512 vx = _mm512_add_ps(LoadHalf16(a.vx + i), gx);
+				__m512 vy = _mm512_add_ps(LoadHalf16(a.vy + i), gy);
+				__m512 vz = _mm512_add_ps(LoadHalf16(a.vz + i), gz);
+				StoreHalf16(a.vx + i, vx);
+				StoreHalf16(a.vy + i, vy);
+				StoreHalf16(a.vz + i, vz);
+				_mm512_storeu_ps(a.qx + i, _mm512_add_ps(_mm512_loadu_ps(a.px + i), _mm512_mul_ps(vx, dt)));
+				_mm512_storeu_ps(a.qy + i, _mm512_add_ps(_mm512_loadu_ps(a.py + i), _mm512_mul_ps(vy, dt)));
+				_mm512_storeu_ps(a.qz + i, _mm512_add_ps(_mm512_loadu_ps(a.pz + i), _mm512_mul_ps(vz, dt)));
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX512 static int FinalizeHalfAvx512(const FinalizeHalfArgs& a, int begin, int end)
+		{
+			const __m512 dt = _mm512_set1_ps(a.dt), damp = _mm512_set1_ps(a.damp);
+			int i = begin;
+			for (; i + 16 <= end; i += 16)
+			{
+				__m512 qx = _mm512_loadu_ps(a.qx + i), qy = _mm512_loadu_ps(a.qy + i), qz = _mm512_loadu_ps(a.qz + i);
+				StoreHalf16(a.vx + i, _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qx, _mm512_loadu_ps(a.px + i)), dt), damp));
+				StoreHalf16(a.vy + i, _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qy, _mm512_loadu_ps(a.py + i)), dt), damp));
+				StoreHalf16(a.vz + i, _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qz, _mm512_loadu_ps(a.pz + i)), dt), damp));
+				_mm512_storeu_ps(a.px + i, qx);
+				_mm512_storeu_ps(a.py + i, qy);
+				_mm512_storeu_ps(a.pz + i, qz);
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX512 static int ApplyDeltasAvx512(const DeltaArgs& a, int begin, int end)
+		{
+			const __m512 relaxation = _mm512_set1_ps(a.relaxation), zero = _mm512_setzero_ps();
+			int i = begin;
+			for (; i + 16 <= end; i += 16)
+			{
+				__m512i counts = _mm512_loadu_si512(a.counts + i);
+				__m512 count = _mm512_cvtepi32_ps(counts);
+				__mmask16 active = _mm512_cmp_ps_mask(count, zero, _CMP_GT_OQ);
+				if (active == 0) continue;
+
+				float* q[3] = { a.qx, a.qy, a.qz };
+				float* d[3] = { a.dx, a.dy, a.dz };
+				for (int axis = 0; axis < 3; axis++)
+				{
+					__m512 pred = _mm512_loadu_ps(q[axis] + i), delta = _mm512_loadu_ps(d[axis] + i);
+					__m512 updated = _mm512_add_ps(pred, _mm512_mul_ps(_mm512_div_ps(delta, count), relaxation));
+					_mm512_storeu_ps(q[axis] + i, _mm512_mask_blend_ps(active, pred, updated));
+					_mm512_storeu_ps(d[axis] + i, _mm512_mask_blend_ps(active, delta, zero));
+				}
+				_mm512_storeu_si512(a.counts + i, _mm512_mask_blend_epi32(active, counts, _mm512_setzero_si512()));
+			}
+			return i;
+		}
+
+		VT_TARGET_AVX512 static __m512 LengthAvx512(__m512 x, __m512 y, __m512 z)
+		{
+			return _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y)), _mm512_mul_ps(z, z)));
+		}
+
+		template <bool TSphere, bool TFriction>
+		VT_TARGET_AVX512 static int CollideAvx512(const CollideArgs& a, int begin, int end, int& contacts)
+		{
+			const auto& shape = *a.shape;
+			const auto& m = shape.velocityTransform;
+			const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+			const __m512 dt = _mm512_set1_ps(a.dt), friction = _mm512_set1_ps(a.friction);
+			const __m512 cx = _mm512_set1_ps(shape.center.x), cy = _mm512_set1_ps(shape.center.y), cz = _mm512_set1_ps(shape.center.z);
+			const __m512 radius = _mm512_set1_ps(shape.radius), margin = _mm512_set1_ps(shape.margin);
+
+			int i = begin;
+			for (; i + 16 <= end; i += 16)
+			{
+				__m512 qx = _mm512_loadu_ps(a.qx + i), qy = _mm512_loadu_ps(a.qy + i), qz = _mm512_loadu_ps(a.qz + i);
+
+				__m512 corrX, corrY, corrZ;
+				if constexpr (TSphere)
+				{
+					__m512 diffX = _mm512_sub_ps(qx, cx), diffY = _mm512_sub_ps(qy, cy), diffZ = _mm512_sub_ps(qz, cz);
+					__m512 distance = LengthAvx512(diffX, diffY, diffZ);
+					__mmask16 inside = _mm512_cmp_ps_mask(distance, radius, _CMP_LT_OQ);
+					__m512 depth = _mm512_sub_ps(radius, distance);
+					corrX = _mm512_maskz_mul_ps(inside, depth, _mm512_div_ps(diffX, distance));
+					corrY = _mm512_maskz_mul_ps(inside, depth, _mm512_div_ps(diffY, distance));
+					corrZ = _mm512_maskz_mul_ps(inside, depth, _mm512_div_ps(diffZ, distance));
+				}
+				else
+				{
+					__mmask16 below = _mm512_cmp_ps_mask(qy, margin, _CMP_LT_OQ);
+					corrX = zero;
+					corrY = _mm512_maskz_sub_ps(below, margin, qy);
+					corrZ = zero;
+				}
+				qx = _mm512_add_ps(qx, corrX);
+				qy = _mm512_add_ps(qy, corrY);
+				qz = _mm512_add_ps(qz, corrZ);
+
+				__m512 dot = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(corrX, corrX), _mm512_mul_ps(corrY, corrY)), _mm512_mul_ps(corrZ, corrZ));
+				__mmask16 contact = _mm512_cmp_ps_mask(dot, zero, _CMP_GT_OQ);
+				if (contact != 0)
+				{
+					contacts += VtSimd::PopCount(contact);
+
+					if constexpr (TFriction)
+					{
+						__m512 lastX = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(m[0][0]), qx), _mm512_mul_ps(_mm512_set1_ps(m[1][0]), qy)),
+							_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(m[2][0]), qz), _mm512_set1_ps(m[3][0])));
+						__m512 lastY = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(m[0][1]), qx), _mm512_mul_ps(_mm512_set1_ps(m[1][1]), qy)),
+							_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(m[2][1]), qz), _mm512_set1_ps(m[3][1])));
+						__m512 lastZ = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(m[0][2]), qx), _mm512_mul_ps(_mm512_set1_ps(m[1][2]), qy)),
+							_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(m[2][2]), qz), _mm512_set1_ps(m[3][2])));
+						__m512 relX = _mm512_sub_ps(_mm512_sub_ps(qx, _mm512_loadu_ps(a.px + i)), _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qx, lastX), dt), dt));
+						__m512 relY = _mm512_sub_ps(_mm512_sub_ps(qy, _mm512_loadu_ps(a.py + i)), _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qy, lastY), dt), dt));
+						__m512 relZ = _mm512_sub_ps(_mm512_sub_ps(qz, _mm512_loadu_ps(a.pz + i)), _mm512_mul_ps(_mm512_div_ps(_mm512_sub_ps(qz, lastZ), dt), dt));
+
+						__m512 correctionLength = _mm512_sqrt_ps(dot);
+						__m512 nx = _mm512_div_ps(corrX, correctionLength), ny = _mm512_div_ps(corrY, correctionLength), nz = _mm512_div_ps(corrZ, correctionLength);
+						__m512 normalVelocity = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(relX, nx), _mm512_mul_ps(relY, ny)), _mm512_mul_ps(relZ, nz));
+						__m512 tx = _mm512_sub_ps(relX, _mm512_mul_ps(nx, normalVelocity));
+						__m512 ty = _mm512_sub_ps(relY, _mm512_mul_ps(ny, normalVelocity));
+						__m512 tz = _mm512_sub_ps(relZ, _mm512_mul_ps(nz, normalVelocity));
+						__m512 tangentialLength = LengthAvx512(tx, ty, tz);
+						__m512 maxTangential = _mm512_mul_ps(correctionLength, friction);
+						__m512 scale = _mm512_min_ps(one, _mm512_div_ps(maxTangential, tangentialLength));
+						const __m512 minusOne = _mm512_set1_ps(-1.0f);
+						qx = _mm512_mask_add_ps(qx, contact, qx, _mm512_mul_ps(_mm512_mul_ps(tx, minusOne), scale));
+						qy = _mm512_mask_add_ps(qy, contact, qy, _mm512_mul_ps(_mm512_mul_ps(ty, minusOne), scale));
+						qz = _mm512_mask_add_ps(qz, contact, qz, _mm512_mul_ps(_mm512_mul_ps(tz, minusOne), scale));
+					}
+				}
+				_mm512_storeu_ps(a.qx + i, qx);
+				_mm512_storeu_ps(a.qy + i, qy);
+				_mm512_storeu_ps(a.qz + i, qz);
+			}
+			return i;
+		}
+#endif
+	};
+}
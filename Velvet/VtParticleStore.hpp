@@ -0,0 +1,356 @@
+#pragma once
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include <glm/glm.hpp>
+
+#include "VtArena.hpp"
+
+namespace Velvet
+{
+	using namespace std;
+
+	// While alive, elements that VtAlignedVector makes without a value (resize(n), vector(n)) are default-initialized,
+	// which leaves trivial types unwritten, instead of being zeroed. Nests like VtArena::Scope.
+	class VtDefaultInitScope
+	{
+	public:
+		VtDefaultInitScope() : m_previous(t_active)
+		{
+			t_active = true;
+		}
+
+		~VtDefaultInitScope()
+		{
+			t_active = m_previous;
+		}
+
+		VtDefaultInitScope(const VtDefaultInitScope&) = delete;
+		VtDefaultInitScope& operator=(const VtDefaultInitScope&) = delete;
+
+		static bool Active()
+		{
+			return t_active;
+		}
+
+	private:
+		bool m_previous;
+		inline static thread_local bool t_active = false;
+	};
+
+	// Allocates on cache line boundaries, so that every stream starts on a full SIMD vector. Inside a VtArena::Scope the
+	// memory comes from that arena and is only reclaimed when the arena is reset.
+	template <class T, size_t Alignment = 64>
+	struct VtAlignedAllocator
+	{
+		using value_type = T;
+
+		template <class U>
+		struct rebind
+		{
+			using other = VtAlignedAllocator<U, Alignment>;
+		};
+
+		VtAlignedAllocator() = default;
+
+		template <class U>
+		VtAlignedAllocator(const VtAlignedAllocator<U, Alignment>&) {}
+
+		T* allocate(size_t n)
+		{
+			if (VtArena* arena = VtArena::Current())
+			{
+				if (void* p = arena->Allocate(n * sizeof(T), Alignment)) return static_cast<T*>(p);
+			}
+			return static_cast<T*>(::operator new(n * sizeof(T), align_val_t(Alignment)));
+		}
+
+		void deallocate(T* p, size_t)
+		{
+			if (VtArena::Owns(p)) return;
+			::operator delete(p, align_val_t(Alignment));
+		}
+
+		template <class U>
+		void construct(U* p)
+		{
+			if (VtDefaultInitScope::Active())
+			{
+				::new (static_cast<void*>(p)) U;
+			}
+			else
+			{
+				::new (static_cast<void*>(p)) U();
+			}
+		}
+
+		template <class U, class... TArgs>
+		void construct(U* p, TArgs&&... args)
+		{
+			::new (static_cast<void*>(p)) U(forward<TArgs>(args)...);
+		}
+
+		template <class U>
+		bool operator==(const VtAlignedAllocator<U, Alignment>&) const { return true; }
+		template <class U>
+		bool operator!=(const VtAlignedAllocator<U, Alignment>&) const { return false; }
+	};
+
+	template <class T>
+	using VtAlignedVector = vector<T, VtAlignedAllocator<T>>;
+
+	// Moves v into new heap memory whose parts are first written by the threads that run the chunks of forEachChunk(body),
+	// where body(begin, end) takes an element range like a ParallelFor body and the ranges cover all of v. Every element
+	// is copied once, by the thread of its chunk. Linux and Windows place a page on the NUMA node of the thread that
+	// first touches it, so partitioning like the sweeps that use v keeps every part near its worker. Only fresh memory is
+	// placed this way, which large heap blocks are; arena pages may have been touched by an earlier owner.
+	template <class T, class TForEachChunk>
+	void VtFirstTouch(VtAlignedVector<T>& v, const TForEachChunk& forEachChunk)
+	{
+		static_assert(is_trivially_copyable<T>::value, "first touch copies raw bytes");
+		if (v.empty()) return;
+		VtAlignedVector<T> placed;
+		{
+			VtArena::Scope heap(nullptr);
+			VtDefaultInitScope unwritten;
+			placed.resize(v.size());
+		}
+		T* data = placed.data();
+		const T* source = v.data();
+		forEachChunk([&](int begin, int end) {
+			memcpy(data + begin, source + begin, (end - begin) * sizeof(T));
+			});
+		v = move(placed);
+	}
+
+	// IEEE half precision (fp16) conversions, rounding to nearest even like the F16C and AVX-512 instructions, so that
+	// scalar and vectorized kernels store the same bits. NaN payloads are not preserved.
+	struct VtHalf
+	{
+		static uint16_t Pack(float value)
+		{
+			uint32_t f;
+			memcpy(&f, &value, sizeof(f));
+			uint32_t sign = (f >> 16) & 0x8000;
+			uint32_t magnitude = f & 0x7FFFFFFF;
+			if (magnitude > 0x7F800000) return (uint16_t)(sign | 0x7E00);
+			// 65520 and above round to infinity
+			if (magnitude >= 0x477FF000) return (uint16_t)(sign | 0x7C00);
+			if (magnitude < 0x38800000)
+			{
+				// Subnormal: units of 2^-24
+				uint32_t shift = 126 - (magnitude >> 23);
+				if (shift > 24) return (uint16_t)sign;
+				uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+				uint32_t h = mantissa >> shift;
+				uint32_t remainder = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+				if (remainder > halfway || (remainder == halfway && (h & 1))) h++;
+				return (uint16_t)(sign | h);
+			}
+			uint32_t h = (magnitude >> 13) - (112 << 10);
+			uint32_t remainder = magnitude & 0x1FFF;
+			if (remainder > 0x1000 || (remainder == 0x1000 && (h & 1))) h++;
+			return (uint16_t)(sign | h);
+		}
+
+		static float Unpack(uint16_t h)
+		{
+			uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+			uint32_t exponent = (h >> 10) & 0x1F, mantissa = h & 0x3FF;
+			uint32_t f;
+			if (exponent == 0x1F)
+			{
+				f = sign | 0x7F800000 | (mantissa << 13);
+			}
+			else if (exponent != 0)
+			{
+				f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+			}
+			else if (mantissa == 0)
+			{
+				f = sign;
+			}
+			else
+			{
+				uint32_t e = 113;
+				while ((mantissa & 0x400) == 0)
+				{
+					mantissa <<= 1;
+					e--;
+				}
+				f = sign | (e << 23) | ((mantissa & 0x3FF) << 13);
+			}
+			float value;
+			memcpy(&value, &f, sizeof(value));
+			return value;
+		}
+	};
+
+	// Structure-of-arrays storage for one vec3 per particle: separate x, y and z streams.
+	// Per-particle kernels (see VtParticleKernels) load full SIMD vectors from each stream;
+	// gather-style code reads and writes single particles through operator[], Set, Add and Sub.
+	class VtVec3Stream
+	{
+	public:
+		VtAlignedVector<float> x, y, z;
+
+		VtVec3Stream() = default;
+
+		explicit VtVec3Stream(size_t n, glm::vec3 value = glm::vec3(0))
+		{
+			Resize(n, value);
+		}
+
+		size_t size() const
+		{
+			return x.size();
+		}
+
+		bool empty() const
+		{
+			return x.empty();
+		}
+
+		void Resize(size_t n, glm::vec3 value = glm::vec3(0))
+		{
+			x.resize(n, value.x);
+			y.resize(n, value.y);
+			z.resize(n, value.z);
+		}
+
+		glm::vec3 operator[](size_t i) const
+		{
+			return glm::vec3(x[i], y[i], z[i]);
+		}
+
+		void Set(size_t i, glm::vec3 value)
+		{
+			x[i] = value.x;
+			y[i] = value.y;
+			z[i] = value.z;
+		}
+
+		void Add(size_t i, glm::vec3 value)
+		{
+			x[i] += value.x;
+			y[i] += value.y;
+			z[i] += value.z;
+		}
+
+		void Sub(size_t i, glm::vec3 value)
+		{
+			x[i] -= value.x;
+			y[i] -= value.y;
+			z[i] -= value.z;
+		}
+
+		// Stream of one axis: 0 = x, 1 = y, 2 = z
+		float* Axis(int axis)
+		{
+			return axis == 0 ? x.data() : (axis == 1 ? y.data() : z.data());
+		}
+
+		void Fill(glm::vec3 value)
+		{
+			fill(x.begin(), x.end(), value.x);
+			fill(y.begin(), y.end(), value.y);
+			fill(z.begin(), z.end(), value.z);
+		}
+
+		void Assign(const vector<glm::vec3>& values)
+		{
+			Resize(values.size());
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				Set(i, values[i]);
+			}
+		}
+
+		// Interleaves into an array of structures, e.g. for mesh upload. Does not allocate once output has the right size.
+		template <class Allocator>
+		void CopyTo(vector<glm::vec3, Allocator>& output) const
+		{
+			output.resize(size());
+			for (size_t i = 0; i < output.size(); i++)
+			{
+				output[i] = glm::vec3(x[i], y[i], z[i]);
+			}
+		}
+
+		// See VtFirstTouch()
+		template <class TForEachChunk>
+		void FirstTouch(const TForEachChunk& forEachChunk)
+		{
+			VtFirstTouch(x, forEachChunk);
+			VtFirstTouch(y, forEachChunk);
+			VtFirstTouch(z, forEachChunk);
+		}
+
+		size_t capacityBytes() const
+		{
+			return (x.capacity() + y.capacity() + z.capacity()) * sizeof(float);
+		}
+	};
+
+	// VtVec3Stream in half precision, for state that tolerates 11 significant bits (VtSimParams::compactState).
+	// Kernels convert to float on load and round once on store; element access converts the same way.
+	class VtHalfStream
+	{
+	public:
+		VtAlignedVector<uint16_t> x, y, z;
+
+		size_t size() const
+		{
+			return x.size();
+		}
+
+		bool empty() const
+		{
+			return x.empty();
+		}
+
+		void Resize(size_t n, glm::vec3 value = glm::vec3(0))
+		{
+			x.resize(n, VtHalf::Pack(value.x));
+			y.resize(n, VtHalf::Pack(value.y));
+			z.resize(n, VtHalf::Pack(value.z));
+		}
+
+		glm::vec3 operator[](size_t i) const
+		{
+			return glm::vec3(VtHalf::Unpack(x[i]), VtHalf::Unpack(y[i]), VtHalf::Unpack(z[i]));
+		}
+
+		void Set(size_t i, glm::vec3 value)
+		{
+			x[i] = VtHalf::Pack(value.x);
+			y[i] = VtHalf::Pack(value.y);
+			z[i] = VtHalf::Pack(value.z);
+		}
+
+		void Add(size_t i, glm::vec3 value)
+		{
+			Set(i, (*this)[i] + value);
+		}
+
+		// See VtFirstTouch()
+		template <class TForEachChunk>
+		void FirstTouch(const TForEachChunk& forEachChunk)
+		{
+			VtFirstTouch(x, forEachChunk);
+			VtFirstTouch(y, forEachChunk);
+			VtFirstTouch(z, forEachChunk);
+		}
+
+		size_t capacityBytes() const
+		{
+			return (x.capacity() + y.capacity() + z.capacity()) * sizeof(uint16_t);
+		}
+	};
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fmt/core.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace Velvet
+{
+	using namespace std;
+
+	// Hardware counters read around every profiled scope (see ProfileScope).
+	// Uses perf_event_open on Linux; elsewhere, or when the kernel refuses (containers, VMs,
+	// perf_event_paranoid), Enable() returns false and scopes only record time.
+	class PerfCounters
+	{
+	public:
+		enum Counter
+		{
+			Cycles,
+			Instructions,
+			L1DMisses,
+			LLCMisses,
+			BranchMisses,
+			Count
+		};
+
+		static constexpr uint32_t k_maxScopes = 256;
+
+		struct Sample
+		{
+			uint64_t values[Count] = {};
+		};
+
+		struct ScopeTotals
+		{
+			uint64_t calls = 0;
+			uint64_t values[Count] = {};
+		};
+
+		static const char* CounterName(int counter)
+		{
+			static const char* names[Count] = { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses" };
+			return names[counter];
+		}
+
+		// Opens the counters for the calling thread. Other threads open theirs on their first scope.
+		static bool Enable()
+		{
+			s_requested = true;
+			auto& group = LocalGroup();
+			s_enabled.store(group.available[Cycles], memory_order_relaxed);
+			return s_enabled.load(memory_order_relaxed);
+		}
+
+		static inline bool Enabled()
+		{
+			return s_enabled.load(memory_order_relaxed);
+		}
+
+		// Whether the counter could be opened on the calling thread
+		static bool Available(int counter)
+		{
+			return Enabled() && LocalGroup().available[counter];
+		}
+
+		static inline void Read(Sample& sample)
+		{
+#if defined(__linux__)
+			auto& group = LocalGroup();
+			if (group.leader < 0) return;
+
+			// PERF_FORMAT_GROUP: { nr, values[nr] }
+			uint64_t data[1 + Count] = {};
+			if (read(group.leader, data, sizeof(data)) <= 0) return;
+			for (int i = 0, slot = 0; i < Count; i++)
+			{
+				sample.values[i] = group.available[i] ? data[1 + slot++] : 0;
+			}
+#else
+			(void)sample;
+#endif
+		}
+
+		static inline void Accumulate(uint32_t scopeId, const Sample& start, const Sample& end)
+		{
+			s_calls[scopeId].fetch_add(1, memory_order_relaxed);
+			for (int i = 0; i < Count; i++)
+			{
+				s_values[scopeId][i].fetch_add(end.values[i] - start.values[i], memory_order_relaxed);
+			}
+		}
+
+		static ScopeTotals Totals(uint32_t scopeId)
+		{
+			ScopeTotals result;
+			result.calls = s_calls[scopeId].load(memory_order_relaxed);
+			for (int i = 0; i < Count; i++)
+			{
+				result.values[i] = s_values[scopeId][i].load(memory_order_relaxed);
+			}
+			return result;
+		}
+
+		static void Reset()
+		{
+			for (uint32_t id = 0; id < k_maxScopes; id++)
+			{
+				s_calls[id].store(0, memory_order_relaxed);
+				for (auto& v : s_values[id]) v.store(0, memory_order_relaxed);
+			}
+		}
+
+	private:
+		struct Group
+		{
+			int leader = -1;
+			int fds[Count] = { -1, -1, -1, -1, -1 };
+			bool available[Count] = {};
+
+			Group() = default;
+			Group(const Group&) = delete;
+
+			~Group()
+			{
+#if defined(__linux__)
+				for (int fd : fds)
+				{
+					if (fd >= 0) close(fd);
+				}
+#endif
+			}
+		};
+
+		inline static atomic<bool> s_enabled{ false };
+		inline static bool s_requested = false;
+		inline static atomic<bool> s_warned{ false };
+		inline static atomic<uint64_t> s_calls[k_maxScopes];
+		inline static atomic<uint64_t> s_values[k_maxScopes][Count];
+
+		static Group& LocalGroup()
+		{
+			thread_local Group group;
+			thread_local bool opened = false;
+			if (!opened && s_requested)
+			{
+				opened = true;
+				OpenGroup(group);
+			}
+			return group;
+		}
+
+		static void OpenGroup(Group& group)
+		{
+#if defined(__linux__)
+			const uint64_t configs[Count][2] = {
+				{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+				{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+				{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+				{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+				{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+			};
+
+			for (int i = 0; i < Count; i++)
+			{
+				perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = (uint32_t)configs[i][0];
+				attr.config = configs[i][1];
+				attr.disabled = (i == 0);
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP;
+
+				int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group.leader, 0);
+				if (fd < 0)
+				{
+					if (i == 0)
+					{
+						// Without the group leader nothing can be counted
+						if (!s_warned.exchange(true))
+						{
+							fmt::print("Warning(PerfCounters): Hardware counters unavailable ({}). Check /proc/sys/kernel/perf_event_paranoid "
+								"or run outside the container; continuing with timing only.\n", strerror(errno));
+						}
+						return;
+					}
+					continue;
+				}
+
+				group.fds[i] = fd;
+				group.available[i] = true;
+				if (i == 0) group.leader = fd;
+			}
+
+			ioctl(group.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+			if (!s_warned.exchange(true))
+			{
+				fmt::print("Warning(PerfCounters): Hardware counters are only supported on Linux; continuing with timing only.\n");
+			}
+#endif
+		}
+	};
+}
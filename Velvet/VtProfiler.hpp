@@ -0,0 +1,353 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+
+#include <fmt/core.h>
+
+#include "VtPerfCounters.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Profiling scopes are only compiled in when VT_PROFILER is defined.
+// VT_PROFILE_SCOPE("Name") registers the name once per call site (static id) and records
+// start/end ticks into a per-thread ring buffer. Without VT_PROFILER it expands to nothing.
+#define VT_PROFILER_CONCAT_INNER(a, b) a##b
+#define VT_PROFILER_CONCAT(a, b) VT_PROFILER_CONCAT_INNER(a, b)
+
+#ifdef VT_PROFILER
+#define VT_PROFILE_SCOPE(name) \
+	static const uint32_t VT_PROFILER_CONCAT(_vtProfileId, __LINE__) = Velvet::Profiler::RegisterScope(name); \
+	Velvet::ProfileScope VT_PROFILER_CONCAT(_vtProfileScope, __LINE__)(VT_PROFILER_CONCAT(_vtProfileId, __LINE__))
+#define VT_PROFILE_FRAME() Velvet::Profiler::NextFrame()
+#else
+#define VT_PROFILE_SCOPE(name)
+#define VT_PROFILE_FRAME()
+#endif
+
+namespace Velvet
+{
+	using namespace std;
+
+	struct ProfileEvent
+	{
+		uint64_t start;
+		uint64_t end;
+		uint32_t id;
+		uint32_t depth;
+	};
+
+	// Single producer ring buffer owned by one thread. Readers (frame aggregation, trace export)
+	// only look at the most recent half of the buffer, so the owner can keep writing while they read.
+	struct ProfileThreadBuffer
+	{
+		static constexpr uint32_t k_capacity = 1 << 16;
+
+		ProfileEvent events[k_capacity];
+		atomic<uint64_t> head{ 0 };
+		uint32_t depth = 0;
+		uint32_t scopeId = 0;	// innermost open scope, valid while depth > 0
+		uint32_t threadIndex = 0;
+
+		inline void Push(uint32_t id, uint32_t _depth, uint64_t start, uint64_t end)
+		{
+			uint64_t h = head.load(memory_order_relaxed);
+			events[h & (k_capacity - 1)] = ProfileEvent{ start, end, id, _depth };
+			head.store(h + 1, memory_order_release);
+		}
+	};
+
+	class Profiler
+	{
+	public:
+		static constexpr uint32_t k_maxScopes = PerfCounters::k_maxScopes;
+		static constexpr uint32_t k_maxFrames = 256;
+
+		static inline uint64_t Now()
+		{
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+			return __rdtsc();
+#else
+			return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+		// Returns a stable id for the name. Call sites cache the result in a function-local static.
+		static uint32_t RegisterScope(const char* name)
+		{
+			auto& s = Instance();
+			lock_guard<mutex> lock(s.m_mutex);
+			for (uint32_t i = 0; i < s.m_scopeNames.size(); i++)
+			{
+				if (s.m_scopeNames[i] == name) return i;
+			}
+			if (s.m_scopeNames.size() >= k_maxScopes)
+			{
+				fmt::print("Warning(Profiler): Too many scopes, [{}] is merged into scope 0.\n", name);
+				return 0;
+			}
+			s.m_scopeNames.push_back(name);
+			return (uint32_t)s.m_scopeNames.size() - 1;
+		}
+
+		static ProfileThreadBuffer& LocalBuffer()
+		{
+			auto& buffer = LocalBufferPointer();
+			if (buffer == nullptr) buffer = CreateThreadBuffer();
+			return *buffer;
+		}
+
+		// Buffer of the calling thread, or nullptr if the thread has not opened any scope yet.
+		// Never allocates, so it is safe to call from an allocation hook.
+		static ProfileThreadBuffer* CurrentBuffer()
+		{
+			return LocalBufferPointer();
+		}
+
+		// Id of a registered scope, -1 if no scope of that name has been entered yet
+		static int FindScope(const string& name)
+		{
+			auto& s = Instance();
+			lock_guard<mutex> lock(s.m_mutex);
+			for (int i = 0; i < s.m_scopeNames.size(); i++)
+			{
+				if (s.m_scopeNames[i] == name) return i;
+			}
+			return -1;
+		}
+
+		static string ScopeName(uint32_t id)
+		{
+			auto& s = Instance();
+			lock_guard<mutex> lock(s.m_mutex);
+			return id < s.m_scopeNames.size() ? s.m_scopeNames[id] : "";
+		}
+
+		// Closes the current frame: aggregates per-scope times over all threads and checks the flight recorder.
+		static void NextFrame()
+		{
+			auto& s = Instance();
+			if (s.m_frameIndex == 0)
+			{
+				// Calibrate before the first frame starts instead of stalling a measured frame
+				TicksPerSecond();
+			}
+			uint64_t now = Now();
+			uint64_t frameStart = s.m_frameStarts[s.m_frameIndex % k_maxFrames];
+
+			if (s.m_frameIndex > 0)
+			{
+				fill(s.m_frameTicks, s.m_frameTicks + k_maxScopes, 0);
+				ForEachEvent(frameStart, [&s](const ProfileEvent& e, uint32_t) {
+					s.m_frameTicks[e.id] += e.end - e.start;
+					});
+				for (uint32_t i = 0; i < k_maxScopes; i++)
+				{
+					if (s.m_frameTicks[i] > 0) s.m_lastRecordedTicks[i] = s.m_frameTicks[i];
+				}
+
+				double frameMs = TicksToSeconds(now - frameStart) * 1000.0;
+				if (s.m_flightThresholdMs > 0 && frameMs > s.m_flightThresholdMs)
+				{
+					auto path = fmt::format("{}_frame{}.json", s.m_flightPathPrefix, s.m_frameIndex);
+					fmt::print("Info(Profiler): Frame {} took {:.2f} ms (> {:.2f} ms). Dump last {} frames to [{}].\n",
+						s.m_frameIndex, frameMs, s.m_flightThresholdMs, s.m_flightNumFrames, path);
+					ExportChromeTrace(path, s.m_flightNumFrames);
+				}
+			}
+
+			s.m_frameIndex++;
+			s.m_frameStarts[s.m_frameIndex % k_maxFrames] = now;
+		}
+
+		// Total time (seconds) recorded under the scope name during the last closed frame
+		static double FrameTime(const string& name)
+		{
+			int id = FindScope(name);
+			return id >= 0 ? TicksToSeconds(Instance().m_frameTicks[id]) : 0.0;
+		}
+
+		// Same as FrameTime, but keeps the value of the latest frame in which the scope was recorded
+		static double LastRecordedTime(const string& name)
+		{
+			int id = FindScope(name);
+			return id >= 0 ? TicksToSeconds(Instance().m_lastRecordedTicks[id]) : 0.0;
+		}
+
+		// Dumps a trace readable by chrome://tracing or ui.perfetto.dev.
+		// numFrames limits the output to the most recent frames; 0 writes everything still in the buffers.
+		static bool ExportChromeTrace(const string& path, int numFrames = 0)
+		{
+			auto& s = Instance();
+			ofstream file(path);
+			if (!file.is_open())
+			{
+				fmt::print("Error(Profiler): Unable to open [{}] for writing.\n", path);
+				return false;
+			}
+
+			uint64_t since = 0;
+			if (numFrames > 0 && s.m_frameIndex > 0)
+			{
+				uint32_t frames = min((uint32_t)numFrames, min(s.m_frameIndex, k_maxFrames - 1));
+				since = s.m_frameStarts[(s.m_frameIndex - frames + 1) % k_maxFrames];
+			}
+
+			vector<string> names;
+			{
+				lock_guard<mutex> lock(s.m_mutex);
+				names = s.m_scopeNames;
+			}
+
+			file << "{\"traceEvents\":[\n";
+			bool first = true;
+			ForEachEvent(since, [&](const ProfileEvent& e, uint32_t threadIndex) {
+				double ts = TicksToSeconds(e.start - s.m_originTicks) * 1e6;
+				double dur = TicksToSeconds(e.end - e.start) * 1e6;
+				file << (first ? "" : ",\n") << fmt::format("{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":0,\"tid\":{}}}",
+					names[e.id], ts, dur, threadIndex);
+				first = false;
+				});
+			file << "\n]}\n";
+			return true;
+		}
+
+		// When a frame exceeds thresholdMs, the last numFrames frames are written to <pathPrefix>_frame<N>.json.
+		// A threshold <= 0 disables the flight recorder.
+		static void SetFlightRecorder(double thresholdMs, int numFrames = 16, const string& pathPrefix = "velvet_flight")
+		{
+			auto& s = Instance();
+			s.m_flightThresholdMs = thresholdMs;
+			s.m_flightNumFrames = clamp(numFrames, 1, (int)k_maxFrames - 1);
+			s.m_flightPathPrefix = pathPrefix;
+		}
+
+		static double TicksToSeconds(uint64_t ticks)
+		{
+			return (double)ticks / TicksPerSecond();
+		}
+
+	private:
+		mutex m_mutex;
+		vector<string> m_scopeNames;
+		vector<unique_ptr<ProfileThreadBuffer>> m_buffers;
+
+		uint32_t m_frameIndex = 0;
+		uint64_t m_frameStarts[k_maxFrames] = {};
+		uint64_t m_frameTicks[k_maxScopes] = {};
+		uint64_t m_lastRecordedTicks[k_maxScopes] = {};
+
+		double m_flightThresholdMs = 0;
+		int m_flightNumFrames = 16;
+		string m_flightPathPrefix = "velvet_flight";
+
+		uint64_t m_originTicks = Now();
+		chrono::steady_clock::time_point m_originTime = chrono::steady_clock::now();
+
+		static Profiler& Instance()
+		{
+			static Profiler s_profiler;
+			return s_profiler;
+		}
+
+		static ProfileThreadBuffer*& LocalBufferPointer()
+		{
+			thread_local ProfileThreadBuffer* t_buffer = nullptr;
+			return t_buffer;
+		}
+
+		static ProfileThreadBuffer* CreateThreadBuffer()
+		{
+			auto& s = Instance();
+			lock_guard<mutex> lock(s.m_mutex);
+			// Buffers are never released, so events of finished threads can still be exported
+			s.m_buffers.push_back(make_unique<ProfileThreadBuffer>());
+			s.m_buffers.back()->threadIndex = (uint32_t)s.m_buffers.size() - 1;
+			return s.m_buffers.back().get();
+		}
+
+		// Visits events that ended after `since` on every thread, newest first
+		template <class Func>
+		static void ForEachEvent(uint64_t since, Func func)
+		{
+			auto& s = Instance();
+			vector<ProfileThreadBuffer*> buffers;
+			{
+				lock_guard<mutex> lock(s.m_mutex);
+				for (auto& b : s.m_buffers) buffers.push_back(b.get());
+			}
+
+			for (auto buffer : buffers)
+			{
+				uint64_t head = buffer->head.load(memory_order_acquire);
+				uint64_t count = min(head, (uint64_t)ProfileThreadBuffer::k_capacity / 2);
+				for (uint64_t i = 0; i < count; i++)
+				{
+					const auto& e = buffer->events[(head - 1 - i) & (ProfileThreadBuffer::k_capacity - 1)];
+					// Events are pushed when a scope ends, so end ticks only decrease from here on
+					if (e.end < since) break;
+					func(e, buffer->threadIndex);
+				}
+			}
+		}
+
+		static double TicksPerSecond()
+		{
+			// Calibrate the tick counter against steady_clock once, over at least 20 ms
+			static double s_ticksPerSecond = []() {
+				auto& s = Instance();
+				while (chrono::steady_clock::now() - s.m_originTime < chrono::milliseconds(20));
+				double seconds = chrono::duration<double>(chrono::steady_clock::now() - s.m_originTime).count();
+				return (double)(Now() - s.m_originTicks) / seconds;
+			}();
+			return s_ticksPerSecond;
+		}
+	};
+
+	class ProfileScope
+	{
+	public:
+		ProfileScope(uint32_t id) : m_buffer(Profiler::LocalBuffer())
+		{
+			m_id = id;
+			m_parentId = m_buffer.scopeId;
+			m_buffer.scopeId = id;
+			m_depth = m_buffer.depth++;
+			if (PerfCounters::Enabled()) PerfCounters::Read(m_counters);
+			m_start = Profiler::Now();
+		}
+
+		~ProfileScope()
+		{
+			uint64_t end = Profiler::Now();
+			if (PerfCounters::Enabled())
+			{
+				PerfCounters::Sample counters;
+				PerfCounters::Read(counters);
+				PerfCounters::Accumulate(m_id, m_counters, counters);
+			}
+			m_buffer.depth--;
+			m_buffer.scopeId = m_parentId;
+			m_buffer.Push(m_id, m_depth, m_start, end);
+		}
+
+	private:
+		ProfileThreadBuffer& m_buffer;
+		uint64_t m_start;
+		uint32_t m_id;
+		uint32_t m_parentId;
+		uint32_t m_depth;
+		PerfCounters::Sample m_counters;
+	};
+}
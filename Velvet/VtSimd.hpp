@@ -0,0 +1,141 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VT_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX instructions in functions that ask for them; MSVC accepts the intrinsics anywhere.
+// Functions marked with these must only be called after VtSimd::Supported() confirmed the instruction set.
+// GCC would otherwise fuse the separate mul/add intrinsics into FMA (AVX-512F implies it) and change the results.
+#if defined(VT_SIMD_X86) && defined(__clang__)
+#define VT_TARGET_AVX2 __attribute__((target("avx2")))
+#define VT_TARGET_AVX2_F16C __attribute__((target("avx2,f16c")))
+#define VT_TARGET_AVX512 __attribute__((target("avx512f")))
+#elif defined(VT_SIMD_X86) && defined(__GNUC__)
+#define VT_TARGET_AVX2 __attribute__((target("avx2"), optimize("fp-contract=off")))
+#define VT_TARGET_AVX2_F16C __attribute__((target("avx2,f16c"), optimize("fp-contract=off")))
+#define VT_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#else
+#define VT_TARGET_AVX2
+#define VT_TARGET_AVX2_F16C
+#define VT_TARGET_AVX512
+#endif
+
+namespace Velvet
+{
+	using namespace std;
+
+	enum class VtSimdLevel
+	{
+		Scalar,
+		AVX2,
+		AVX512,
+	};
+
+	// Instruction set used by the per-particle kernels. Detected once at startup;
+	// SetLevel can lower it (e.g. to compare against the scalar path) but never raise it above the CPU.
+	class VtSimd
+	{
+	public:
+		static VtSimdLevel Supported()
+		{
+			static VtSimdLevel level = Detect();
+			return level;
+		}
+
+		static VtSimdLevel Active()
+		{
+			return s_active;
+		}
+
+		// Whether AVX2 kernels may convert fp16 values (F16C, VT_TARGET_AVX2_F16C). AVX-512 kernels always can.
+		static bool HalfConversions()
+		{
+			static bool f16c = DetectF16C();
+			return f16c;
+		}
+
+		static VtSimdLevel SetLevel(VtSimdLevel level)
+		{
+			s_active = min(level, Supported());
+			return s_active;
+		}
+
+		static const char* Name(VtSimdLevel level)
+		{
+			switch (level)
+			{
+			case VtSimdLevel::AVX2: return "avx2";
+			case VtSimdLevel::AVX512: return "avx512";
+			default: return "scalar";
+			}
+		}
+
+		static bool Parse(const string& name, VtSimdLevel& level)
+		{
+			for (auto candidate : { VtSimdLevel::Scalar, VtSimdLevel::AVX2, VtSimdLevel::AVX512 })
+			{
+				if (name == Name(candidate))
+				{
+					level = candidate;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		static int PopCount(uint32_t mask)
+		{
+			int count = 0;
+			for (; mask; count++) mask &= mask - 1;
+			return count;
+		}
+
+	private:
+		inline static VtSimdLevel s_active = Supported();
+
+		static VtSimdLevel Detect()
+		{
+#if defined(VT_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f")) return VtSimdLevel::AVX512;
+			if (__builtin_cpu_supports("avx2")) return VtSimdLevel::AVX2;
+#elif defined(VT_SIMD_X86)
+			// The OS has to save the wider registers as well (OSXSAVE + XCR0), not only the CPU support them
+			int info[4];
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			if (!osxsave) return VtSimdLevel::Scalar;
+			unsigned long long xcr0 = _xgetbv(0);
+			__cpuidex(info, 7, 0);
+			bool avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+			bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+			if (avx512) return VtSimdLevel::AVX512;
+			if (avx2) return VtSimdLevel::AVX2;
+#endif
+			return VtSimdLevel::Scalar;
+		}
+
+		static bool DetectF16C()
+		{
+#if defined(VT_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("f16c");
+#elif defined(VT_SIMD_X86)
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 29)) != 0;
+#else
+			return false;
+#endif
+		}
+	};
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <fmt/core.h>
+
+#include "GameInstance.hpp"
+#include "Scene.hpp"
+#include "VtClothObjectCPU.hpp"
+#include "VtClothSolverCPU.hpp"
+#include "VtProfiler.hpp"
+#include "VtAllocationTracker.hpp"
+#include "VtSimd.hpp"
+
+namespace Velvet
+{
+	// A flat piece of cloth with a number of sphere colliders scattered across it.
+	class SceneSolverBenchmark : public Scene
+	{
+	public:
+		SceneSolverBenchmark(int resolution, int numColliders)
+		{
+			name = fmt::format("Benchmark / Res {} / Colliders {}", resolution, numColliders);
+			m_resolution = resolution;
+			m_numColliders = numColliders;
+		}
+
+		void PopulateActors(GameInstance* game) override
+		{
+			auto cloth = SpawnCloth(game, m_resolution);
+			cloth->Initialize(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0), glm::vec3(90, 0, 0));
+			cloth->GetComponent<VtClothObjectCPU>()->SetAttachedIndices({ 0, m_resolution });
+
+			// Cloth covers [-1, 1] on the xz plane. Place spheres on a grid so that all of them overlap the cloth.
+			int gridSize = (int)ceil(sqrt((float)m_numColliders));
+			float spacing = 2.0f / max(gridSize, 1);
+			for (int i = 0; i < m_numColliders; i++)
+			{
+				int x = i % gridSize;
+				int z = i / gridSize;
+				float radius = spacing * 0.4f;
+				auto sphere = SpawnSphere(game);
+				sphere->Initialize(glm::vec3(-1.0f + (x + 0.5f) * spacing, 1.0f - radius * 0.5f, -1.0f + (z + 0.5f) * spacing), glm::vec3(radius));
+			}
+		}
+
+	private:
+		int m_resolution;
+		int m_numColliders;
+	};
+
+	// Times every VtClothSolverCPU phase in isolation over a matrix of cloth resolutions and collider counts.
+	// Usage: VelvetBenchmark [--resolutions 16,32,...] [--colliders 0,1,...] [--warmup n] [--reps n] [--phase name] [--output file] [--simd scalar|avx2|avx512] [--tile-kb n] [--colored] [--compact]
+	class VtSolverBenchmark
+	{
+	public:
+		VtSolverBenchmark(int argc, char** argv)
+		{
+			for (int i = 1; i < argc; i++)
+			{
+				string arg = argv[i];
+				bool hasValue = (i + 1 < argc);
+
+				if (arg == "--resolutions" && hasValue) m_resolutions = ParseList(argv[++i]);
+				else if (arg == "--colliders" && hasValue) m_colliderCounts = ParseList(argv[++i]);
+				else if (arg == "--warmup" && hasValue) m_numWarmup = max(atoi(argv[++i]), 0);
+				else if (arg == "--reps" && hasValue) m_numRepetitions = max(atoi(argv[++i]), 1);
+				else if (arg == "--phase" && hasValue) m_phaseFilter.push_back(argv[++i]);
+				else if (arg == "--output" && hasValue) m_outputPath = argv[++i];
+				else if (arg == "--tile-kb" && hasValue) m_tileKB = max(atoi(argv[++i]), 1);
+				else if (arg == "--colored") Global::simParams.coloredConstraints = true;
+				else if (arg == "--compact") Global::simParams.compactState = true;
+				else if (arg == "--simd" && hasValue)
+				{
+					VtSimdLevel level;
+					if (VtSimd::Parse(argv[++i], level)) VtSimd::SetLevel(level);
+					else m_validArgs = false;
+				}
+				else
+				{
+					fmt::print("Error(Benchmark): Unknown or incomplete argument [{}].\n", arg);
+					m_validArgs = false;
+				}
+			}
+		}
+
+		int Run()
+		{
+			if (!m_validArgs || m_resolutions.empty() || m_colliderCounts.empty())
+			{
+				fmt::print("Usage: VelvetBenchmark [--resolutions 16,32,...] [--colliders 0,1,...] [--warmup n] [--reps n] [--phase name] [--output file] [--simd scalar|avx2|avx512] [--tile-kb n] [--colored] [--compact]\n");
+				return 1;
+			}
+
+			for (int resolution : m_resolutions)
+			{
+				for (int c = 0; c < m_colliderCounts.size(); c++)
+				{
+					// Only collider dependent phases are repeated for every collider count
+					RunCase(resolution, m_colliderCounts[c], c == 0);
+				}
+			}
+
+			WriteJson();
+			if (m_numAllocationFailures > 0)
+			{
+				fmt::print("Error(Benchmark): {} phase(s) allocated during measured repetitions.\n", m_numAllocationFailures);
+				return 4;
+			}
+			return 0;
+		}
+
+	private:
+		struct Phase
+		{
+			string name;
+			bool dependsOnColliders;
+			function<void()> run;
+			function<size_t()> numConstraints; // nullptr for phases that only touch particles
+			function<void()> prepare = nullptr; // untimed, called once before warmup
+			function<size_t()> modeledBytes = nullptr; // memory traffic if every array is streamed once per pass, for fused phases and their counterparts
+		};
+
+		struct Result
+		{
+			string phase;
+			int resolution;
+			int colliders;
+			size_t particles;
+			size_t constraints;
+			double medianNs;
+			double minNs;
+			size_t modeledBytes;
+		};
+
+		vector<int> m_resolutions = { 16, 32, 64, 128, 256, 512, 1024 };
+		vector<int> m_colliderCounts = { 0, 1, 4, 16, 64 };
+		vector<string> m_phaseFilter;
+		int m_numWarmup = 3;
+		int m_numRepetitions = 10;
+		int m_tileKB = 1024; // cache tile size of SolveStretchTiled
+		string m_outputPath = "solver_benchmark.json";
+		bool m_validArgs = true;
+		int m_numAllocationFailures = 0;
+
+		vector<Result> m_results;
+
+		static vector<int> ParseList(const string& text)
+		{
+			vector<int> result;
+			stringstream ss(text);
+			string item;
+			while (getline(ss, item, ','))
+			{
+				if (!item.empty()) result.push_back(atoi(item.c_str()));
+			}
+			return result;
+		}
+
+		bool PhaseEnabled(const string& name) const
+		{
+			return m_phaseFilter.empty() || find(m_phaseFilter.begin(), m_phaseFilter.end(), name) != m_phaseFilter.end();
+		}
+
+		void RunCase(int resolution, int numColliders, bool includeAllPhases)
+		{
+			SceneSolverBenchmark scene(resolution, numColliders);
+			auto game = make_shared<GameInstance>(nullptr, nullptr);
+			scene.PopulateActors(game.get());
+			game->Initialize();
+
+			auto solver = game->FindComponents<VtClothObjectCPU>()[0]->solver();
+			VtClothSolverCPU& s = *solver;
+			float substepTime = Timer::fixedDeltaTime() / Global::simParams.numSubsteps;
+
+			// Give every particle a velocity and jitter predicted positions with a fixed seed,
+			// so that stretch/bending constraints and collisions are active but results are reproducible.
+			mt19937 rng(12345);
+			uniform_real_distribution<float> jitter(-0.25f, 0.25f);
+			float restLength = s.m_particleDiameter / Global::simParams.particleDiameterScalar;
+			s.PredictPositions(substepTime);
+			for (int i = 0; i < s.m_numVertices; i++)
+			{
+				s.m_predicted.Add(i, glm::vec3(jitter(rng), jitter(rng), jitter(rng)) * restLength);
+			}
+
+			const auto positions = s.m_positions;
+			const auto predicted = s.m_predicted;
+			const auto velocities = s.m_velocities;
+			const auto halfVelocities = s.m_halfVelocities;
+			auto restore = [&]() {
+				s.m_positions = positions;
+				s.m_predicted = predicted;
+				s.m_velocities = velocities;
+				s.m_halfVelocities = halfVelocities;
+				s.m_deltas.Fill(glm::vec3(0));
+				fill(s.m_deltaCounts.begin(), s.m_deltaCounts.end(), 0);
+			};
+
+			auto numNeighborPairs = [&]() {
+				size_t count = 0;
+				for (int i = 0; i < s.m_numVertices; i++) count += s.m_spatialHash->NumNeighbors(i);
+				return count / 2;
+			};
+
+			// Traffic of the fused sweeps and their unfused counterparts. A fused sweep counts the arrays of a chunk once,
+			// as it finds them in cache after the first step; CollideSDF reads predicted and origins and writes predicted.
+			size_t vec3 = sizeof(glm::vec3);
+			size_t n = s.m_numVertices, numTriangles = s.m_indices.size() / 3;
+			auto substepBytes = [&]() { return n * vec3 * (4 + 4 + 3 * s.m_colliders.size()); };
+			auto fusedSubstepBytes = [&]() { return n * vec3 * 5; };
+			// The triangle and the vertex pass of ComputeNormals, after Finalize and CopyToMesh or after FinalizeToMesh
+			size_t normalBytes = numTriangles * (3 * sizeof(int) + vec3) + n * vec3 +
+				n * sizeof(int) + numTriangles * 3 * sizeof(int) + numTriangles * vec3 + n * vec3;
+			size_t frameEndBytes = n * vec3 * 4 + n * vec3 * 2 + normalBytes;
+			size_t fusedFrameEndBytes = n * vec3 * 5 + normalBytes;
+
+			vector<Phase> phases = {
+				{ "PredictPositions", false, [&]() { s.PredictPositions(substepTime); }, nullptr },
+				{ "SolveStretch", false, [&]() { s.SolveStretch(substepTime); }, [&]() { return s.m_stretchConstraints.size(); } },
+				{ "SolveStretchGrid", false, [&]() { s.SolveStretchGrid(); }, [&]() { return s.m_stretchConstraints.size(); } },
+				// All iterations of one substep
+				{ "SolveStretchTiled", false, [&]() { s.SolveStretchTiled(0, Global::simParams.numIterations, m_tileKB); }, [&]() { return s.m_stretchConstraints.size() * Global::simParams.numIterations; } },
+				{ "SolveStretchJacobi", false, [&]() { s.SolveStretchJacobi(); s.ApplyDeltas(); }, [&]() { return s.m_stretchConstraints.size(); } },
+				{ "SolveBending", false, [&]() { s.SolveBending(substepTime); }, [&]() { return s.m_bendingConstraints.size(); } },
+				{ "SolveAttachment", false, [&]() { s.SolveAttachment(); }, [&]() { return s.m_attachmentConstriants.size(); } },
+				{ "CollideSDF", true, [&]() { s.CollideSDF(s.m_predicted, s.m_positions, substepTime); }, [&]() { return s.m_numVertices * s.m_colliders.size(); } },
+				{ "CollideParticles", false, [&]() { s.CollideParticles(); }, numNeighborPairs, [&]() { s.m_spatialHash->HashObjects(s.m_predicted); } },
+				{ "CollideParticlesJacobi", false, [&]() { s.CollideParticlesJacobi(); }, numNeighborPairs, [&]() { s.m_spatialHash->HashObjects(s.m_predicted); } },
+				{ "Finalize", false, [&]() { s.Finalize(substepTime); }, nullptr },
+				{ "SubstepSweeps", true, [&]() {
+					s.Finalize(substepTime);
+					s.PredictPositions(substepTime);
+					s.CollideSDF(s.m_predicted, s.m_positions, substepTime);
+					}, nullptr, nullptr, substepBytes },
+				{ "SubstepSweepsFused", true, [&]() {
+					s.WithFeatures([&](auto features) { s.FinalizeAndPredict(features, substepTime, true); });
+					}, nullptr, nullptr, fusedSubstepBytes },
+				{ "FrameEnd", false, [&]() {
+					s.Finalize(substepTime);
+					s.CopyToMesh();
+					s.ComputeNormals(s.m_meshPositions, s.m_normals);
+					}, nullptr, nullptr, [&]() { return frameEndBytes; } },
+				{ "FrameEndFused", false, [&]() {
+					s.FinalizeToMesh(substepTime);
+					s.ComputeNormals(s.m_meshPositions, s.m_normals);
+					}, nullptr, nullptr, [&]() { return fusedFrameEndBytes; } },
+				{ "ComputeNormals", false, [&]() { s.ComputeNormals(s.m_meshPositions, s.m_normals); }, nullptr },
+				{ "HashObjects", false, [&]() { s.m_spatialHash->HashObjects(s.m_predicted); }, nullptr },
+			};
+
+			for (auto& phase : phases)
+			{
+				if (!PhaseEnabled(phase.name)) continue;
+				if (!phase.dependsOnColliders && !includeAllPhases) continue;
+
+				restore();
+				if (phase.prepare) phase.prepare();
+
+#ifdef VT_PROFILER
+				// Phases run inside a scope of their own name, so that the allocation tracker can attribute them
+				uint32_t scopeId = Profiler::RegisterScope(("Benchmark_" + phase.name).c_str());
+#endif
+				vector<double> samples;
+				for (int rep = 0; rep < m_numWarmup + m_numRepetitions; rep++)
+				{
+					restore();
+					AllocationTracker::Enable(rep >= m_numWarmup);
+					auto start = chrono::steady_clock::now();
+					{
+#ifdef VT_PROFILER
+						ProfileScope scope(scopeId);
+#endif
+						phase.run();
+					}
+					auto end = chrono::steady_clock::now();
+					AllocationTracker::Enable(false);
+					if (rep >= m_numWarmup)
+					{
+						samples.push_back((double)chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+					}
+				}
+				sort(samples.begin(), samples.end());
+				if (!AllocationTracker::Report(fmt::format("res {} colliders {}", resolution, numColliders)))
+				{
+					m_numAllocationFailures++;
+				}
+
+				Result result;
+				result.phase = phase.name;
+				result.resolution = resolution;
+				result.colliders = phase.dependsOnColliders ? numColliders : -1;
+				result.particles = s.m_numVertices;
+				result.constraints = phase.numConstraints ? phase.numConstraints() : 0;
+				result.medianNs = samples[samples.size() / 2];
+				result.minNs = samples[0];
+				result.modeledBytes = phase.modeledBytes ? phase.modeledBytes() : 0;
+				m_results.push_back(result);
+
+				string traffic = result.modeledBytes > 0 ?
+					fmt::format("  {:>8.2f} MB modeled, {:>6.1f} GB/s", result.modeledBytes / 1e6, result.modeledBytes / result.medianNs) : "";
+				fmt::print("Info(Benchmark): res {:>4} colliders {:>2} {:<17} {:>12.0f} ns  {:>8.2f} ns/particle{}\n",
+					resolution, numColliders, phase.name, result.medianNs, result.medianNs / result.particles, traffic);
+			}
+
+			game->Finalize();
+			scene.ClearCallbacks();
+		}
+
+		void WriteJson() const
+		{
+			ofstream file(m_outputPath);
+			if (!file.is_open())
+			{
+				fmt::print("Error(Benchmark): Unable to open [{}] for writing.\n", m_outputPath);
+				return;
+			}
+
+			file << "{\n";
+			file << fmt::format("  \"warmup\": {},\n  \"repetitions\": {},\n  \"numSubsteps\": {},\n  \"numIterations\": {},\n  \"simd\": \"{}\",\n  \"coloredConstraints\": {},\n  \"compactState\": {},\n",
+				m_numWarmup, m_numRepetitions, Global::simParams.numSubsteps, Global::simParams.numIterations, VtSimd::Name(VtSimd::Active()),
+				Global::simParams.coloredConstraints, Global::simParams.compactState);
+			file << "  \"results\": [\n";
+			for (int i = 0; i < m_results.size(); i++)
+			{
+				const auto& r = m_results[i];
+				// Colliders is null for phases that do not depend on colliders
+				string colliders = r.colliders >= 0 ? to_string(r.colliders) : "null";
+				string nsPerConstraint = r.constraints > 0 ? fmt::format("{:.3f}", r.medianNs / r.constraints) : "null";
+				string modeledBytes = r.modeledBytes > 0 ? to_string(r.modeledBytes) : "null";
+				file << fmt::format("    {{ \"phase\": \"{}\", \"resolution\": {}, \"colliders\": {}, \"particles\": {}, \"constraints\": {}, "
+					"\"median_ns\": {:.0f}, \"min_ns\": {:.0f}, \"ns_per_particle\": {:.3f}, \"ns_per_constraint\": {}, \"modeled_bytes\": {} }}{}\n",
+					r.phase, r.resolution, colliders, r.particles, r.constraints,
+					r.medianNs, r.minNs, r.medianNs / r.particles, nsPerConstraint, modeledBytes, i + 1 < m_results.size() ? "," : "");
+			}
+			file << "  ]\n}\n";
+			fmt::print("Info(Benchmark): Results written to [{}].\n", m_outputPath);
+		}
+	};
+}
@@ -0,0 +1,119 @@
+#include "VtThreadPool.hpp"
+
+#include <fstream>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace Velvet;
+
+namespace
+{
+#if defined(__linux__)
+	// Parses a sysfs list such as "0-23,48-71"
+	vector<int> ParseList(const string& text)
+	{
+		vector<int> values;
+		size_t pos = 0;
+		while (pos < text.size())
+		{
+			size_t next = text.find(',', pos);
+			if (next == string::npos) next = text.size();
+			string range = text.substr(pos, next - pos);
+			size_t dash = range.find('-');
+			try
+			{
+				int first = stoi(range.substr(0, dash));
+				int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+				for (int v = first; v <= last; v++) values.push_back(v);
+			}
+			catch (const exception&)
+			{
+			}
+			pos = next + 1;
+		}
+		return values;
+	}
+
+	string ReadLine(const string& path)
+	{
+		ifstream file(path);
+		string line;
+		getline(file, line);
+		return line;
+	}
+#endif
+
+	vector<vector<int>> QueryNumaNodes()
+	{
+		vector<vector<int>> nodes;
+#if defined(_WIN32)
+		// Processor group 0 only, like PinCurrentThread()
+		ULONG highest = 0;
+		if (GetNumaHighestNodeNumber(&highest))
+		{
+			for (ULONG n = 0; n <= highest; n++)
+			{
+				ULONGLONG mask = 0;
+				if (!GetNumaNodeProcessorMask((UCHAR)n, &mask)) continue;
+				vector<int> cores;
+				for (int core = 0; core < 64; core++)
+				{
+					if ((mask >> core) & 1) cores.push_back(core);
+				}
+				if (!cores.empty()) nodes.push_back(move(cores));
+			}
+		}
+#elif defined(__linux__)
+		// Only cores this process may run on, so that pinning cannot fail inside a restricted cpuset
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+		for (int n : ParseList(ReadLine("/sys/devices/system/node/online")))
+		{
+			vector<int> cores;
+			for (int core : ParseList(ReadLine("/sys/devices/system/node/node" + to_string(n) + "/cpulist")))
+			{
+				if (!restricted || (core < CPU_SETSIZE && CPU_ISSET(core, &allowed))) cores.push_back(core);
+			}
+			if (!cores.empty()) nodes.push_back(move(cores));
+		}
+#endif
+		if (nodes.empty())
+		{
+			nodes.emplace_back();
+			for (int core = 0; core < VtThreadPool::HardwareThreads(); core++) nodes.back().push_back(core);
+		}
+		return nodes;
+	}
+}
+
+bool VtThreadPool::PinCurrentThread(int core)
+{
+#if defined(_WIN32)
+	if (core < 0 || core >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+	if (core < 0 || core >= CPU_SETSIZE) return false;
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(core, &cpus);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+	(void)core;
+	return false;
+#endif
+}
+
+const vector<vector<int>>& VtThreadPool::NumaNodes()
+{
+	static const vector<vector<int>> nodes = QueryNumaNodes();
+	return nodes;
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace Velvet
+{
+	using namespace std;
+
+	// Persistent worker threads shared by all CPU solvers (Shared()). ParallelFor cuts [0, count) into chunks of
+	// chunkSize items, deals them out as one contiguous run per thread, and threads that run out steal chunks from
+	// the back of other runs. The calling thread works as well, and the call returns once every chunk is done, so
+	// consecutive calls act as barriers (e.g. between the colors of a colored Gauss-Seidel sweep).
+	// Chunk boundaries only depend on count and chunkSize, never on which thread runs a chunk, so bodies that write
+	// per item or per chunk give the same result for every thread count. Dispatching does not allocate.
+	// ParallelFor may only be called from one thread at a time, and not from inside a body.
+	class VtThreadPool
+	{
+	public:
+		static VtThreadPool& Shared()
+		{
+			static VtThreadPool pool;
+			return pool;
+		}
+
+		VtThreadPool() = default;
+		VtThreadPool(const VtThreadPool&) = delete;
+		VtThreadPool& operator=(const VtThreadPool&) = delete;
+
+		~VtThreadPool()
+		{
+			Stop();
+		}
+
+		// Threads that work on a ParallelFor, the calling thread included
+		int numThreads() const
+		{
+			return (int)m_workers.size() + 1;
+		}
+
+		// Where workers run. Compact fills the logical cores of one NUMA node before moving on to the next, Scatter deals
+		// workers round robin over the nodes. Both leave the calling thread alone: it counts as the first slot.
+		enum class Affinity
+		{
+			None,
+			Compact,
+			Scatter,
+		};
+
+		// Restarts the workers if the count or affinity changed. Allocates when it restarts.
+		void Configure(int numThreads, Affinity affinity)
+		{
+			numThreads = max(numThreads, 1);
+			if (numThreads == this->numThreads() && affinity == m_affinity) return;
+
+			Stop();
+			m_affinity = affinity;
+			m_runs = unique_ptr<Run[]>(new Run[numThreads]);
+			m_workers.reserve(numThreads - 1);
+			vector<int> cores = CoreOrder(affinity);
+			// Workers start from the current generation, so a call made before they run is not missed
+			uint64_t generation = m_generation.load(memory_order_acquire);
+			for (int i = 1; i < numThreads; i++)
+			{
+				int core = cores.empty() ? -1 : cores[i % cores.size()];
+				m_workers.emplace_back([this, i, generation, core]() {
+					if (core >= 0) PinCurrentThread(core);
+					WorkerLoop(i, generation);
+					});
+			}
+		}
+
+		// body(begin, end) is called for every chunk [begin, end) of [0, count). Runs on the calling thread alone
+		// when there is a single chunk or no worker.
+		template <class TBody>
+		void ParallelFor(int count, int chunkSize, const TBody& body)
+		{
+			if (count <= 0) return;
+			chunkSize = max(chunkSize, 1);
+			int numChunks = (count + chunkSize - 1) / chunkSize;
+			int n = numThreads();
+			if (n == 1 || numChunks == 1)
+			{
+				body(0, count);
+				return;
+			}
+
+			m_body = &body;
+			m_invoke = [](const void* context, int begin, int end) {
+				(*static_cast<const TBody*>(context))(begin, end);
+			};
+			m_count = count;
+			m_chunkSize = chunkSize;
+			for (int t = 0; t < n; t++)
+			{
+				m_runs[t].Reset((int)((long long)numChunks * t / n), (int)((long long)numChunks * (t + 1) / n));
+			}
+			m_pending.store(n - 1, memory_order_relaxed);
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_generation++;
+			}
+			m_wake.notify_all();
+
+			Work(0);
+			for (int spin = 0; m_pending.load(memory_order_acquire) != 0; spin++)
+			{
+				Backoff(spin);
+			}
+		}
+
+		// Chunk size that gives every thread one share of [0, count), rounded up to a multiple of alignment
+		int ShareSize(int count, int alignment) const
+		{
+			int share = (count + numThreads() - 1) / numThreads();
+			return max((share + alignment - 1) / alignment * alignment, alignment);
+		}
+
+		// Logical cores of the machine, at least 1
+		static int HardwareThreads()
+		{
+			return max((int)thread::hardware_concurrency(), 1);
+		}
+
+		// Binds the calling thread to one logical core. Returns false where unsupported.
+		static bool PinCurrentThread(int core);
+
+		// Logical cores of every NUMA node, read once. A single node with all cores where the system reports none.
+		static const vector<vector<int>>& NumaNodes();
+
+		// Logical cores in the order that affinity assigns them to threads, empty for Affinity::None
+		static vector<int> CoreOrder(Affinity affinity)
+		{
+			const auto& nodes = NumaNodes();
+			vector<int> cores;
+			if (affinity == Affinity::Compact)
+			{
+				for (const auto& node : nodes) cores.insert(cores.end(), node.begin(), node.end());
+			}
+			else if (affinity == Affinity::Scatter)
+			{
+				for (size_t i = 0;; i++)
+				{
+					size_t before = cores.size();
+					for (const auto& node : nodes)
+					{
+						if (i < node.size()) cores.push_back(node[i]);
+					}
+					if (cores.size() == before) break;
+				}
+			}
+			return cores;
+		}
+
+	private:
+		static constexpr int k_pauseIterations = 64;
+		static constexpr int k_spinIterations = 4096;
+
+		// Chunk indices [front, back) not yet taken from one thread's run, packed into one word so that
+		// the owner (front) and thieves (back) claim chunks with a single compare-exchange
+		struct alignas(64) Run
+		{
+			atomic<uint64_t> range{ 0 };
+
+			void Reset(int front, int back)
+			{
+				range.store(Pack(front, back), memory_order_relaxed);
+			}
+
+			int PopFront()
+			{
+				uint64_t r = range.load(memory_order_acquire);
+				while (Front(r) < Back(r))
+				{
+					if (range.compare_exchange_weak(r, Pack(Front(r) + 1, Back(r)), memory_order_acq_rel)) return Front(r);
+				}
+				return -1;
+			}
+
+			int PopBack()
+			{
+				uint64_t r = range.load(memory_order_acquire);
+				while (Front(r) < Back(r))
+				{
+					if (range.compare_exchange_weak(r, Pack(Front(r), Back(r) - 1), memory_order_acq_rel)) return Back(r) - 1;
+				}
+				return -1;
+			}
+
+			static uint64_t Pack(int front, int back) { return ((uint64_t)(uint32_t)front << 32) | (uint32_t)back; }
+			static int Front(uint64_t r) { return (int)(r >> 32); }
+			static int Back(uint64_t r) { return (int)(uint32_t)r; }
+		};
+
+		vector<thread> m_workers;
+		unique_ptr<Run[]> m_runs = unique_ptr<Run[]>(new Run[1]);
+		Affinity m_affinity = Affinity::None;
+		mutex m_mutex;
+		condition_variable m_wake;
+		atomic<uint64_t> m_generation{ 0 };
+		atomic<int> m_pending{ 0 };
+		atomic<bool> m_quit{ false };
+
+		const void* m_body = nullptr;
+		void (*m_invoke)(const void*, int, int) = nullptr;
+		int m_count = 0;
+		int m_chunkSize = 1;
+
+		// Busy-waits briefly, then yields so that waiting threads do not starve working ones when there are more threads than cores
+		static void Backoff(int spin)
+		{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+			if (spin < k_pauseIterations)
+			{
+				_mm_pause();
+				return;
+			}
+#endif
+			this_thread::yield();
+		}
+
+		void Stop()
+		{
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_quit = true;
+				m_generation++;
+			}
+			m_wake.notify_all();
+			for (auto& worker : m_workers) worker.join();
+			m_workers.clear();
+			m_quit.store(false, memory_order_release);
+		}
+
+		void RunChunk(int chunk)
+		{
+			int begin = chunk * m_chunkSize;
+			m_invoke(m_body, begin, min(begin + m_chunkSize, m_count));
+		}
+
+		// Own run first, then steal from the other threads until no chunk is left anywhere
+		void Work(int thread)
+		{
+			int n = numThreads();
+			for (int chunk = m_runs[thread].PopFront(); chunk >= 0; chunk = m_runs[thread].PopFront())
+			{
+				RunChunk(chunk);
+			}
+			for (int i = 1; i < n; i++)
+			{
+				auto& victim = m_runs[(thread + i) % n];
+				for (int chunk = victim.PopBack(); chunk >= 0; chunk = victim.PopBack())
+				{
+					RunChunk(chunk);
+				}
+			}
+		}
+
+		void WorkerLoop(int thread, uint64_t seen)
+		{
+			while (true)
+			{
+				// Spin first: the next call usually follows within microseconds
+				for (int spin = 0; spin < k_spinIterations && m_generation.load(memory_order_acquire) == seen; spin++)
+				{
+					Backoff(spin);
+				}
+				if (m_generation.load(memory_order_acquire) == seen)
+				{
+					unique_lock<mutex> lock(m_mutex);
+					m_wake.wait(lock, [&]() { return m_generation.load(memory_order_acquire) != seen; });
+				}
+				seen = m_generation.load(memory_order_acquire);
+
+				if (m_quit.load(memory_order_acquire)) return;
+				Work(thread);
+				m_pending.fetch_sub(1, memory_order_release);
+			}
+		}
+	};
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <fmt/core.h>
+
+#include "Global.hpp"
+#include "GameInstance.hpp"
+#include "Collider.hpp"
+#include "VtClothObjectCPU.hpp"
+
+namespace Velvet
+{
+	// State of all cloth particles in a scene after one physics frame, together with quality metrics
+	struct VtTrajectoryFrame
+	{
+		vector<glm::vec3> positions;
+		float stretchResidual = 0;	//!< Mean relative error |d - d0| / d0 over all stretch constraints
+		float penetration = 0;		//!< Deepest particle penetration into any enabled collider (collision margin excluded)
+		float kineticEnergy = 0;	//!< 0.5 * sum(v^2) over all particles with unit mass
+	};
+
+	// Acceptable differences between a candidate run and its reference
+	struct VtTrajectoryTolerance
+	{
+		float position = 0.05f;		//!< Max distance between a candidate particle and its reference position
+		float stretch = 0.01f;		//!< Max increase of the stretch residual
+		float penetration = 0.005f;	//!< Max increase of the collider penetration depth
+		float energy = 0.1f;		//!< Max kinetic energy difference, relative to the peak reference kinetic energy
+	};
+
+	// Worst values of every metric over all compared frames
+	struct VtTrajectoryComparison
+	{
+		int numFrames = 0;
+		float position = 0;
+		float stretch = 0;
+		float penetration = 0;
+		float energy = 0;
+		int firstFailedFrame = -1;
+
+		bool Passed() const { return firstFailedFrame < 0; }
+	};
+
+	// Per-frame particle positions of a scene, recorded from a reference solver and compared against candidates.
+	class VtTrajectory
+	{
+	public:
+		vector<VtTrajectoryFrame> frames;
+		bool jacobi = false;	//!< Recorded with Global::simParams.jacobiCPU, whose trajectories diverge from Gauss-Seidel ones
+
+		static VtTrajectoryFrame Capture(GameInstance* game)
+		{
+			VtTrajectoryFrame frame;
+			double residual = 0;
+			size_t numConstraints = 0;
+
+			auto colliders = game->FindComponents<Collider>();
+			for (auto cloth : game->FindComponents<VtClothObjectCPU>())
+			{
+				auto solver = cloth->solver();
+				const auto& positions = solver->m_positions;
+				// Recorded in mesh order, so that trajectories do not depend on how the solver orders particles
+				for (int i = 0; i < positions.size(); i++)
+				{
+					frame.positions.push_back(positions[solver->ParticleIndex(i)]);
+				}
+				for (int i = 0; i < positions.size(); i++)
+				{
+					glm::vec3 v = solver->Velocity(i);
+					frame.kineticEnergy += 0.5f * glm::dot(v, v);
+				}
+
+				const auto& stretch = solver->m_stretchConstraints;
+				for (size_t c = 0; c < stretch.size(); c++)
+				{
+					float restLength = stretch.rest[c];
+					float length = glm::length(positions[stretch.indices[c].idx1] - positions[stretch.indices[c].idx2]);
+					residual += fabs(length - restLength) / restLength;
+				}
+				numConstraints += solver->m_stretchConstraints.size();
+
+				for (int i = 0; i < positions.size(); i++)
+				{
+					glm::vec3 p = positions[i];
+					for (auto col : colliders)
+					{
+						if (!col->enabled) continue;
+						float depth = glm::length(col->ComputeSDF(p)) - Global::simParams.collisionMargin;
+						frame.penetration = max(frame.penetration, depth);
+					}
+				}
+			}
+			frame.stretchResidual = numConstraints > 0 ? (float)(residual / numConstraints) : 0.0f;
+			return frame;
+		}
+
+		// Compares frame by frame; stops at the shorter of both trajectories
+		VtTrajectoryComparison Compare(const VtTrajectory& candidate, const VtTrajectoryTolerance& tolerance) const
+		{
+			VtTrajectoryComparison result;
+			float peakEnergy = 1e-6f;
+			for (const auto& f : frames) peakEnergy = max(peakEnergy, f.kineticEnergy);
+
+			result.numFrames = (int)min(frames.size(), candidate.frames.size());
+			for (int i = 0; i < result.numFrames; i++)
+			{
+				const auto& ref = frames[i];
+				const auto& cand = candidate.frames[i];
+				if (ref.positions.size() != cand.positions.size())
+				{
+					fmt::print("Error(Trajectory): Frame {} has {} particles, reference has {}.\n", i, cand.positions.size(), ref.positions.size());
+					result.firstFailedFrame = i;
+					return result;
+				}
+
+				float position = 0;
+				for (int p = 0; p < ref.positions.size(); p++)
+				{
+					position = max(position, glm::length(ref.positions[p] - cand.positions[p]));
+				}
+				float stretch = cand.stretchResidual - ref.stretchResidual;
+				float penetration = cand.penetration - ref.penetration;
+				float energy = fabs(cand.kineticEnergy - ref.kineticEnergy) / peakEnergy;
+
+				result.position = max(result.position, position);
+				result.stretch = max(result.stretch, stretch);
+				result.penetration = max(result.penetration, penetration);
+				result.energy = max(result.energy, energy);
+
+				bool failed = position > tolerance.position || stretch > tolerance.stretch ||
+					penetration > tolerance.penetration || energy > tolerance.energy;
+				if (failed && result.firstFailedFrame < 0)
+				{
+					result.firstFailedFrame = i;
+				}
+			}
+			return result;
+		}
+
+		// First frame whose positions differ from the candidate's, -1 if both trajectories are identical. Coordinates are
+		// the same if they have the same bits or compare equal, so -0 and +0 match and so do identical NaNs.
+		int FirstMismatch(const VtTrajectory& candidate) const
+		{
+			auto same = [](float a, float b) { return a == b || memcmp(&a, &b, sizeof(float)) == 0; };
+			size_t numFrames = min(frames.size(), candidate.frames.size());
+			for (size_t i = 0; i < numFrames; i++)
+			{
+				const auto& a = frames[i].positions;
+				const auto& b = candidate.frames[i].positions;
+				if (a.size() != b.size()) return (int)i;
+				for (size_t p = 0; p < a.size(); p++)
+				{
+					if (!same(a[p].x, b[p].x) || !same(a[p].y, b[p].y) || !same(a[p].z, b[p].z)) return (int)i;
+				}
+			}
+			return frames.size() == candidate.frames.size() ? -1 : (int)numFrames;
+		}
+
+		bool Save(const string& path) const
+		{
+			ofstream file(path, ios::binary);
+			if (!file.is_open())
+			{
+				fmt::print("Error(Trajectory): Unable to open [{}] for writing.\n", path);
+				return false;
+			}
+
+			uint32_t header[5] = { k_magic, k_version, (uint32_t)frames.size(), frames.empty() ? 0u : (uint32_t)frames[0].positions.size(),
+				jacobi ? 1u : 0u };
+			file.write((const char*)header, sizeof(header));
+			for (const auto& f : frames)
+			{
+				float metrics[3] = { f.stretchResidual, f.penetration, f.kineticEnergy };
+				file.write((const char*)metrics, sizeof(metrics));
+				file.write((const char*)f.positions.data(), f.positions.size() * sizeof(glm::vec3));
+			}
+			return true;
+		}
+
+		bool Load(const string& path)
+		{
+			ifstream file(path, ios::binary);
+			// Version 1 files have no solver field and were all recorded with Gauss-Seidel
+			uint32_t header[5] = {};
+			if (!file.is_open() || !file.read((char*)header, 4 * sizeof(uint32_t)) || header[0] != k_magic ||
+				header[1] < 1 || header[1] > k_version || (header[1] >= 2 && !file.read((char*)&header[4], sizeof(uint32_t))))
+			{
+				fmt::print("Error(Trajectory): [{}] is missing or not a trajectory file.\n", path);
+				return false;
+			}
+			jacobi = header[4] != 0;
+
+			frames = vector<VtTrajectoryFrame>(header[2]);
+			for (auto& f : frames)
+			{
+				float metrics[3];
+				f.positions.resize(header[3]);
+				file.read((char*)metrics, sizeof(metrics));
+				file.read((char*)f.positions.data(), f.positions.size() * sizeof(glm::vec3));
+				f.stretchResidual = metrics[0];
+				f.penetration = metrics[1];
+				f.kineticEnergy = metrics[2];
+			}
+			if (!file)
+			{
+				fmt::print("Error(Trajectory): [{}] is truncated.\n", path);
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		static constexpr uint32_t k_magic = 0x52545456; // "VTTR"
+		static constexpr uint32_t k_version = 2;
+	};
+}
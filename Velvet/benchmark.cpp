@@ -0,0 +1,10 @@
+#include "VtSolverBenchmark.hpp"
+
+using namespace Velvet;
+
+// Entry point of the VelvetBenchmark project (compiled with VT_HEADLESS).
+int main(int argc, char** argv)
+{
+	VtSolverBenchmark benchmark(argc, argv);
+	return benchmark.Run();
+}
@@ -1,13 +1,18 @@
 #include <iostream>
 
-#include "VtEngine.hpp"
 #include "GameInstance.hpp"
-#include "Resource.hpp"
 #include "Scene.hpp"
 #include "Helper.hpp"
+#ifdef VT_HEADLESS
+#include "VtHeadlessEngine.hpp"
+#else
+#include "VtEngine.hpp"
+#include "Resource.hpp"
+#endif
 
 using namespace Velvet;
 
+#ifndef VT_HEADLESS
 class ScenePremitiveRendering : public Scene
 {
 public:
@@ -120,7 +125,7 @@ public:
 			});
 	}
 };
-
+#endif
 
 class SceneClothAttach : public Scene
 {
@@ -356,12 +361,16 @@ public:
 	}
 };
 
-int main()
+int main(int argc, char** argv)
 {
 	//=====================================
 	// 1. Create graphics
 	//=====================================
+#ifdef VT_HEADLESS
+	auto engine = make_shared<VtHeadlessEngine>(argc, argv);
+#else
 	auto engine = make_shared<VtEngine>();
+#endif
 
 	//=====================================
 	// 2. Instantiate actors